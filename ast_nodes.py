@@ -1,7 +1,7 @@
 """AST node classes for MiniPy."""
 
-from dataclasses import dataclass
-from typing import List, Optional, Union
+from dataclasses import dataclass, field
+from typing import Any, List, Optional, Union
 
 
 class ASTNode:
@@ -62,6 +62,77 @@ class While(ASTNode):
         return f"While({self.cond}, {len(self.body)} stmts)"
 
 
+@dataclass
+class For(ASTNode):
+    """Counting loop: for var in range(start, stop, step): body"""
+    var: str
+    start: 'Expression'
+    stop: 'Expression'
+    step: 'Expression'
+    body: List['Statement']
+    line: int = 0
+    
+    def __repr__(self):
+        return f"For({self.var}, {self.start}, {self.stop}, {self.step}, {len(self.body)} stmts)"
+
+
+@dataclass
+class Checkpoint(ASTNode):
+    """Checkpoint statement: marks where a VM snapshot may be taken"""
+    line: int = 0
+    
+    def __repr__(self):
+        return "Checkpoint()"
+
+
+@dataclass
+class FunctionDef(ASTNode):
+    """Function definition: def name(params) -> return_type: body"""
+    name: str
+    params: List[str]
+    param_types: List[str]  # "int", "bool", "str" or "array" per parameter
+    return_type: str
+    body: List['Statement']
+    line: int = 0
+    
+    def __repr__(self):
+        return f"FunctionDef({self.name}, {self.params}, {len(self.body)} stmts)"
+
+
+@dataclass
+class Return(ASTNode):
+    """Return statement: return expression"""
+    expr: 'Expression'
+    line: int = 0
+    
+    def __repr__(self):
+        return f"Return({self.expr})"
+
+
+@dataclass
+class ExprStmt(ASTNode):
+    """Expression evaluated for its side effects (a call); the result is discarded"""
+    expr: 'Expression'
+    line: int = 0
+    
+    def __repr__(self):
+        return f"ExprStmt({self.expr})"
+
+
+@dataclass
+class IndexAssign(ASTNode):
+    """Element store: array[index] = expression"""
+    array: 'Expression'
+    index: 'Expression'
+    expr: 'Expression'
+    line: int = 0
+    # Cleared by the optimizer once the index is proven to be in bounds
+    checked: bool = field(default=True, compare=False, repr=False)
+    
+    def __repr__(self):
+        return f"IndexAssign({self.array}, {self.index}, {self.expr})"
+
+
 @dataclass
 class BinOp(ASTNode):
     """Binary operation: left op right"""
@@ -69,6 +140,8 @@ class BinOp(ASTNode):
     op: str
     right: 'Expression'
     line: int = 0
+    # Type from semantic analysis (None until analyzed)
+    type: Any = field(default=None, compare=False, repr=False)
     
     def __repr__(self):
         return f"BinOp({self.left}, {self.op}, {self.right})"
@@ -79,22 +152,90 @@ class Number(ASTNode):
     """Number literal."""
     value: int
     line: int = 0
+    # Type from semantic analysis (None until analyzed)
+    type: Any = field(default=None, compare=False, repr=False)
     
     def __repr__(self):
         return f"Number({self.value})"
 
 
+@dataclass
+class String(ASTNode):
+    """String literal."""
+    value: str
+    line: int = 0
+    # Type from semantic analysis (None until analyzed)
+    type: Any = field(default=None, compare=False, repr=False)
+    
+    def __repr__(self):
+        return f"String({self.value!r})"
+
+
 @dataclass
 class Var(ASTNode):
     """Variable reference."""
     name: str
     line: int = 0
+    # Type from semantic analysis (None until analyzed)
+    type: Any = field(default=None, compare=False, repr=False)
     
     def __repr__(self):
         return f"Var({self.name})"
 
 
+@dataclass
+class Call(ASTNode):
+    """Function call: name(args)"""
+    name: str
+    args: List['Expression']
+    line: int = 0
+    # Type from semantic analysis (None until analyzed)
+    type: Any = field(default=None, compare=False, repr=False)
+    
+    def __repr__(self):
+        return f"Call({self.name}, {self.args})"
+
+
+@dataclass
+class Index(ASTNode):
+    """Element load: array[index]"""
+    array: 'Expression'
+    index: 'Expression'
+    line: int = 0
+    # Type from semantic analysis (None until analyzed)
+    type: Any = field(default=None, compare=False, repr=False)
+    # Cleared by the optimizer once the index is proven to be in bounds
+    checked: bool = field(default=True, compare=False, repr=False)
+    
+    def __repr__(self):
+        return f"Index({self.array}, {self.index})"
+
+
+def assigned_names(statements: List['Statement']) -> List[str]:
+    """Names assigned anywhere in a statement list, in first-assignment order.
+    
+    Inside a function these are its locals, as in Python. Storing to an
+    array element does not rebind the array's name.
+    """
+    names = []
+    for stmt in statements:
+        if isinstance(stmt, Assign):
+            found = [stmt.name]
+        elif isinstance(stmt, If):
+            found = assigned_names(stmt.then_body) + assigned_names(stmt.else_body or [])
+        elif isinstance(stmt, While):
+            found = assigned_names(stmt.body)
+        elif isinstance(stmt, For):
+            found = [stmt.var] + assigned_names(stmt.body)
+        else:
+            continue
+        for name in found:
+            if name not in names:
+                names.append(name)
+    return names
+
+
 # Type aliases for type hints
-Statement = Union[Assign, Print, If, While]
-Expression = Union[BinOp, Number, Var]
+Statement = Union[Assign, IndexAssign, Print, If, While, For, Checkpoint, FunctionDef, Return, ExprStmt]
+Expression = Union[BinOp, Number, String, Var, Call, Index]
 
@@ -1,7 +1,11 @@
 """AST visualization using Graphviz."""
 
 from typing import Optional
-from ast_nodes import ASTNode, Program, Assign, Print, If, While, BinOp, Number, Var
+from ast_nodes import (
+    ASTNode, Program, Assign, Print, If, While, For, Checkpoint,
+    FunctionDef, Return, ExprStmt, BinOp, Number, String, Var, Call, Index, IndexAssign
+)
+from bytecode_serializer import quote_string
 
 
 def ast_to_dot(node: ASTNode, output_file: str) -> None:
@@ -34,6 +38,14 @@ def ast_to_dot(node: ASTNode, output_file: str) -> None:
                 lines.append(f'  {parent_id} -> {node_id};')
             add_node(node.expr, node_id)
         
+        elif isinstance(node, IndexAssign):
+            label = "IndexAssign"
+            lines.append(f'  {node_id} [label="{label}"];')
+            if parent_id:
+                lines.append(f'  {parent_id} -> {node_id};')
+            for expr in (node.array, node.index, node.expr):
+                add_node(expr, node_id)
+        
         elif isinstance(node, Print):
             label = "Print"
             lines.append(f'  {node_id} [label="{label}"];')
@@ -66,6 +78,52 @@ def ast_to_dot(node: ASTNode, output_file: str) -> None:
             for stmt in node.body:
                 add_node(stmt, node_id)
         
+        elif isinstance(node, For):
+            label = f"For\\n{node.var}"
+            lines.append(f'  {node_id} [label="{label}"];')
+            if parent_id:
+                lines.append(f'  {parent_id} -> {node_id};')
+            for expr in (node.start, node.stop, node.step):
+                add_node(expr, node_id)
+            for stmt in node.body:
+                add_node(stmt, node_id)
+        
+        elif isinstance(node, Checkpoint):
+            lines.append(f'  {node_id} [label="Checkpoint"];')
+            if parent_id:
+                lines.append(f'  {parent_id} -> {node_id};')
+        
+        elif isinstance(node, FunctionDef):
+            label = f"FunctionDef\\n{node.name}({', '.join(node.params)})"
+            lines.append(f'  {node_id} [label="{label}"];')
+            if parent_id:
+                lines.append(f'  {parent_id} -> {node_id};')
+            for stmt in node.body:
+                add_node(stmt, node_id)
+        
+        elif isinstance(node, (Return, ExprStmt)):
+            label = type(node).__name__
+            lines.append(f'  {node_id} [label="{label}"];')
+            if parent_id:
+                lines.append(f'  {parent_id} -> {node_id};')
+            add_node(node.expr, node_id)
+        
+        elif isinstance(node, Call):
+            label = f"Call\\n{node.name}"
+            lines.append(f'  {node_id} [label="{label}"];')
+            if parent_id:
+                lines.append(f'  {parent_id} -> {node_id};')
+            for arg in node.args:
+                add_node(arg, node_id)
+        
+        elif isinstance(node, Index):
+            label = "Index"
+            lines.append(f'  {node_id} [label="{label}"];')
+            if parent_id:
+                lines.append(f'  {parent_id} -> {node_id};')
+            add_node(node.array, node_id)
+            add_node(node.index, node_id)
+        
         elif isinstance(node, BinOp):
             label = f"BinOp\\n{node.op}"
             lines.append(f'  {node_id} [label="{label}"];')
@@ -84,6 +142,14 @@ def ast_to_dot(node: ASTNode, output_file: str) -> None:
             if parent_id:
                 lines.append(f'  {parent_id} -> {node_id};')
         
+        elif isinstance(node, String):
+            # Quoted as in the source, then escaped for DOT
+            text = quote_string(node.value).replace("\\", "\\\\").replace('"', '\\"')
+            label = f"String\\n{text}"
+            lines.append(f'  {node_id} [label="{label}"];')
+            if parent_id:
+                lines.append(f'  {parent_id} -> {node_id};')
+        
         elif isinstance(node, Var):
             label = f"Var\\n{node.name}"
             lines.append(f'  {node_id} [label="{label}"];')
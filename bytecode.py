@@ -5,6 +5,9 @@
 LOAD_CONST = "LOAD_CONST"
 LOAD_NAME = "LOAD_NAME"
 STORE_NAME = "STORE_NAME"
+# Frame-local slots, by index
+LOAD_FAST = "LOAD_FAST"
+STORE_FAST = "STORE_FAST"
 ADD = "ADD"
 SUB = "SUB"
 MUL = "MUL"
@@ -15,11 +18,63 @@ CMP_LE = "CMP_LE"
 CMP_GE = "CMP_GE"
 CMP_EQ = "CMP_EQ"
 CMP_NEQ = "CMP_NEQ"
+# Integer-only forms, emitted when both operands are typed int
+ADD_INT = "ADD_INT"
+SUB_INT = "SUB_INT"
+MUL_INT = "MUL_INT"
+DIV_INT = "DIV_INT"
+CMP_LT_INT = "CMP_LT_INT"
+CMP_GT_INT = "CMP_GT_INT"
+CMP_LE_INT = "CMP_LE_INT"
+CMP_GE_INT = "CMP_GE_INT"
+CMP_EQ_INT = "CMP_EQ_INT"
+CMP_NEQ_INT = "CMP_NEQ_INT"
 JUMP = "JUMP"
 JUMP_IF_FALSE = "JUMP_IF_FALSE"
 JUMP_IF_TRUE = "JUMP_IF_TRUE"
+# Fused compare-and-branch: pop b, pop a, jump if (a op b)
+JUMP_IF_LT = "JUMP_IF_LT"
+JUMP_IF_GT = "JUMP_IF_GT"
+JUMP_IF_LE = "JUMP_IF_LE"
+JUMP_IF_GE = "JUMP_IF_GE"
+JUMP_IF_EQ = "JUMP_IF_EQ"
+JUMP_IF_NEQ = "JUMP_IF_NEQ"
+# Counting loop step over [counter, stop, step] on the stack: push the counter
+# and advance it, or pop all three and jump once the range is exhausted
+FOR_RANGE = "FOR_RANGE"
+# CALL's argument is the index of a Function constant
+CALL = "CALL"
+# Call in tail position: reuses the current frame
+TAIL_CALL = "TAIL_CALL"
+RETURN = "RETURN"
 POP = "POP"
+# Stack shuffles: DUP pushes a copy of the top value, SWAP exchanges the top
+# two, ROT moves the third value up to the top (a b c -> b c a)
+DUP = "DUP"
+SWAP = "SWAP"
+ROT = "ROT"
+# Fixed-size int arrays: NEW_ARRAY pops a length and pushes a zeroed array,
+# LOAD_INDEX pops index and array, STORE_INDEX pops index, array and value.
+# The UNCHECKED forms skip the bounds check; the optimizer emits them only
+# where the index is proven to be in range.
+NEW_ARRAY = "NEW_ARRAY"
+ARRAY_LEN = "ARRAY_LEN"
+LOAD_INDEX = "LOAD_INDEX"
+LOAD_INDEX_UNCHECKED = "LOAD_INDEX_UNCHECKED"
+STORE_INDEX = "STORE_INDEX"
+STORE_INDEX_UNCHECKED = "STORE_INDEX_UNCHECKED"
+# Whole-array builtins (SIMD kernels in the C++ VM), arguments pushed in
+# order: array_sum(a), array_min(a), array_max(a), array_fill(a, v) and
+# array_add(a, b, out) (which push the array they wrote) and
+# array_count_lt(a, k).
+ARRAY_SUM = "ARRAY_SUM"
+ARRAY_MIN = "ARRAY_MIN"
+ARRAY_MAX = "ARRAY_MAX"
+ARRAY_FILL = "ARRAY_FILL"
+ARRAY_ADD = "ARRAY_ADD"
+ARRAY_COUNT_LT = "ARRAY_COUNT_LT"
 PRINT = "PRINT"
+CHECKPOINT = "CHECKPOINT"
 HALT = "HALT"
 
 
@@ -40,6 +95,23 @@ class Instruction:
         return self.opcode == other.opcode and self.arg == other.arg
 
 
+class Function:
+    """Function constant: CALL moves its nparams arguments into the first of
+    nlocals local slots and continues at entry."""
+    def __init__(self, name, nparams, entry=None, nlocals=None):
+        self.name = name
+        self.nparams = nparams
+        self.entry = entry
+        self.nlocals = nlocals
+    
+    def __repr__(self):
+        return f"<function {self.name}>"
+    
+    def serialize(self):
+        """Constant-pool line read by the C++ loader."""
+        return f"func {self.name} {self.entry} {self.nparams} {self.nlocals}"
+
+
 def format_bytecode(code):
     """Format bytecode for display."""
     lines = []
@@ -1,7 +1,16 @@
 """Serialize bytecode to file format for C++ VM."""
 
 from typing import List
-from bytecode import Instruction
+from bytecode import Instruction, Function
+
+
+# Escapes that keep a string constant on one line and unambiguous
+STRING_ESCAPES = {"\\": "\\\\", "\"": "\\\"", "\n": "\\n", "\t": "\\t"}
+
+
+def quote_string(text: str) -> str:
+    """Write a string constant as a double-quoted literal."""
+    return '"' + "".join(STRING_ESCAPES.get(char, char) for char in text) + '"'
 
 
 def serialize_bytecode(code: List[Instruction], consts: List, names: List[str], filename: str) -> None:
@@ -18,7 +27,12 @@ def serialize_bytecode(code: List[Instruction], consts: List, names: List[str],
         # Write constants
         f.write(f"{len(consts)}\n")
         for const in consts:
-            f.write(f"{const}\n")
+            if isinstance(const, Function):
+                f.write(f"{const.serialize()}\n")
+            elif isinstance(const, str):
+                f.write(f"{quote_string(const)}\n")
+            else:
+                f.write(f"{const}\n")
         
         # Write names
         f.write(f"{len(names)}\n")
@@ -1,13 +1,76 @@
 """Compiler: converts AST to bytecode."""
 
-from ast_nodes import Program, Assign, Print, If, While, BinOp, Number, Var
+from ast_nodes import (
+    Program, Assign, Print, If, While, For, Checkpoint, FunctionDef, Return, ExprStmt,
+    BinOp, Number, String, Var, Call, Index, IndexAssign, assigned_names
+)
 from bytecode import (
-    Instruction, LOAD_CONST, LOAD_NAME, STORE_NAME, ADD, SUB, MUL, DIV,
+    Instruction, Function, LOAD_CONST, LOAD_NAME, STORE_NAME, LOAD_FAST, STORE_FAST,
+    ADD, SUB, MUL, DIV, CALL, TAIL_CALL, RETURN,
     CMP_LT, CMP_GT, CMP_LE, CMP_GE, CMP_EQ, CMP_NEQ,
-    JUMP, JUMP_IF_FALSE, JUMP_IF_TRUE, POP, PRINT, HALT
+    JUMP, JUMP_IF_FALSE, JUMP_IF_TRUE, FOR_RANGE, POP, DUP, PRINT, CHECKPOINT, HALT,
+    NEW_ARRAY, ARRAY_LEN, LOAD_INDEX, LOAD_INDEX_UNCHECKED, STORE_INDEX, STORE_INDEX_UNCHECKED,
+    ARRAY_SUM, ARRAY_MIN, ARRAY_MAX, ARRAY_FILL, ARRAY_ADD, ARRAY_COUNT_LT,
+    JUMP_IF_LT, JUMP_IF_GT, JUMP_IF_LE, JUMP_IF_GE, JUMP_IF_EQ, JUMP_IF_NEQ,
+    ADD_INT, SUB_INT, MUL_INT, DIV_INT,
+    CMP_LT_INT, CMP_GT_INT, CMP_LE_INT, CMP_GE_INT, CMP_EQ_INT, CMP_NEQ_INT
 )
-from semantic import SemanticAnalyzer
-from optimizer import Optimizer
+from semantic import SemanticAnalyzer, INT, BOOL
+from optimizer import Optimizer, is_safe
+
+
+# Fused jump taken when a comparison is false. Negating the operator is only
+# valid for totally ordered operands, so it is used when both sides are typed
+# int or bool.
+INVERTED_BRANCH = {
+    "<": JUMP_IF_GE,
+    ">": JUMP_IF_LE,
+    "<=": JUMP_IF_GT,
+    ">=": JUMP_IF_LT,
+    "==": JUMP_IF_NEQ,
+    "!=": JUMP_IF_EQ,
+}
+
+# Specialized opcodes for operators whose operands are both typed int
+INT_OPCODES = {
+    "+": ADD_INT,
+    "-": SUB_INT,
+    "*": MUL_INT,
+    "/": DIV_INT,
+    "<": CMP_LT_INT,
+    ">": CMP_GT_INT,
+    "<=": CMP_LE_INT,
+    ">=": CMP_GE_INT,
+    "==": CMP_EQ_INT,
+    "!=": CMP_NEQ_INT,
+}
+
+# Builtin functions and the opcode each one compiles to
+BUILTIN_OPCODES = {
+    "array": NEW_ARRAY,
+    "len": ARRAY_LEN,
+    "array_sum": ARRAY_SUM,
+    "array_min": ARRAY_MIN,
+    "array_max": ARRAY_MAX,
+    "array_fill": ARRAY_FILL,
+    "array_add": ARRAY_ADD,
+    "array_count_lt": ARRAY_COUNT_LT,
+}
+
+
+# Value a function returns when it falls off its end, by return type (int: 0;
+# an array return makes array(0) from it)
+ZERO_VALUES = {"bool": False, "str": ""}
+
+
+# Opcodes whose argument is a jump target (FOR_RANGE jumps when the range is done)
+JUMP_OPCODES = {
+    JUMP, JUMP_IF_FALSE, JUMP_IF_TRUE, FOR_RANGE,
+    JUMP_IF_LT, JUMP_IF_GT, JUMP_IF_LE, JUMP_IF_GE, JUMP_IF_EQ, JUMP_IF_NEQ,
+}
+
+# Instructions after which control never falls through to the next one
+TERMINATORS = {JUMP, RETURN, TAIL_CALL, HALT}
 
 
 class Compiler:
@@ -19,14 +82,18 @@ class Compiler:
         self.names = []
         self.const_map = {}  # Map values to indices
         self.name_map = {}  # Map names to indices
+        self.functions = {}  # Map function names to constant indices
+        self.locals = None  # Map local names to slots inside a function body
     
     def const_index(self, value):
         """Get or create constant index."""
-        if value not in self.const_map:
+        # Keyed by type too, so True and 1 get separate constants
+        key = (type(value), value)
+        if key not in self.const_map:
             idx = len(self.consts)
             self.consts.append(value)
-            self.const_map[value] = idx
-        return self.const_map[value]
+            self.const_map[key] = idx
+        return self.const_map[key]
     
     def name_index(self, name):
         """Get or create name index."""
@@ -47,15 +114,31 @@ class Compiler:
             return self.compile_program(node)
         elif isinstance(node, Assign):
             return self.compile_assign(node)
+        elif isinstance(node, IndexAssign):
+            return self.compile_index_assign(node)
         elif isinstance(node, Print):
             return self.compile_print(node)
         elif isinstance(node, If):
             return self.compile_if(node)
         elif isinstance(node, While):
             return self.compile_while(node)
+        elif isinstance(node, For):
+            return self.compile_for(node)
+        elif isinstance(node, Checkpoint):
+            return self.compile_checkpoint(node)
+        elif isinstance(node, FunctionDef):
+            return None  # Bodies are compiled after the top-level code
+        elif isinstance(node, Return):
+            return self.compile_return(node)
+        elif isinstance(node, ExprStmt):
+            return self.compile_expr_stmt(node)
+        elif isinstance(node, Call):
+            return self.compile_call(node)
+        elif isinstance(node, Index):
+            return self.compile_index(node)
         elif isinstance(node, BinOp):
             return self.compile_binop(node)
-        elif isinstance(node, Number):
+        elif isinstance(node, (Number, String)):
             return self.compile_number(node)
         elif isinstance(node, Var):
             return self.compile_var(node)
@@ -63,30 +146,120 @@ class Compiler:
             raise ValueError(f"Unknown node type: {type(node)}")
     
     def compile_program(self, node):
-        """Compile a program."""
+        """Compile a program: top-level code, HALT, then each function body."""
+        functions = [stmt for stmt in node.statements if isinstance(stmt, FunctionDef)]
+        # Constants first, so calls can be emitted before their bodies exist
+        for func in functions:
+            self.functions[func.name] = self.const_index(Function(func.name, len(func.params)))
         for stmt in node.statements:
             self.compile(stmt)
         self.emit(HALT)
+        for func in functions:
+            self.compile_function_body(func)
+        self.code = peephole(self.code, [const for const in self.consts if isinstance(const, Function)])
         return self.code, self.consts, self.names
     
+    def compile_function_body(self, node):
+        """Compile a function body, filling in its constant's entry and local count.
+        
+        Parameters take the first local slots, then every other name the
+        body assigns.
+        """
+        function = self.consts[self.functions[node.name]]
+        function.entry = len(self.code)
+        self.locals = {name: slot for slot, name in enumerate(node.params)}
+        for name in assigned_names(node.body):
+            if name not in self.locals:
+                self.locals[name] = len(self.locals)
+        
+        for stmt in node.body:
+            self.compile(stmt)
+        # Falling off the end returns the zero value of the return type
+        if not node.body or not isinstance(node.body[-1], Return):
+            self.emit(LOAD_CONST, self.const_index(ZERO_VALUES.get(node.return_type, 0)))
+            if node.return_type == "array":
+                self.emit(NEW_ARRAY)
+            self.emit(RETURN)
+        
+        function.nlocals = len(self.locals)
+        self.locals = None
+    
     def compile_assign(self, node):
-        """Compile assignment: compile expr, then STORE_NAME"""
+        """Compile assignment: compile expr, then store it"""
         self.compile(node.expr)
-        name_idx = self.name_index(node.name)
-        self.emit(STORE_NAME, name_idx)
+        self.emit_store(node.name)
+    
+    def emit_store(self, name):
+        """Store the top of the stack: STORE_FAST in a function, otherwise STORE_NAME"""
+        if self.locals is not None:
+            self.emit(STORE_FAST, self.locals[name])
+        else:
+            name_idx = self.name_index(name)
+            self.emit(STORE_NAME, name_idx)
+    
+    def compile_return(self, node):
+        """Compile return: compile expr, then RETURN.
+        
+        Returning a call's result compiles to TAIL_CALL, which replaces the
+        current frame, so tail recursion runs in constant stack space.
+        """
+        if isinstance(node.expr, Call) and node.expr.name in self.functions:
+            for arg in node.expr.args:
+                self.compile(arg)
+            self.emit(TAIL_CALL, self.functions[node.expr.name])
+            return
+        self.compile(node.expr)
+        self.emit(RETURN)
+    
+    def compile_expr_stmt(self, node):
+        """Compile expression statement: compile expr, then POP the result"""
+        self.compile(node.expr)
+        self.emit(POP)
+    
+    def compile_call(self, node):
+        """Compile call: compile arguments left to right, then CALL (or the builtin's opcode)"""
+        for arg in node.args:
+            self.compile(arg)
+        if node.name in self.functions:
+            self.emit(CALL, self.functions[node.name])
+        else:
+            self.emit(BUILTIN_OPCODES[node.name])
+    
+    def compile_index(self, node):
+        """Compile element load: compile array, compile index, then LOAD_INDEX"""
+        self.compile(node.array)
+        self.compile(node.index)
+        self.emit(LOAD_INDEX if node.checked else LOAD_INDEX_UNCHECKED)
+    
+    def compile_index_assign(self, node):
+        """Compile element store: compile expr, array, then index, then STORE_INDEX
+        
+        The value is evaluated first, as in Python.
+        """
+        self.compile(node.expr)
+        self.compile(node.array)
+        self.compile(node.index)
+        self.emit(STORE_INDEX if node.checked else STORE_INDEX_UNCHECKED)
     
     def compile_print(self, node):
         """Compile print: compile expr, then PRINT"""
         self.compile(node.expr)
         self.emit(PRINT)
     
+    def compile_checkpoint(self, node):
+        """Compile checkpoint: CHECKPOINT"""
+        self.emit(CHECKPOINT)
+    
     def compile_if(self, node):
         """Compile if: condition, JUMP_IF_FALSE else_label, then_body, JUMP end_label, else_body"""
-        # Compile condition
-        self.compile(node.cond)
+        if isinstance(node.cond, Number):
+            # Condition folded by the optimizer: only the taken branch is emitted
+            for stmt in node.then_body if node.cond.value else node.else_body or []:
+                self.compile(stmt)
+            return
         
-        # Emit jump if false (to else or end)
-        else_label_pos = self.emit(JUMP_IF_FALSE, None)  # Will patch later
+        # Compile condition and jump if false (to else or end)
+        else_label_pos = self.compile_branch_if_false(node.cond)  # Will patch later
         
         # Compile then body
         for stmt in node.then_body:
@@ -110,13 +283,13 @@ class Compiler:
     
     def compile_while(self, node):
         """Compile while: loop_start, condition, JUMP_IF_FALSE end, body, JUMP start"""
-        loop_start = len(self.code)
+        if isinstance(node.cond, Number) and not node.cond.value:
+            return  # Never runs
         
-        # Compile condition
-        self.compile(node.cond)
+        loop_start = len(self.code)
         
-        # Emit jump if false (to end)
-        end_label_pos = self.emit(JUMP_IF_FALSE, None)  # Will patch later
+        # Compile condition and jump if false (to end)
+        end_label_pos = self.compile_branch_if_false(node.cond)  # Will patch later
         
         # Compile body
         for stmt in node.body:
@@ -129,12 +302,55 @@ class Compiler:
         end_label = len(self.code)
         self.patch_jump(end_label_pos, end_label)
     
+    def compile_for(self, node):
+        """Compile counting loop: start, stop, step, then loop: FOR_RANGE end, store var, body, JUMP loop
+        
+        The counter, stop and step stay on the stack for the whole loop, so
+        each iteration costs FOR_RANGE, the store and the back jump.
+        """
+        self.compile(node.start)
+        self.compile(node.stop)
+        self.compile(node.step)
+        loop_start = len(self.code)
+        end_label_pos = self.emit(FOR_RANGE, None)  # Will patch later
+        self.emit_store(node.var)
+        
+        for stmt in node.body:
+            self.compile(stmt)
+        
+        self.emit(JUMP, loop_start)
+        self.patch_jump(end_label_pos, len(self.code))
+    
+    def compile_branch_if_false(self, cond):
+        """Compile a condition and an unpatched jump taken when it is false.
+        
+        A typed comparison becomes a single fused compare-and-branch, so no
+        bool is pushed just to be popped by JUMP_IF_FALSE.
+        """
+        if (isinstance(cond, BinOp) and cond.op in INVERTED_BRANCH and
+                cond.left.type in (INT, BOOL) and cond.right.type in (INT, BOOL)):
+            self.compile(cond.left)
+            self.compile(cond.right)
+            return self.emit(INVERTED_BRANCH[cond.op], None)
+        self.compile(cond)
+        return self.emit(JUMP_IF_FALSE, None)
+    
     def compile_binop(self, node):
-        """Compile binary operation: compile left, compile right, emit op"""
+        """Compile binary operation: compile left, compile right, emit op
+        
+        When both operands are the same expression (x * x, (a + b) * (a + b))
+        and evaluating it has no effects, the right one is a DUP of the left.
+        """
         self.compile(node.left)
-        self.compile(node.right)
+        if repr(node.left) == repr(node.right) and is_safe(node.left) and not isinstance(node.left, Number):
+            self.emit(DUP)
+        else:
+            self.compile(node.right)
         
-        if node.op == "+":
+        # Operands known to be ints skip the VM's type dispatch
+        if node.left.type == INT and node.right.type == INT and node.op in INT_OPCODES:
+            self.emit(INT_OPCODES[node.op])
+        elif node.op == "+":
             self.emit(ADD)
         elif node.op == "-":
             self.emit(SUB)
@@ -163,16 +379,93 @@ class Compiler:
             self.code[pos].arg = target
     
     def compile_number(self, node):
-        """Compile number: LOAD_CONST"""
+        """Compile number or string literal: LOAD_CONST"""
         const_idx = self.const_index(node.value)
         self.emit(LOAD_CONST, const_idx)
     
     def compile_var(self, node):
-        """Compile variable: LOAD_NAME"""
+        """Compile variable: LOAD_FAST for a local, otherwise LOAD_NAME"""
+        if self.locals is not None and node.name in self.locals:
+            self.emit(LOAD_FAST, self.locals[node.name])
+            return
         name_idx = self.name_index(node.name)
         self.emit(LOAD_NAME, name_idx)
 
 
+def peephole(code, functions):
+    """Thread jumps and drop dead code, re-patching every target.
+    
+    A jump to an unconditional JUMP goes straight to its final target, and a
+    JUMP to HALT or RETURN becomes a copy of it. Unreachable instructions
+    (code after a JUMP, HALT or RETURN that nothing jumps to) and JUMPs to the
+    next surviving instruction are removed. Function entries are updated in
+    place. Repeats until nothing changes. Finally a global stored and read
+    straight back (STORE_NAME x; LOAD_NAME x) is kept on the stack with DUP
+    instead of being looked up again, unless the load is a jump target.
+    """
+    code = [Instruction(instr.opcode, instr.arg) for instr in code]
+    while code:
+        changed = False
+        for instr in code:
+            if instr.opcode not in JUMP_OPCODES:
+                continue
+            target = instr.arg
+            seen = set()
+            while code[target].opcode == JUMP and target not in seen:
+                seen.add(target)
+                target = code[target].arg
+            if code[target].opcode == JUMP:
+                continue  # A loop made only of jumps; leave it alone
+            if instr.opcode == JUMP and code[target].opcode in (HALT, RETURN):
+                instr.opcode, instr.arg = code[target].opcode, None
+                changed = True
+            elif target != instr.arg:
+                instr.arg = target
+                changed = True
+        
+        reachable = [False] * len(code)
+        work = [0] + [function.entry for function in functions]
+        while work:
+            i = work.pop()
+            if i >= len(code) or reachable[i]:
+                continue
+            reachable[i] = True
+            if code[i].opcode in JUMP_OPCODES:
+                work.append(code[i].arg)
+            if code[i].opcode not in TERMINATORS:
+                work.append(i + 1)
+        
+        # A removed instruction maps to where the next kept one ends up
+        keep = []
+        next_reachable = len(code)
+        for i in reversed(range(len(code))):
+            keep.append(reachable[i] and not (code[i].opcode == JUMP and code[i].arg == next_reachable))
+            if reachable[i]:
+                next_reachable = i
+        keep.reverse()
+        if all(keep) and not changed:
+            break
+        new_index = []
+        kept = 0
+        for i in range(len(code)):
+            new_index.append(kept)
+            kept += keep[i]
+        code = [instr for instr, kept in zip(code, keep) if kept]
+        for instr in code:
+            if instr.opcode in JUMP_OPCODES:
+                instr.arg = new_index[instr.arg]
+        for function in functions:
+            function.entry = new_index[function.entry]
+    
+    targets = {instr.arg for instr in code if instr.opcode in JUMP_OPCODES}
+    targets.update(function.entry for function in functions)
+    for i in range(len(code) - 1):
+        if code[i].opcode == STORE_NAME and code[i + 1] == Instruction(LOAD_NAME, code[i].arg) and \
+           i + 1 not in targets:
+            code[i], code[i + 1] = Instruction(DUP), code[i]
+    return code
+
+
 def compile_ast(ast):
     """Convenience function to compile an AST."""
     compiler = Compiler()
@@ -189,15 +482,17 @@ if __name__ == "__main__":
     from bytecode import format_bytecode
     from ast_viz import ast_to_dot
     from bytecode_serializer import serialize_bytecode
+    from ir import build_ir, optimize_ir, lower_ir
     
     if len(sys.argv) < 2:
-        print("Usage: python compiler.py <file.mp> [--debug] [--dump-ast] [--compile-only]")
+        print("Usage: python compiler.py <file.mp> [--debug] [--dump-ast] [--compile-only] [--ssa]")
         sys.exit(1)
     
     filename = sys.argv[1]
     debug = "--debug" in sys.argv
     dump_ast = "--dump-ast" in sys.argv
     compile_only = "--compile-only" in sys.argv
+    ssa = "--ssa" in sys.argv
     
     try:
         # Read source file
@@ -248,7 +543,16 @@ if __name__ == "__main__":
             print(f"Generate visualization with: dot -Tpng {dot_file} -o {dot_file.replace('.dot', '.png')}")
         
         # Compile
-        code, consts, names = compile_ast(ast)
+        if ssa:
+            functions = [optimize_ir(function) for function in build_ir(ast)]
+            if debug:
+                print("=== SSA ===")
+                for function in functions:
+                    print(function.format())
+                print()
+            code, consts, names = lower_ir(functions)
+        else:
+            code, consts, names = compile_ast(ast)
         if debug:
             print("=== BYTECODE ===")
             print(format_bytecode(code))
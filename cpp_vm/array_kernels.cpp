@@ -0,0 +1,350 @@
+#include "array_kernels.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MINIPY_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace minipy {
+
+namespace {
+
+// Portable loops, also used for the tails the vector loops leave over
+
+SplitSum scalar_sum(const int64_t* elements, size_t length) {
+    SplitSum sum;
+    for (size_t i = 0; i < length; i++) {
+        sum.high += elements[i] >> 32;
+        sum.low += static_cast<uint64_t>(elements[i]) & 0xffffffffu;
+    }
+    return sum;
+}
+
+int64_t scalar_min(const int64_t* elements, size_t length) {
+    int64_t best = elements[0];
+    for (size_t i = 1; i < length; i++) {
+        best = elements[i] < best ? elements[i] : best;
+    }
+    return best;
+}
+
+int64_t scalar_max(const int64_t* elements, size_t length) {
+    int64_t best = elements[0];
+    for (size_t i = 1; i < length; i++) {
+        best = elements[i] > best ? elements[i] : best;
+    }
+    return best;
+}
+
+void scalar_fill(int64_t* elements, size_t length, int64_t value) {
+    for (size_t i = 0; i < length; i++) {
+        elements[i] = value;
+    }
+}
+
+size_t scalar_add(const int64_t* a, const int64_t* b, int64_t* out, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        int64_t sum;
+        if (__builtin_add_overflow(a[i], b[i], &sum)) {
+            return i;
+        }
+        out[i] = sum;
+    }
+    return length;
+}
+
+size_t scalar_count_lt(const int64_t* elements, size_t length, int64_t limit) {
+    size_t count = 0;
+    for (size_t i = 0; i < length; i++) {
+        count += elements[i] < limit;
+    }
+    return count;
+}
+
+const ArrayKernels SCALAR_KERNELS = {
+    "scalar", scalar_sum, scalar_min, scalar_max, scalar_fill, scalar_add, scalar_count_lt,
+};
+
+#ifdef MINIPY_X86_KERNELS
+
+// Neither SSE4.2 nor AVX2 has a 64-bit arithmetic shift, so the vector sums
+// add the unsigned upper halves and count the negative elements instead:
+// the signed upper half is the unsigned one minus 2^32 when negative.
+SplitSum split_sum(uint64_t upper, uint64_t lower, uint64_t negatives) {
+    SplitSum sum;
+    sum.high = static_cast<int64_t>(upper) - static_cast<int64_t>(negatives << 32);
+    sum.low = lower;
+    return sum;
+}
+
+SplitSum add_split(SplitSum a, SplitSum b) {
+    a.high += b.high;
+    a.low += b.low;
+    return a;
+}
+
+// SSE4.2: two lanes; _mm_cmpgt_epi64 is the SSE4.2 instruction these need
+
+__attribute__((target("sse4.2")))
+uint64_t sse_total(__m128i v) {
+    return static_cast<uint64_t>(_mm_cvtsi128_si64(v)) + static_cast<uint64_t>(_mm_extract_epi64(v, 1));
+}
+
+__attribute__((target("sse4.2")))
+SplitSum sse_sum(const int64_t* elements, size_t length) {
+    const __m128i mask = _mm_set1_epi64x(0xffffffff);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i upper = zero, lower = zero, negatives = zero;
+    size_t i = 0;
+    for (; i + 2 <= length; i += 2) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements + i));
+        upper = _mm_add_epi64(upper, _mm_srli_epi64(x, 32));
+        lower = _mm_add_epi64(lower, _mm_and_si128(x, mask));
+        negatives = _mm_sub_epi64(negatives, _mm_cmpgt_epi64(zero, x));
+    }
+    return add_split(split_sum(sse_total(upper), sse_total(lower), sse_total(negatives)),
+                     scalar_sum(elements + i, length - i));
+}
+
+__attribute__((target("sse4.2")))
+int64_t sse_min(const int64_t* elements, size_t length) {
+    if (length < 2) {
+        return scalar_min(elements, length);
+    }
+    __m128i best = _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements));
+    size_t i = 2;
+    for (; i + 2 <= length; i += 2) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements + i));
+        best = _mm_blendv_epi8(best, x, _mm_cmpgt_epi64(best, x));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), best);
+    int64_t result = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+    for (; i < length; i++) {
+        result = elements[i] < result ? elements[i] : result;
+    }
+    return result;
+}
+
+__attribute__((target("sse4.2")))
+int64_t sse_max(const int64_t* elements, size_t length) {
+    if (length < 2) {
+        return scalar_max(elements, length);
+    }
+    __m128i best = _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements));
+    size_t i = 2;
+    for (; i + 2 <= length; i += 2) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements + i));
+        best = _mm_blendv_epi8(best, x, _mm_cmpgt_epi64(x, best));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), best);
+    int64_t result = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+    for (; i < length; i++) {
+        result = elements[i] > result ? elements[i] : result;
+    }
+    return result;
+}
+
+__attribute__((target("sse4.2")))
+void sse_fill(int64_t* elements, size_t length, int64_t value) {
+    const __m128i v = _mm_set1_epi64x(value);
+    size_t i = 0;
+    for (; i + 2 <= length; i += 2) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(elements + i), v);
+    }
+    scalar_fill(elements + i, length - i, value);
+}
+
+__attribute__((target("sse4.2")))
+size_t sse_add(const int64_t* a, const int64_t* b, int64_t* out, size_t length) {
+    size_t i = 0;
+    for (; i + 2 <= length; i += 2) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        __m128i sum = _mm_add_epi64(x, y);
+        // Overflow when the sum's sign differs from both operands'
+        __m128i overflow = _mm_and_si128(_mm_xor_si128(x, sum), _mm_xor_si128(y, sum));
+        if (_mm_movemask_pd(_mm_castsi128_pd(overflow)) != 0) {
+            break;
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), sum);
+    }
+    return i + scalar_add(a + i, b + i, out + i, length - i);
+}
+
+__attribute__((target("sse4.2")))
+size_t sse_count_lt(const int64_t* elements, size_t length, int64_t limit) {
+    const __m128i bound = _mm_set1_epi64x(limit);
+    __m128i count = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= length; i += 2) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements + i));
+        count = _mm_sub_epi64(count, _mm_cmpgt_epi64(bound, x));
+    }
+    return sse_total(count) + scalar_count_lt(elements + i, length - i, limit);
+}
+
+const ArrayKernels SSE42_KERNELS = {
+    "sse4.2", sse_sum, sse_min, sse_max, sse_fill, sse_add, sse_count_lt,
+};
+
+// AVX2: four lanes, with the same structure
+
+__attribute__((target("avx2")))
+uint64_t avx_total(__m256i v) {
+    __m128i pair = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return static_cast<uint64_t>(_mm_cvtsi128_si64(pair)) + static_cast<uint64_t>(_mm_extract_epi64(pair, 1));
+}
+
+__attribute__((target("avx2")))
+SplitSum avx_sum(const int64_t* elements, size_t length) {
+    const __m256i mask = _mm256_set1_epi64x(0xffffffff);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i upper = zero, lower = zero, negatives = zero;
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(elements + i));
+        upper = _mm256_add_epi64(upper, _mm256_srli_epi64(x, 32));
+        lower = _mm256_add_epi64(lower, _mm256_and_si256(x, mask));
+        negatives = _mm256_sub_epi64(negatives, _mm256_cmpgt_epi64(zero, x));
+    }
+    return add_split(split_sum(avx_total(upper), avx_total(lower), avx_total(negatives)),
+                     scalar_sum(elements + i, length - i));
+}
+
+__attribute__((target("avx2")))
+int64_t avx_min(const int64_t* elements, size_t length) {
+    if (length < 4) {
+        return scalar_min(elements, length);
+    }
+    __m256i best = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(elements));
+    size_t i = 4;
+    for (; i + 4 <= length; i += 4) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(elements + i));
+        best = _mm256_blendv_epi8(best, x, _mm256_cmpgt_epi64(best, x));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), best);
+    int64_t result = scalar_min(lanes, 4);
+    for (; i < length; i++) {
+        result = elements[i] < result ? elements[i] : result;
+    }
+    return result;
+}
+
+__attribute__((target("avx2")))
+int64_t avx_max(const int64_t* elements, size_t length) {
+    if (length < 4) {
+        return scalar_max(elements, length);
+    }
+    __m256i best = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(elements));
+    size_t i = 4;
+    for (; i + 4 <= length; i += 4) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(elements + i));
+        best = _mm256_blendv_epi8(best, x, _mm256_cmpgt_epi64(x, best));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), best);
+    int64_t result = scalar_max(lanes, 4);
+    for (; i < length; i++) {
+        result = elements[i] > result ? elements[i] : result;
+    }
+    return result;
+}
+
+__attribute__((target("avx2")))
+void avx_fill(int64_t* elements, size_t length, int64_t value) {
+    const __m256i v = _mm256_set1_epi64x(value);
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(elements + i), v);
+    }
+    scalar_fill(elements + i, length - i, value);
+}
+
+__attribute__((target("avx2")))
+size_t avx_add(const int64_t* a, const int64_t* b, int64_t* out, size_t length) {
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        __m256i sum = _mm256_add_epi64(x, y);
+        __m256i overflow = _mm256_and_si256(_mm256_xor_si256(x, sum), _mm256_xor_si256(y, sum));
+        if (_mm256_movemask_pd(_mm256_castsi256_pd(overflow)) != 0) {
+            break;
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), sum);
+    }
+    return i + scalar_add(a + i, b + i, out + i, length - i);
+}
+
+__attribute__((target("avx2")))
+size_t avx_count_lt(const int64_t* elements, size_t length, int64_t limit) {
+    const __m256i bound = _mm256_set1_epi64x(limit);
+    __m256i count = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(elements + i));
+        count = _mm256_sub_epi64(count, _mm256_cmpgt_epi64(bound, x));
+    }
+    return avx_total(count) + scalar_count_lt(elements + i, length - i, limit);
+}
+
+const ArrayKernels AVX2_KERNELS = {
+    "avx2", avx_sum, avx_min, avx_max, avx_fill, avx_add, avx_count_lt,
+};
+
+#endif // MINIPY_X86_KERNELS
+
+// Best first
+const ArrayKernels* const ALL_KERNELS[] = {
+#ifdef MINIPY_X86_KERNELS
+    &AVX2_KERNELS,
+    &SSE42_KERNELS,
+#endif
+    &SCALAR_KERNELS,
+};
+
+bool supported(const ArrayKernels* kernels) {
+#ifdef MINIPY_X86_KERNELS
+    if (kernels == &AVX2_KERNELS) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (kernels == &SSE42_KERNELS) {
+        return __builtin_cpu_supports("sse4.2");
+    }
+#endif
+    return kernels == &SCALAR_KERNELS;
+}
+
+const ArrayKernels* best_kernels(size_t from) {
+    for (size_t i = from; i < sizeof(ALL_KERNELS) / sizeof(ALL_KERNELS[0]); i++) {
+        if (supported(ALL_KERNELS[i])) {
+            return ALL_KERNELS[i];
+        }
+    }
+    return &SCALAR_KERNELS;
+}
+
+const ArrayKernels* active_kernels = best_kernels(0);
+
+} // namespace
+
+const ArrayKernels& array_kernels() {
+    return *active_kernels;
+}
+
+bool limit_array_kernels(const std::string& level) {
+    if (level != "avx2" && level != "sse4.2" && level != "scalar") {
+        return false;
+    }
+    size_t i = 0;
+    while (i < sizeof(ALL_KERNELS) / sizeof(ALL_KERNELS[0]) && ALL_KERNELS[i]->name != level) {
+        i++;
+    }
+    active_kernels = best_kernels(i);
+    return true;
+}
+
+} // namespace minipy
@@ -0,0 +1,44 @@
+#ifndef MINIPY_ARRAY_KERNELS_H
+#define MINIPY_ARRAY_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace minipy {
+
+// Exact sum of int64 elements as high * 2^32 + low: the signed upper and
+// unsigned lower halves are summed separately, so neither can overflow for
+// arrays of up to MAX_ARRAY_LENGTH elements
+struct SplitSum {
+    int64_t high = 0;
+    uint64_t low = 0;
+};
+
+// Loops behind the whole-array opcodes (ARRAY_SUM, ARRAY_MIN, ...). Each
+// instruction set gets its own table; the VM calls through the one chosen at
+// startup.
+struct ArrayKernels {
+    const char* name;
+    SplitSum (*sum)(const int64_t* elements, size_t length);
+    // length must be non-zero
+    int64_t (*min)(const int64_t* elements, size_t length);
+    int64_t (*max)(const int64_t* elements, size_t length);
+    void (*fill)(int64_t* elements, size_t length, int64_t value);
+    // out[i] = a[i] + b[i] in order (out may alias a or b); stops at the first
+    // sum that overflows and returns its index, or length when none does
+    size_t (*add)(const int64_t* a, const int64_t* b, int64_t* out, size_t length);
+    // Number of elements less than limit
+    size_t (*count_lt)(const int64_t* elements, size_t length, int64_t limit);
+};
+
+// The best kernels this CPU supports: AVX2, then SSE4.2, then portable scalar loops
+const ArrayKernels& array_kernels();
+
+// Cap the kernels at "avx2", "sse4.2" or "scalar" (still limited to what the
+// CPU supports); false for an unknown name. Call before any VM runs.
+bool limit_array_kernels(const std::string& level);
+
+} // namespace minipy
+
+#endif // MINIPY_ARRAY_KERNELS_H
@@ -0,0 +1,380 @@
+#include "bigint.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+namespace minipy {
+
+namespace {
+
+using Limbs = std::vector<uint32_t>;
+
+void trim_limbs(Limbs& limbs) {
+    while (!limbs.empty() && limbs.back() == 0) {
+        limbs.pop_back();
+    }
+}
+
+int compare_magnitude(const uint32_t* a, size_t a_size, const uint32_t* b, size_t b_size) {
+    if (a_size != b_size) {
+        return a_size < b_size ? -1 : 1;
+    }
+    for (size_t i = a_size; i-- > 0;) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+int compare_magnitude(const Limbs& a, const Limbs& b) {
+    return compare_magnitude(a.data(), a.size(), b.data(), b.size());
+}
+
+Limbs add_magnitude(const Limbs& a, const Limbs& b) {
+    const Limbs& longer = a.size() >= b.size() ? a : b;
+    const Limbs& shorter = a.size() >= b.size() ? b : a;
+    Limbs result(longer.size() + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < longer.size(); i++) {
+        uint64_t sum = static_cast<uint64_t>(longer[i]) + (i < shorter.size() ? shorter[i] : 0) + carry;
+        result[i] = static_cast<uint32_t>(sum);
+        carry = sum >> 32;
+    }
+    result[longer.size()] = static_cast<uint32_t>(carry);
+    trim_limbs(result);
+    return result;
+}
+
+// Requires |a| >= |b|
+Limbs sub_magnitude(const Limbs& a, const Limbs& b) {
+    Limbs result(a.size());
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        int64_t diff = static_cast<int64_t>(a[i]) - (i < b.size() ? b[i] : 0) - borrow;
+        borrow = diff < 0 ? 1 : 0;
+        result[i] = static_cast<uint32_t>(diff + (borrow << 32));
+    }
+    trim_limbs(result);
+    return result;
+}
+
+Limbs mul_magnitude(const Limbs& a, const Limbs& b) {
+    if (a.empty() || b.empty()) {
+        return Limbs();
+    }
+    Limbs result(a.size() + b.size());
+    for (size_t i = 0; i < a.size(); i++) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < b.size(); j++) {
+            uint64_t cur = static_cast<uint64_t>(a[i]) * b[j] + result[i + j] + carry;
+            result[i + j] = static_cast<uint32_t>(cur);
+            carry = cur >> 32;
+        }
+        result[i + b.size()] = static_cast<uint32_t>(carry);
+    }
+    trim_limbs(result);
+    return result;
+}
+
+// In-place divide by a single limb; returns the remainder
+uint32_t divide_small(Limbs& limbs, uint32_t divisor) {
+    uint64_t rem = 0;
+    for (size_t i = limbs.size(); i-- > 0;) {
+        uint64_t cur = (rem << 32) | limbs[i];
+        limbs[i] = static_cast<uint32_t>(cur / divisor);
+        rem = cur % divisor;
+    }
+    trim_limbs(limbs);
+    return static_cast<uint32_t>(rem);
+}
+
+// Knuth, TAOCP vol. 2, 4.3.1 algorithm D; v must be non-zero
+void divmod_magnitude(const Limbs& u, const Limbs& v, Limbs& quotient, Limbs& remainder) {
+    if (compare_magnitude(u, v) < 0) {
+        quotient.clear();
+        remainder = u;
+        return;
+    }
+    if (v.size() == 1) {
+        quotient = u;
+        uint32_t rem = divide_small(quotient, v[0]);
+        remainder = rem ? Limbs{rem} : Limbs();
+        return;
+    }
+
+    const uint64_t base = uint64_t(1) << 32;
+    size_t n = v.size();
+    size_t m = u.size() - n;
+    int shift = __builtin_clz(v[n - 1]);
+
+    // Normalize so the divisor's top limb has its high bit set
+    Limbs vn(n);
+    for (size_t i = n - 1; i > 0; i--) {
+        vn[i] = (v[i] << shift) | static_cast<uint32_t>(static_cast<uint64_t>(v[i - 1]) >> (32 - shift));
+    }
+    vn[0] = v[0] << shift;
+    Limbs un(u.size() + 1);
+    un[u.size()] = static_cast<uint32_t>(static_cast<uint64_t>(u[u.size() - 1]) >> (32 - shift));
+    for (size_t i = u.size() - 1; i > 0; i--) {
+        un[i] = (u[i] << shift) | static_cast<uint32_t>(static_cast<uint64_t>(u[i - 1]) >> (32 - shift));
+    }
+    un[0] = u[0] << shift;
+
+    quotient.assign(m + 1, 0);
+    for (size_t j = m + 1; j-- > 0;) {
+        uint64_t num = (static_cast<uint64_t>(un[j + n]) << 32) | un[j + n - 1];
+        uint64_t qhat = num / vn[n - 1];
+        uint64_t rhat = num % vn[n - 1];
+        while (qhat >= base || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+            qhat--;
+            rhat += vn[n - 1];
+            if (rhat >= base) {
+                break;
+            }
+        }
+
+        // Multiply and subtract
+        int64_t borrow = 0;
+        int64_t t;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t p = qhat * vn[i];
+            t = static_cast<int64_t>(un[i + j]) - borrow - static_cast<int64_t>(p & 0xFFFFFFFF);
+            un[i + j] = static_cast<uint32_t>(t);
+            borrow = static_cast<int64_t>(p >> 32) - (t >> 32);
+        }
+        t = static_cast<int64_t>(un[j + n]) - borrow;
+        un[j + n] = static_cast<uint32_t>(t);
+
+        quotient[j] = static_cast<uint32_t>(qhat);
+        if (t < 0) {
+            // Estimate was one too large; add the divisor back
+            quotient[j]--;
+            uint64_t carry = 0;
+            for (size_t i = 0; i < n; i++) {
+                uint64_t sum = static_cast<uint64_t>(un[i + j]) + vn[i] + carry;
+                un[i + j] = static_cast<uint32_t>(sum);
+                carry = sum >> 32;
+            }
+            un[j + n] += static_cast<uint32_t>(carry);
+        }
+    }
+    trim_limbs(quotient);
+
+    remainder.assign(n, 0);
+    for (size_t i = 0; i < n; i++) {
+        remainder[i] = (un[i] >> shift) | static_cast<uint32_t>(static_cast<uint64_t>(un[i + 1]) << (32 - shift));
+    }
+    trim_limbs(remainder);
+}
+
+} // namespace
+
+BigNum::BigNum(int64_t value) : negative_(value < 0) {
+    uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    while (magnitude != 0) {
+        magnitude_.push_back(static_cast<uint32_t>(magnitude));
+        magnitude >>= 32;
+    }
+}
+
+BigNum BigNum::fromLimbs(bool negative, std::vector<uint32_t> limbs) {
+    BigNum result;
+    result.negative_ = negative;
+    result.magnitude_ = std::move(limbs);
+    result.trim();
+    return result;
+}
+
+BigNum BigNum::fromValue(Value value) {
+    if (value.isSmall()) {
+        return BigNum(value.small());
+    }
+    if (value.isBool()) {
+        return BigNum(value.boolean() ? 1 : 0);
+    }
+    if (value.isArray()) {
+        throw std::runtime_error("Unsupported operand type: array");
+    }
+    if (value.isString()) {
+        throw std::runtime_error("Unsupported operand type: str");
+    }
+    const BigIntObject* big = value.bigint();
+    return fromLimbs(big->negative(), Limbs(big->limbs(), big->limbs() + big->length));
+}
+
+BigNum BigNum::fromString(const std::string& text) {
+    size_t pos = 0;
+    bool negative = false;
+    if (pos < text.size() && (text[pos] == '-' || text[pos] == '+')) {
+        negative = text[pos] == '-';
+        pos++;
+    }
+    if (pos == text.size()) {
+        throw std::runtime_error("Invalid integer: " + text);
+    }
+
+    BigNum result;
+    // Nine decimal digits at a time fit in one limb
+    while (pos < text.size()) {
+        size_t chunk = std::min<size_t>(9, text.size() - pos);
+        uint32_t scale = 1;
+        uint32_t digits = 0;
+        for (size_t i = 0; i < chunk; i++, pos++) {
+            char c = text[pos];
+            if (c < '0' || c > '9') {
+                throw std::runtime_error("Invalid integer: " + text);
+            }
+            digits = digits * 10 + static_cast<uint32_t>(c - '0');
+            scale *= 10;
+        }
+        uint64_t carry = digits;
+        for (uint32_t& limb : result.magnitude_) {
+            uint64_t cur = static_cast<uint64_t>(limb) * scale + carry;
+            limb = static_cast<uint32_t>(cur);
+            carry = cur >> 32;
+        }
+        if (carry != 0) {
+            result.magnitude_.push_back(static_cast<uint32_t>(carry));
+        }
+    }
+    result.negative_ = negative;
+    result.trim();
+    return result;
+}
+
+Value BigNum::toValue(Arena& arena, uint8_t flags) const {
+    if (magnitude_.size() <= 2) {
+        uint64_t magnitude = 0;
+        for (size_t i = magnitude_.size(); i-- > 0;) {
+            magnitude = (magnitude << 32) | magnitude_[i];
+        }
+        if (!negative_ && magnitude <= static_cast<uint64_t>(Value::SMALL_MAX)) {
+            return Value::fromSmall(static_cast<int64_t>(magnitude));
+        }
+        if (negative_ && magnitude <= uint64_t(1) << 62) {
+            return Value::fromSmall(-static_cast<int64_t>(magnitude));
+        }
+    }
+
+    size_t bytes = sizeof(BigIntObject) + magnitude_.size() * sizeof(uint32_t);
+    BigIntObject* big = new (arena.allocate(bytes)) BigIntObject();
+    big->kind = HeapKind::BigInt;
+    big->flags = static_cast<uint8_t>(flags | (negative_ ? BIGINT_NEGATIVE : 0));
+    big->reserved = 0;
+    big->length = static_cast<uint32_t>(magnitude_.size());
+    std::memcpy(big->limbs(), magnitude_.data(), magnitude_.size() * sizeof(uint32_t));
+    return Value::fromHeap(big);
+}
+
+std::string BigNum::toString() const {
+    if (magnitude_.empty()) {
+        return "0";
+    }
+    Limbs rest = magnitude_;
+    std::vector<uint32_t> chunks;
+    while (!rest.empty()) {
+        chunks.push_back(divide_small(rest, 1000000000));
+    }
+    std::string text = negative_ ? "-" : "";
+    text += std::to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i-- > 0;) {
+        std::string part = std::to_string(chunks[i]);
+        text.append(9 - part.size(), '0');
+        text += part;
+    }
+    return text;
+}
+
+void BigNum::trim() {
+    trim_limbs(magnitude_);
+    if (magnitude_.empty()) {
+        negative_ = false;
+    }
+}
+
+BigNum operator+(const BigNum& a, const BigNum& b) {
+    if (a.negative_ == b.negative_) {
+        return BigNum::fromLimbs(a.negative_, add_magnitude(a.magnitude_, b.magnitude_));
+    }
+    if (compare_magnitude(a.magnitude_, b.magnitude_) >= 0) {
+        return BigNum::fromLimbs(a.negative_, sub_magnitude(a.magnitude_, b.magnitude_));
+    }
+    return BigNum::fromLimbs(b.negative_, sub_magnitude(b.magnitude_, a.magnitude_));
+}
+
+BigNum operator-(const BigNum& a, const BigNum& b) {
+    BigNum negated = b;
+    negated.negative_ = !b.negative_;
+    negated.trim();
+    return a + negated;
+}
+
+BigNum operator*(const BigNum& a, const BigNum& b) {
+    return BigNum::fromLimbs(a.negative_ != b.negative_, mul_magnitude(a.magnitude_, b.magnitude_));
+}
+
+BigNum BigNum::floorDiv(const BigNum& a, const BigNum& b) {
+    Limbs quotient;
+    Limbs remainder;
+    divmod_magnitude(a.magnitude_, b.magnitude_, quotient, remainder);
+    if (a.negative_ == b.negative_) {
+        return fromLimbs(false, std::move(quotient));
+    }
+    // Opposite signs: round towards negative infinity
+    if (!remainder.empty()) {
+        quotient = add_magnitude(quotient, Limbs{1});
+    }
+    return fromLimbs(true, std::move(quotient));
+}
+
+int BigNum::compare(const BigNum& a, const BigNum& b) {
+    if (a.negative_ != b.negative_) {
+        return a.negative_ ? -1 : 1;
+    }
+    int order = compare_magnitude(a.magnitude_, b.magnitude_);
+    return a.negative_ ? -order : order;
+}
+
+double BigNum::toDouble() const {
+    double result = 0;
+    for (size_t i = magnitude_.size(); i-- > 0;) {
+        result = result * 4294967296.0 + magnitude_[i];
+    }
+    return negative_ ? -result : result;
+}
+
+int compare_values(Value a, Value b) {
+    if (a.isBool()) {
+        a = Value::fromSmall(a.boolean() ? 1 : 0);
+    }
+    if (b.isBool()) {
+        b = Value::fromSmall(b.boolean() ? 1 : 0);
+    }
+    if (Value::bothSmall(a, b)) {
+        return a.small() < b.small() ? -1 : (a.small() > b.small() ? 1 : 0);
+    }
+    if (a.isArray() || b.isArray()) {
+        throw std::runtime_error("Unsupported operand type: array");
+    }
+    if (a.isString() || b.isString()) {
+        throw std::runtime_error("Unsupported operand type: str");
+    }
+    // A BigInt is always outside the small range, so against a small int its sign decides
+    if (a.isSmall()) {
+        return b.bigint()->negative() ? 1 : -1;
+    }
+    if (b.isSmall()) {
+        return a.bigint()->negative() ? -1 : 1;
+    }
+    const BigIntObject* x = a.bigint();
+    const BigIntObject* y = b.bigint();
+    if (x->negative() != y->negative()) {
+        return x->negative() ? -1 : 1;
+    }
+    int order = compare_magnitude(x->limbs(), x->length, y->limbs(), y->length);
+    return x->negative() ? -order : order;
+}
+
+} // namespace minipy
@@ -0,0 +1,57 @@
+#ifndef MINIPY_BIGINT_H
+#define MINIPY_BIGINT_H
+
+#include "value.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace minipy {
+
+// Sign-magnitude arbitrary-precision integer used by the slow paths of the
+// interpreter (after a small-int overflow) and by the loaders. Results are
+// turned back into Values with toValue(), which keeps them unboxed when they
+// fit in a small int.
+class BigNum {
+public:
+    BigNum() = default;
+    explicit BigNum(int64_t value);
+
+    // From a small int, bool or BigInt
+    static BigNum fromValue(Value value);
+    // Optional sign followed by decimal digits; throws std::runtime_error otherwise
+    static BigNum fromString(const std::string& text);
+
+    // Small int when it fits, otherwise a BigInt allocated in the arena
+    Value toValue(Arena& arena, uint8_t flags = 0) const;
+    std::string toString() const;
+    // Nearest double (truncating the low bits of very large values)
+    double toDouble() const;
+
+    bool isZero() const { return magnitude_.empty(); }
+    bool negative() const { return negative_; }
+    const std::vector<uint32_t>& magnitude() const { return magnitude_; }
+    // Little-endian limbs; normalizes away leading zeros
+    static BigNum fromLimbs(bool negative, std::vector<uint32_t> limbs);
+
+    friend BigNum operator+(const BigNum& a, const BigNum& b);
+    friend BigNum operator-(const BigNum& a, const BigNum& b);
+    friend BigNum operator*(const BigNum& a, const BigNum& b);
+    // Floor division, matching the reference VM; divisor must be non-zero
+    static BigNum floorDiv(const BigNum& a, const BigNum& b);
+    // -1, 0 or 1
+    static int compare(const BigNum& a, const BigNum& b);
+
+private:
+    void trim();
+
+    bool negative_ = false;
+    std::vector<uint32_t> magnitude_;
+};
+
+// Ordering of two integer values (small ints, bools or BigInts)
+int compare_values(Value a, Value b);
+
+} // namespace minipy
+
+#endif // MINIPY_BIGINT_H
@@ -6,39 +6,60 @@
 namespace minipy {
 
 BytecodeFile load_bytecode(const std::string& filename) {
-    BytecodeFile bf;
     std::ifstream file(filename, std::ios::binary);
     if (!file.is_open()) {
         throw std::runtime_error("Cannot open bytecode file: " + filename);
     }
+    return parse_bytecode(file);
+}
+
+std::shared_ptr<const Program> make_program(BytecodeFile bf) {
+    return std::make_shared<const Program>(std::move(bf.code), bf.consts, std::move(bf.names));
+}
+
+std::shared_ptr<const Program> load_program(const std::string& filename) {
+    return make_program(load_bytecode(filename));
+}
+
+BytecodeFile parse_bytecode(std::istream& file) {
+    BytecodeFile bf;
     
     // Simple text-based format: opcode,arg per line
     // Format: CODE_SIZE
     // Then: opcode arg (one per line)
     // Then: CONSTS_SIZE
-    // Then: value (one per line)
+    // Then: value or "func name entry nparams nlocals" (one per line)
     // Then: NAMES_SIZE
     // Then: name (one per line)
     
     size_t code_size;
     file >> code_size;
+    file.ignore(); // Skip newline
     for (size_t i = 0; i < code_size; i++) {
-        std::string opcode;
+        // The argument is optional, so parse each instruction line on its own
+        std::string line;
+        std::getline(file, line);
+        std::istringstream instr(line);
+        std::string name;
         int64_t arg = 0;
-        file >> opcode;
-        if (opcode != "HALT" && opcode != "ADD" && opcode != "SUB" && 
-            opcode != "MUL" && opcode != "DIV" && opcode != "PRINT" &&
-            opcode != "POP") {
-            file >> arg;
+        instr >> name;
+        if (!(instr >> arg)) {
+            arg = 0;
+        }
+        Opcode opcode;
+        if (!parse_opcode(name, opcode)) {
+            throw std::runtime_error("Unknown opcode: " + name);
         }
         bf.code.emplace_back(opcode, arg);
     }
     
     size_t consts_size;
     file >> consts_size;
+    file.ignore(); // Skip newline
     for (size_t i = 0; i < consts_size; i++) {
-        Value value;
-        file >> value;
+        // Function constants span several words
+        std::string value;
+        std::getline(file, value);
         bf.consts.push_back(value);
     }
     
@@ -51,8 +72,48 @@ BytecodeFile load_bytecode(const std::string& filename) {
         bf.names.push_back(name);
     }
     
+    if (file.fail()) {
+        throw std::runtime_error("Malformed bytecode");
+    }
+    
     return bf;
 }
 
+namespace {
+
+void hash_bytes(uint64_t& hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+void hash_string(uint64_t& hash, const std::string& s) {
+    uint64_t size = s.size();
+    hash_bytes(hash, &size, sizeof(size));
+    hash_bytes(hash, s.data(), s.size());
+}
+
+} // namespace
+
+uint64_t program_hash(const BytecodeFile& bf) {
+    uint64_t hash = 14695981039346656037ULL;
+    uint64_t sizes[3] = {bf.code.size(), bf.consts.size(), bf.names.size()};
+    hash_bytes(hash, sizes, sizeof(sizes));
+    for (const Instruction& instr : bf.code) {
+        uint8_t opcode = static_cast<uint8_t>(instr.opcode);
+        hash_bytes(hash, &opcode, sizeof(opcode));
+        hash_bytes(hash, &instr.arg, sizeof(instr.arg));
+    }
+    for (const std::string& value : bf.consts) {
+        hash_string(hash, value);
+    }
+    for (const std::string& name : bf.names) {
+        hash_string(hash, name);
+    }
+    return hash;
+}
+
 } // namespace minipy
 
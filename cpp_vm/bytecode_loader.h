@@ -2,18 +2,30 @@
 #define MINIPY_BYTECODE_LOADER_H
 
 #include "vm.h"
+#include <istream>
+#include <memory>
 #include <string>
 
 namespace minipy {
 
 struct BytecodeFile {
     std::vector<Instruction> code;
-    std::vector<Value> consts;
+    std::vector<std::string> consts;   // decimal text; integers may be arbitrarily large
     std::vector<std::string> names;
 };
 
 BytecodeFile load_bytecode(const std::string& filename);
 
+// Load and validate a program ready to be shared between VMs
+std::shared_ptr<const Program> load_program(const std::string& filename);
+std::shared_ptr<const Program> make_program(BytecodeFile bf);
+
+// Parse bytecode from an already-open stream (files, in-memory buffers)
+BytecodeFile parse_bytecode(std::istream& file);
+
+// Hash of the decoded program (code, constants, names); identifies it in snapshots
+uint64_t program_hash(const BytecodeFile& bf);
+
 } // namespace minipy
 
 #endif // MINIPY_BYTECODE_LOADER_H
@@ -1,23 +1,183 @@
 #include "vm.h"
 #include "bytecode_loader.h"
+#include "server.h"
+#include "snapshot.h"
+#include "scheduler.h"
+#include "array_kernels.h"
+#include <mutex>
+#include <chrono>
 #include <iostream>
 #include <stdexcept>
+#include <string>
+
+namespace {
+
+void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options] <bytecode_file>" << std::endl;
+    std::cerr << "       " << prog << " --serve <socket_path> [--workers N] [--cache-bytes N]"
+              << " [--max-program-bytes N] [limits]" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --snapshot <file>        run to the first checkpoint and save the VM state" << std::endl;
+    std::cerr << "  --resume <file>          continue from a saved checkpoint" << std::endl;
+    std::cerr << "  --tasks N                run N green threads of the program (global 'task' = 0..N-1)" << std::endl;
+    std::cerr << "  --workers N              worker threads for --tasks and --serve" << std::endl;
+    std::cerr << "  --slice N                instructions per time slice for --tasks" << std::endl;
+    std::cerr << "  --cache-bytes N          program bytes --serve keeps cached (default 256 MiB)" << std::endl;
+    std::cerr << "  --max-program-bytes N    largest program --serve accepts (default 16 MiB)" << std::endl;
+    std::cerr << "  --simd LEVEL             newest array kernels to use: avx2 (default), sse4.2 or scalar" << std::endl;
+    std::cerr << "Limits:" << std::endl;
+    std::cerr << "  --max-instructions N     abort runs that execute about N instructions" << std::endl;
+    std::cerr << "  --max-time-ms N          abort runs that take longer than N milliseconds" << std::endl;
+}
+
+struct Options {
+    std::string bytecode_file;
+    std::string snapshot_file;
+    std::string resume_file;
+    std::string socket_path;
+    size_t workers = 4;
+    size_t cache_bytes = size_t(256) << 20;
+    size_t max_program_bytes = size_t(16) << 20;
+    size_t tasks = 0;
+    uint64_t slice = 10000;
+    minipy::RunLimits limits;
+};
+
+bool parse_options(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--serve" && has_value) {
+            options.socket_path = argv[++i];
+        } else if (arg == "--workers" && has_value) {
+            options.workers = std::stoul(argv[++i]);
+        } else if (arg == "--cache-bytes" && has_value) {
+            options.cache_bytes = std::stoull(argv[++i]);
+        } else if (arg == "--max-program-bytes" && has_value) {
+            options.max_program_bytes = std::stoull(argv[++i]);
+        } else if (arg == "--tasks" && has_value) {
+            options.tasks = std::stoul(argv[++i]);
+        } else if (arg == "--slice" && has_value) {
+            options.slice = std::stoull(argv[++i]);
+        } else if (arg == "--snapshot" && has_value) {
+            options.snapshot_file = argv[++i];
+        } else if (arg == "--resume" && has_value) {
+            options.resume_file = argv[++i];
+        } else if (arg == "--simd" && has_value) {
+            if (!minipy::limit_array_kernels(argv[++i])) {
+                return false;
+            }
+        } else if (arg == "--max-instructions" && has_value) {
+            options.limits.instructions = std::stoull(argv[++i]);
+        } else if (arg == "--max-time-ms" && has_value) {
+            options.limits.time = std::chrono::milliseconds(std::stoull(argv[++i]));
+        } else if (arg.rfind("--", 0) == 0 || !options.bytecode_file.empty()) {
+            return false;
+        } else {
+            options.bytecode_file = arg;
+        }
+    }
+    if (!options.socket_path.empty()) {
+        return options.bytecode_file.empty();
+    }
+    return !options.bytecode_file.empty();
+}
+
+// Run many copies of one program as green threads on a scheduler
+int run_tasks(const Options& options) {
+    std::shared_ptr<const minipy::Program> program = minipy::load_program(options.bytecode_file);
+    minipy::SchedulerOptions sched;
+    sched.workers = options.workers;
+    sched.slice_instructions = options.slice;
+    
+    std::mutex errors_mutex;
+    size_t failed = 0;
+    {
+        minipy::Scheduler scheduler(sched);
+        for (size_t i = 0; i < options.tasks; i++) {
+            minipy::VM vm(program);
+            vm.setGlobal("task", minipy::Value::fromSmall(static_cast<int64_t>(i)));
+            scheduler.spawn(std::move(vm), [&](minipy::TaskId id, const minipy::VM&, const std::string& error) {
+                if (!error.empty()) {
+                    std::lock_guard<std::mutex> lock(errors_mutex);
+                    std::cerr << "Error in task " << id << ": " << error << std::endl;
+                    failed++;
+                }
+            });
+        }
+        scheduler.wait();
+    }
+    std::cout.flush();
+    return failed == 0 ? 0 : 1;
+}
+
+} // namespace
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <bytecode_file>" << std::endl;
+    Options options;
+    try {
+        if (!parse_options(argc, argv, options)) {
+            usage(argv[0]);
+            return 1;
+        }
+    } catch (const std::exception&) {
+        usage(argv[0]);
         return 1;
     }
     
     try {
-        minipy::BytecodeFile bf = minipy::load_bytecode(argv[1]);
-        minipy::VM vm(bf.code, bf.consts, bf.names);
-        vm.run();
+        if (!options.socket_path.empty()) {
+            minipy::ServerOptions server;
+            server.socket_path = options.socket_path;
+            server.workers = options.workers;
+            server.limits = options.limits;
+            server.cache_bytes = options.cache_bytes;
+            server.max_program_bytes = options.max_program_bytes;
+            minipy::serve(server);
+            return 0;
+        }
+        if (options.tasks > 0) {
+            return run_tasks(options);
+        }
+        
+        minipy::BytecodeFile bf = minipy::load_bytecode(options.bytecode_file);
+        uint64_t hash = minipy::program_hash(bf);
+        minipy::VM vm(minipy::make_program(std::move(bf)));
+        vm.setBudget(options.limits.instructions, options.limits.time);
+        
+        minipy::RunStatus status;
+        if (!options.resume_file.empty()) {
+            // Continue a program from a saved checkpoint
+            minipy::Snapshot snap = minipy::load_snapshot(options.resume_file);
+            if (snap.program_hash != hash) {
+                throw std::runtime_error("Snapshot was taken from a different program");
+            }
+            vm.restoreState(snap.state);
+            status = vm.resume();
+        } else {
+            vm.setStopAtCheckpoint(!options.snapshot_file.empty());
+            status = vm.run();
+        }
+        
+        if (status == minipy::RunStatus::Suspended) {
+            throw std::runtime_error("Execution budget exhausted");
+        }
+        if (!options.snapshot_file.empty()) {
+            // Save the VM state at the first checkpoint
+            if (status != minipy::RunStatus::Checkpoint) {
+                throw std::runtime_error("Program halted before reaching a checkpoint");
+            }
+            minipy::Snapshot snap;
+            snap.program_hash = hash;
+            snap.state = vm.saveState();
+            minipy::save_snapshot(snap, options.snapshot_file);
+        }
     } catch (const std::exception& e) {
+        std::cout.flush();
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
     
+    std::cout.flush();
     return 0;
 }
-
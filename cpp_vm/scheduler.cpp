@@ -0,0 +1,129 @@
+#include "scheduler.h"
+#include <stdexcept>
+
+namespace minipy {
+
+Scheduler::Scheduler(SchedulerOptions options) : options_(options) {
+    if (options_.workers == 0) {
+        options_.workers = 1;
+    }
+    for (size_t i = 0; i < options_.workers; i++) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < options_.workers; i++) {
+        workers_[i]->thread = std::thread([this, i] { workerLoop(i); });
+    }
+}
+
+Scheduler::~Scheduler() {
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        stopping_ = true;
+    }
+    idle_.notify_all();
+    for (auto& worker : workers_) {
+        worker->thread.join();
+    }
+}
+
+TaskId Scheduler::spawn(VM vm, TaskCompletion on_done) {
+    TaskId id = next_id_++;
+    vm.setStopAtCheckpoint(false);
+    vm.setBudget(options_.slice_instructions, options_.slice_time);
+    live_++;
+    enqueue(next_worker_++ % workers_.size(),
+            std::unique_ptr<Task>(new Task{id, std::move(vm), std::move(on_done)}));
+    return id;
+}
+
+void Scheduler::wait() {
+    std::unique_lock<std::mutex> lock(done_mutex_);
+    done_.wait(lock, [this] { return live_.load() == 0; });
+}
+
+void Scheduler::enqueue(size_t index, std::unique_ptr<Task> task) {
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        queued_++;
+        workers_[index]->queue.push_back(std::move(task));
+    }
+    if (sleeping_.load() > 0) {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        idle_.notify_one();
+    }
+}
+
+// Next task for a worker: its own queue first, then steal from the others
+std::unique_ptr<Scheduler::Task> Scheduler::take(size_t index) {
+    while (true) {
+        for (size_t k = 0; k < workers_.size(); k++) {
+            Worker& worker = *workers_[(index + k) % workers_.size()];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (worker.queue.empty()) {
+                continue;
+            }
+            std::unique_ptr<Task> task;
+            if (k == 0) {
+                task = std::move(worker.queue.front());
+                worker.queue.pop_front();
+            } else {
+                task = std::move(worker.queue.back());
+                worker.queue.pop_back();
+            }
+            queued_--;
+            return task;
+        }
+
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        sleeping_++;
+        idle_.wait(lock, [this] { return stopping_ || queued_.load() > 0; });
+        sleeping_--;
+        if (stopping_) {
+            return nullptr;
+        }
+    }
+}
+
+void Scheduler::workerLoop(size_t index) {
+    Worker& worker = *workers_[index];
+    while (std::unique_ptr<Task> task = take(index)) {
+        std::string error;
+        RunStatus status = RunStatus::Halted;
+        task->vm.setOutput(worker.output);
+        try {
+            status = task->vm.resume();
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        flushOutput(worker);
+
+        if (error.empty() && status == RunStatus::Suspended) {
+            enqueue(index, std::move(task));
+        } else {
+            finish(std::move(task), error);
+        }
+    }
+}
+
+void Scheduler::flushOutput(Worker& worker) {
+    std::string text = worker.output.str();
+    if (text.empty()) {
+        return;
+    }
+    worker.output.str(std::string());
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    options_.output->write(text.data(), static_cast<std::streamsize>(text.size()));
+}
+
+void Scheduler::finish(std::unique_ptr<Task> task, const std::string& error) {
+    if (task->on_done) {
+        task->on_done(task->id, task->vm, error);
+    }
+    task.reset();
+    std::lock_guard<std::mutex> lock(done_mutex_);
+    if (--live_ == 0) {
+        done_.notify_all();
+    }
+}
+
+} // namespace minipy
@@ -0,0 +1,93 @@
+#ifndef MINIPY_SCHEDULER_H
+#define MINIPY_SCHEDULER_H
+
+#include "vm.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace minipy {
+
+using TaskId = uint64_t;
+
+// Called on a worker thread when a task halts or fails; error is empty on success
+using TaskCompletion = std::function<void(TaskId id, const VM& vm, const std::string& error)>;
+
+struct SchedulerOptions {
+    size_t workers = 4;
+    // Budget of one time slice; a task that uses it up goes to the back of its queue
+    uint64_t slice_instructions = 10000;
+    std::chrono::nanoseconds slice_time{0};
+    // Receives the PRINT output of every task, whole lines at a time
+    std::ostream* output = &std::cout;
+};
+
+// Green-thread scheduler: time-slices many VM contexts over a few worker threads.
+// Each worker owns a run queue; idle workers steal from the others. Tasks are
+// preempted at backward jumps via VM::setBudget, so a task costs only its VM
+// context (a few hundred bytes plus its operand stack) while it waits.
+class Scheduler {
+public:
+    explicit Scheduler(SchedulerOptions options = SchedulerOptions());
+    // Stops the workers; tasks that have not finished are dropped (call wait() first)
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // Queue a context for execution; it resumes from its current state
+    TaskId spawn(VM vm, TaskCompletion on_done = nullptr);
+    // Block until every spawned task has finished
+    void wait();
+    // Tasks spawned but not yet finished
+    size_t live() const { return live_.load(); }
+
+private:
+    struct Task {
+        TaskId id;
+        VM vm;
+        TaskCompletion on_done;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::unique_ptr<Task>> queue;
+        std::ostringstream output;
+        std::thread thread;
+    };
+
+    void workerLoop(size_t index);
+    std::unique_ptr<Task> take(size_t index);
+    void enqueue(size_t index, std::unique_ptr<Task> task);
+    void flushOutput(Worker& worker);
+    void finish(std::unique_ptr<Task> task, const std::string& error);
+
+    SchedulerOptions options_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    std::atomic<TaskId> next_id_{0};
+    std::atomic<size_t> next_worker_{0};
+    std::atomic<size_t> queued_{0};
+    std::atomic<size_t> sleeping_{0};
+    std::atomic<size_t> live_{0};
+    bool stopping_ = false;
+
+    std::mutex idle_mutex_;
+    std::condition_variable idle_;
+    std::mutex done_mutex_;
+    std::condition_variable done_;
+    std::mutex output_mutex_;
+};
+
+} // namespace minipy
+
+#endif // MINIPY_SCHEDULER_H
@@ -0,0 +1,623 @@
+#include "server.h"
+#include "bigint.h"
+#include "vm.h"
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace minipy {
+
+namespace {
+
+constexpr uint32_t SHA256_ROUND_CONSTANTS[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+// One 64-byte block of SHA-256 (FIPS 180-4)
+void sha256_block(uint32_t state[8], const unsigned char* block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = uint32_t(block[4 * i]) << 24 | uint32_t(block[4 * i + 1]) << 16 | uint32_t(block[4 * i + 2]) << 8 |
+               uint32_t(block[4 * i + 3]);
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) +
+                      SHA256_ROUND_CONSTANTS[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+} // namespace
+
+std::string program_id(const std::string& contents) {
+    uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    size_t full = contents.size() / 64 * 64;
+    for (size_t i = 0; i < full; i += 64) {
+        sha256_block(state, reinterpret_cast<const unsigned char*>(contents.data()) + i);
+    }
+    // Padding: a 1 bit, zeros, then the message length in bits (big-endian)
+    unsigned char tail[128] = {};
+    size_t rest = contents.size() - full;
+    std::memcpy(tail, contents.data() + full, rest);
+    tail[rest] = 0x80;
+    size_t tail_size = rest < 56 ? 64 : 128;
+    uint64_t bits = static_cast<uint64_t>(contents.size()) * 8;
+    for (int i = 0; i < 8; i++) {
+        tail[tail_size - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+    for (size_t i = 0; i < tail_size; i += 64) {
+        sha256_block(state, tail + i);
+    }
+
+    char hex[65];
+    for (int i = 0; i < 8; i++) {
+        std::snprintf(hex + 8 * i, 9, "%08x", state[i]);
+    }
+    return hex;
+}
+
+std::string ProgramCache::load(const std::string& contents) {
+    std::string id = program_id(contents);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = programs_.find(id);
+        if (it != programs_.end()) {
+            touch(it->second);
+            return id;
+        }
+    }
+
+    // Parse outside the lock; a concurrent load of the same program is harmless
+    std::istringstream in(contents);
+    std::shared_ptr<const Program> program = make_program(parse_bytecode(in));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto inserted = programs_.emplace(id, Entry{std::move(program), contents.size(), uses_.end()});
+    Entry& entry = inserted.first->second;
+    if (!inserted.second) {
+        touch(entry);
+        return id;
+    }
+    uses_.push_front(id);
+    entry.use = uses_.begin();
+    bytes_ += entry.bytes;
+    // The newest program stays even when it alone is over capacity
+    while (bytes_ > capacity_ && uses_.size() > 1) {
+        auto oldest = programs_.find(uses_.back());
+        bytes_ -= oldest->second.bytes;
+        programs_.erase(oldest);
+        uses_.pop_back();
+    }
+    return id;
+}
+
+std::shared_ptr<const Program> ProgramCache::find(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = programs_.find(id);
+    if (it == programs_.end()) {
+        return nullptr;
+    }
+    touch(it->second);
+    return it->second.program;
+}
+
+void ProgramCache::touch(Entry& entry) {
+    uses_.splice(uses_.begin(), uses_, entry.use);
+}
+
+size_t ProgramCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return programs_.size();
+}
+
+namespace {
+
+void send_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Connection lost");
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+void send_all(int fd, const std::string& data) {
+    send_all(fd, data.data(), data.size());
+}
+
+// Streams PRINT output back to the client as OUT frames, one per filled buffer
+class OutputFrames : public std::streambuf {
+public:
+    explicit OutputFrames(int fd) : fd_(fd) {
+        setp(buffer_, buffer_ + sizeof(buffer_));
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        flushFrame();
+        if (ch != traits_type::eof()) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override {
+        flushFrame();
+        return 0;
+    }
+
+private:
+    void flushFrame() {
+        size_t size = static_cast<size_t>(pptr() - pbase());
+        if (size == 0) {
+            return;
+        }
+        send_all(fd_, "OUT " + std::to_string(size) + "\n");
+        send_all(fd_, pbase(), size);
+        setp(buffer_, buffer_ + sizeof(buffer_));
+    }
+
+    int fd_;
+    char buffer_[4096];
+};
+
+// Longest request or binding line accepted
+constexpr size_t MAX_LINE_BYTES = 64 * 1024;
+
+// A client that stops reading its output gives up the worker after this long
+constexpr int SEND_TIMEOUT_SECONDS = 30;
+
+// One complete request, split off a connection by the connection thread and run by a worker
+struct Request {
+    enum class Kind { Load, Run };
+
+    int fd;
+    Kind kind;
+    std::string contents;
+    std::string id;
+    // "<name> <value>" lines, parsed by the worker so a huge value stalls no other connection
+    std::vector<std::string> bindings;
+};
+
+// Received bytes of a connection that have not formed a complete request yet. While one of its
+// requests is with a worker the connection is not read, so replies stay in request order.
+struct Connection {
+    std::string input;
+    // Progress on the request at the front of `input`, kept so a partial request is not rescanned
+    // on every read: its parsed request line (header_end is 0 until then), the payload bytes or
+    // binding lines it announced, and where the search for the next line resumes
+    Request pending;
+    size_t header_end = 0;
+    size_t expected = 0;
+    size_t scanned = 0;
+    bool busy = false;
+    bool closing = false;
+};
+
+// Returns false when the connection can no longer be used
+bool handle_run(const Request& request, ProgramCache& cache, const RunLimits& limits) {
+    std::vector<std::pair<std::string, BigNum>> bindings;
+    for (const std::string& line : request.bindings) {
+        std::istringstream binding(line);
+        std::string name;
+        std::string text;
+        binding >> name >> text;
+        BigNum value;
+        try {
+            if (binding.fail()) {
+                throw std::runtime_error("missing value");
+            }
+            value = BigNum::fromString(text);
+        } catch (const std::runtime_error&) {
+            send_all(request.fd, "ERR Malformed binding: " + line + "\n");
+            return false;
+        }
+        bindings.emplace_back(name, std::move(value));
+    }
+
+    std::shared_ptr<const Program> program = cache.find(request.id);
+    if (!program) {
+        send_all(request.fd, "ERR Unknown program: " + request.id + "\n");
+        return true;
+    }
+
+    OutputFrames frames(request.fd);
+    std::ostream out(&frames);
+    try {
+        VM vm(program);
+        vm.setOutput(out);
+        for (const auto& binding : bindings) {
+            vm.setGlobal(binding.first, vm.makeInteger(binding.second));
+        }
+        vm.setBudget(limits.instructions, limits.time);
+        if (vm.run() == RunStatus::Suspended) {
+            throw std::runtime_error("Execution budget exhausted");
+        }
+        out.flush();
+        send_all(request.fd, "DONE\n");
+    } catch (const std::exception& e) {
+        out.flush();
+        send_all(request.fd, std::string("ERR ") + e.what() + "\n");
+    }
+    return true;
+}
+
+// Returns false when the connection can no longer be used
+bool handle_request(const Request& request, ProgramCache& cache, const RunLimits& limits) {
+    try {
+        if (request.kind == Request::Kind::Load) {
+            try {
+                send_all(request.fd, "OK " + cache.load(request.contents) + "\n");
+            } catch (const std::exception& e) {
+                send_all(request.fd, std::string("ERR ") + e.what() + "\n");
+            }
+            return true;
+        }
+        return handle_run(request, cache, limits);
+    } catch (const std::exception&) {
+        // The client went away mid-response; nothing left to report to
+        return false;
+    }
+}
+
+// Requests waiting for a worker
+class RequestQueue {
+public:
+    void push(Request request) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            requests_.push_back(std::move(request));
+        }
+        ready_.notify_one();
+    }
+
+    Request pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return !requests_.empty(); });
+        Request request = std::move(requests_.front());
+        requests_.pop_front();
+        return request;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<Request> requests_;
+};
+
+// Requests the workers have finished, handed back to the connection thread through a self-pipe
+class Completions {
+public:
+    Completions() {
+        if (::pipe(pipe_) < 0) {
+            throw std::runtime_error("Cannot create pipe");
+        }
+        ::fcntl(pipe_[0], F_SETFL, O_NONBLOCK);
+        ::fcntl(pipe_[1], F_SETFL, O_NONBLOCK);
+    }
+
+    int fd() const { return pipe_[0]; }
+
+    void push(int fd, bool usable) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_.emplace_back(fd, usable);
+        }
+        // A full pipe already has a wakeup pending
+        char byte = 0;
+        ssize_t n = ::write(pipe_[1], &byte, 1);
+        (void)n;
+    }
+
+    std::vector<std::pair<int, bool>> take() {
+        char drain[256];
+        while (::read(pipe_[0], drain, sizeof(drain)) > 0) {
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<std::pair<int, bool>> done;
+        done.swap(done_);
+        return done;
+    }
+
+private:
+    int pipe_[2];
+    std::mutex mutex_;
+    std::vector<std::pair<int, bool>> done_;
+};
+
+// Parses the request line of a connection's next request into its pending request. Returns
+// false when the line is incomplete; sets `error` for a request that must end the connection.
+bool parse_header(int fd, Connection& connection, const ServerOptions& options, std::string& error) {
+    std::string& input = connection.input;
+    size_t nl = input.find('\n', connection.scanned);
+    if (nl == std::string::npos) {
+        connection.scanned = input.size();
+        if (input.size() > MAX_LINE_BYTES) {
+            error = "Request line too long";
+        }
+        return false;
+    }
+    if (nl > MAX_LINE_BYTES) {
+        error = "Request line too long";
+        return false;
+    }
+
+    std::istringstream header(input.substr(0, nl));
+    std::string command;
+    header >> command;
+    Request& request = connection.pending;
+    request.fd = fd;
+
+    if (command == "LOAD") {
+        request.kind = Request::Kind::Load;
+        header >> connection.expected;
+        if (header.fail()) {
+            error = "Malformed LOAD request";
+            return false;
+        }
+        // Refused before the payload is buffered; it is never read, so the connection ends
+        if (connection.expected > options.max_program_bytes) {
+            error = "Program too large: limit is " + std::to_string(options.max_program_bytes) + " bytes";
+            return false;
+        }
+    }
+    else if (command == "RUN") {
+        request.kind = Request::Kind::Run;
+        header >> request.id >> connection.expected;
+        if (header.fail()) {
+            error = "Malformed RUN request";
+            return false;
+        }
+    }
+    else {
+        error = "Unknown request: " + command;
+        return false;
+    }
+    connection.header_end = nl + 1;
+    connection.scanned = nl + 1;
+    return true;
+}
+
+// Completes the connection's pending request from its input. Returns false when more input is
+// needed or `error` is set for a request that must end the connection.
+bool parse_request(int fd, Connection& connection, const ServerOptions& options, std::string& error) {
+    if (connection.header_end == 0 && !parse_header(fd, connection, options, error)) {
+        return false;
+    }
+
+    std::string& input = connection.input;
+    Request& request = connection.pending;
+    if (request.kind == Request::Kind::Load) {
+        if (input.size() - connection.header_end < connection.expected) {
+            return false;
+        }
+        request.contents = input.substr(connection.header_end, connection.expected);
+        connection.scanned = connection.header_end + connection.expected;
+    }
+    else {
+        while (request.bindings.size() < connection.expected) {
+            size_t start = connection.scanned;
+            size_t nl = input.find('\n', start);
+            size_t length = (nl == std::string::npos ? input.size() : nl) - start;
+            if (length > MAX_LINE_BYTES) {
+                error = "Binding line too long";
+                return false;
+            }
+            if (start > options.max_program_bytes) {
+                error = "RUN request too large";
+                return false;
+            }
+            if (nl == std::string::npos) {
+                return false;
+            }
+            request.bindings.push_back(input.substr(start, length));
+            connection.scanned = nl + 1;
+        }
+    }
+    input.erase(0, connection.scanned);
+    connection.header_end = 0;
+    connection.scanned = 0;
+    return true;
+}
+
+// Hands the connection's next buffered request to the workers, or ends the connection on a bad one
+void dispatch(int fd, Connection& connection, const ServerOptions& options, RequestQueue& queue) {
+    if (connection.busy || connection.input.empty()) {
+        return;
+    }
+    std::string error;
+    if (parse_request(fd, connection, options, error)) {
+        connection.busy = true;
+        queue.push(std::move(connection.pending));
+        connection.pending = Request();
+        return;
+    }
+    if (!error.empty()) {
+        try {
+            send_all(fd, "ERR " + error + "\n");
+        } catch (const std::exception&) {
+        }
+        connection.input.clear();
+        connection.closing = true;
+    }
+}
+
+int open_listener(const std::string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    // Replace a stale socket from a previous run, but never any other kind of file
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            throw std::runtime_error("Refusing to replace non-socket file: " + path);
+        }
+        ::unlink(path.c_str());
+    }
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot create socket");
+    }
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(fd, SOMAXCONN) < 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot listen on " + path + ": " + std::strerror(errno));
+    }
+    return fd;
+}
+
+} // namespace
+
+void serve(const ServerOptions& options) {
+    int listener = open_listener(options.socket_path);
+    ProgramCache cache(options.cache_bytes);
+    RequestQueue queue;
+    Completions completions;
+
+    size_t workers = options.workers > 0 ? options.workers : 1;
+    std::vector<std::thread> pool;
+    for (size_t i = 0; i < workers; i++) {
+        pool.emplace_back([&queue, &completions, &cache, &options] {
+            while (true) {
+                Request request = queue.pop();
+                bool usable = handle_request(request, cache, options.limits);
+                completions.push(request.fd, usable);
+            }
+        });
+    }
+
+    // This thread owns every connection: it reads requests, and closes a connection only once no
+    // worker is using it. Workers write replies directly.
+    std::unordered_map<int, Connection> connections;
+    auto finish = [&connections](int fd) {
+        ::close(fd);
+        connections.erase(fd);
+    };
+
+    std::cerr << "Serving on " << options.socket_path << " with " << workers << " workers" << std::endl;
+    std::vector<pollfd> polled;
+    while (true) {
+        polled.clear();
+        polled.push_back({listener, POLLIN, 0});
+        polled.push_back({completions.fd(), POLLIN, 0});
+        for (const auto& entry : connections) {
+            if (!entry.second.busy) {
+                polled.push_back({entry.first, POLLIN, 0});
+            }
+        }
+        if (::poll(polled.data(), polled.size(), -1) < 0) {
+            if (errno != EINTR) {
+                std::cerr << "poll failed: " << std::strerror(errno) << std::endl;
+            }
+            continue;
+        }
+
+        if (polled[1].revents & POLLIN) {
+            for (const auto& done : completions.take()) {
+                Connection& connection = connections[done.first];
+                connection.busy = false;
+                if (!done.second) {
+                    connection.closing = true;
+                }
+                else {
+                    dispatch(done.first, connection, options, queue);
+                }
+                if (connection.closing && !connection.busy) {
+                    finish(done.first);
+                }
+            }
+        }
+
+        for (size_t i = 2; i < polled.size(); i++) {
+            if (polled[i].revents == 0) {
+                continue;
+            }
+            int fd = polled[i].fd;
+            Connection& connection = connections[fd];
+            char chunk[4096];
+            ssize_t n;
+            do {
+                n = ::recv(fd, chunk, sizeof(chunk), 0);
+            } while (n < 0 && errno == EINTR);
+            if (n <= 0) {
+                connection.closing = true;
+            }
+            else {
+                connection.input.append(chunk, static_cast<size_t>(n));
+                dispatch(fd, connection, options, queue);
+            }
+            if (connection.closing && !connection.busy) {
+                finish(fd);
+            }
+        }
+
+        if (polled[0].revents & POLLIN) {
+            int fd = ::accept(listener, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno != EINTR) {
+                    std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+                }
+                continue;
+            }
+            timeval timeout{SEND_TIMEOUT_SECONDS, 0};
+            ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            connections.emplace(fd, Connection());
+        }
+    }
+}
+
+} // namespace minipy
@@ -0,0 +1,67 @@
+#ifndef MINIPY_SERVER_H
+#define MINIPY_SERVER_H
+
+#include "bytecode_loader.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace minipy {
+
+// Loaded programs keyed by a hash of their .mpbc contents, shared by all workers.
+// The hash is cryptographic, so a different program cannot be made to share an id.
+// Holds at most capacity bytes of .mpbc contents, evicting the least recently
+// used programs (runs already holding one keep it alive).
+class ProgramCache {
+public:
+    explicit ProgramCache(size_t capacity) : capacity_(capacity) {}
+
+    // Parse and cache a program, returning its id; loading the same contents again is a lookup
+    std::string load(const std::string& contents);
+    // nullptr for ids never loaded or since evicted; a hit counts as a use
+    std::shared_ptr<const Program> find(const std::string& id);
+    size_t size() const;
+
+private:
+    struct Entry {
+        std::shared_ptr<const Program> program;
+        size_t bytes;
+        std::list<std::string>::iterator use;  // position in uses_
+    };
+
+    void touch(Entry& entry);
+
+    mutable std::mutex mutex_;
+    size_t capacity_;
+    size_t bytes_ = 0;
+    std::list<std::string> uses_;  // ids, most recently used first
+    std::unordered_map<std::string, Entry> programs_;
+};
+
+struct ServerOptions {
+    std::string socket_path;
+    size_t workers = 4;
+    RunLimits limits;  // runs exceeding these fail with ERR
+    size_t cache_bytes = size_t(256) << 20;        // ProgramCache capacity
+    size_t max_program_bytes = size_t(16) << 20;   // larger LOADs are refused unread
+};
+
+// Content hash used as the program id (SHA-256, hex encoded)
+std::string program_id(const std::string& contents);
+
+// Accept connections on a Unix domain socket. One thread polls every connection and hands each
+// complete request to a worker pool, so idle connections hold no worker; a connection's requests
+// run one at a time and are answered in order.
+// Protocol:
+//   LOAD <nbytes>\n<.mpbc contents>   -> OK <id>\n (or ERR and a closed connection
+//                                       when nbytes exceeds max_program_bytes)
+//   RUN <id> <nbindings>\n            -> OUT <nbytes>\n<output>... then DONE\n
+//   <name> <value>\n (x nbindings)       (or ERR <message>\n on failure)
+// Runs until the process is terminated.
+void serve(const ServerOptions& options);
+
+} // namespace minipy
+
+#endif // MINIPY_SERVER_H
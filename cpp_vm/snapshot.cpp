@@ -0,0 +1,299 @@
+#include "snapshot.h"
+#include "bigint.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace minipy {
+
+namespace {
+
+const char SNAPSHOT_MAGIC[] = "MPSNAP7\n";
+constexpr size_t SNAPSHOT_MAGIC_SIZE = sizeof(SNAPSHOT_MAGIC) - 1;
+
+// Low three bits of a non-small value header
+constexpr uint64_t VALUE_BIGINT = 1;
+constexpr uint64_t VALUE_BOOL = 3;
+constexpr uint64_t VALUE_FLOAT = 5;
+constexpr uint64_t VALUE_ARRAY = 7;
+// Set in a float header for a string
+constexpr uint64_t STRING_FLAG = 8;
+
+void write_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+// Zigzag so small negative numbers stay small
+uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ (value < 0 ? ~uint64_t(0) : 0);
+}
+
+int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(std::string& out) : out_(out) {}
+
+    void writeValue(Value value) {
+        if (value.isSmall()) {
+            write_varint(out_, zigzag(value.small()) << 1);
+            return;
+        }
+        if (value.isBool()) {
+            write_varint(out_, (value.boolean() ? 8 : 0) | VALUE_BOOL);
+            return;
+        }
+        if (value.isString()) {
+            std::string scratch;
+            std::string_view bytes = string_bytes(value, scratch);
+            write_varint(out_, (static_cast<uint64_t>(bytes.size()) << 4) | STRING_FLAG | VALUE_FLOAT);
+            out_.append(bytes.data(), bytes.size());
+            return;
+        }
+        if (value.isFloat()) {
+            uint64_t bits;
+            double number = value.floating();
+            std::memcpy(&bits, &number, sizeof(bits));
+            write_varint(out_, VALUE_FLOAT);
+            write_varint(out_, bits);
+            return;
+        }
+        if (value.isArray()) {
+            const ArrayObject* array = value.array();
+            auto it = arrays_.find(array);
+            if (it != arrays_.end()) {
+                write_varint(out_, (it->second << 4) | 8 | VALUE_ARRAY);
+                return;
+            }
+            arrays_.emplace(array, arrays_.size());
+            write_varint(out_, (static_cast<uint64_t>(array->length) << 4) | VALUE_ARRAY);
+            for (uint32_t i = 0; i < array->length; i++) {
+                write_varint(out_, zigzag(array->elements()[i]));
+            }
+            return;
+        }
+        const BigIntObject* big = value.bigint();
+        write_varint(out_, (static_cast<uint64_t>(big->length) << 4) | (big->negative() ? 8 : 0) | VALUE_BIGINT);
+        for (uint32_t i = 0; i < big->length; i++) {
+            write_varint(out_, big->limbs()[i]);
+        }
+    }
+
+private:
+    std::string& out_;
+    // Index of each array already written, in writing order
+    std::unordered_map<const ArrayObject*, uint64_t> arrays_;
+};
+
+class SnapshotReader {
+public:
+    explicit SnapshotReader(const std::string& data) : data_(data), pos_(0) {}
+
+    uint64_t readVarint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos_ >= data_.size()) {
+                throw std::runtime_error("Truncated snapshot");
+            }
+            uint8_t byte = static_cast<uint8_t>(data_[pos_++]);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        throw std::runtime_error("Malformed snapshot");
+    }
+
+    Value readValue(Arena& heap) {
+        uint64_t header = readVarint();
+        if (!(header & 1)) {
+            return Value::fromSmall(unzigzag(header >> 1));
+        }
+        if ((header & 7) == VALUE_BOOL) {
+            return Value::fromBool((header & 8) != 0);
+        }
+        if ((header & 7) == VALUE_FLOAT && (header & STRING_FLAG)) {
+            if ((header >> 4) > MAX_STRING_LENGTH) {
+                throw std::runtime_error("Malformed snapshot");
+            }
+            std::string bytes = readBytes(header >> 4);
+            return make_string(bytes.data(), bytes.size(), heap);
+        }
+        if ((header & 7) == VALUE_FLOAT) {
+            uint64_t bits = readVarint();
+            double number;
+            std::memcpy(&number, &bits, sizeof(number));
+            return make_float(number, heap);
+        }
+        if ((header & 7) == VALUE_ARRAY) {
+            return readArray(header, heap);
+        }
+        if ((header & 7) != VALUE_BIGINT) {
+            throw std::runtime_error("Malformed snapshot");
+        }
+        uint64_t length = header >> 4;
+        if (length > MAX_BIGINT_LIMBS) {
+            throw std::runtime_error("Malformed snapshot");
+        }
+        if (length > remaining()) {
+            throw std::runtime_error("Truncated snapshot");
+        }
+        std::vector<uint32_t> limbs(length);
+        for (uint32_t& limb : limbs) {
+            uint64_t value = readVarint();
+            if (value > UINT32_MAX) {
+                throw std::runtime_error("Malformed snapshot");
+            }
+            limb = static_cast<uint32_t>(value);
+        }
+        return BigNum::fromLimbs((header & 8) != 0, std::move(limbs)).toValue(heap);
+    }
+
+    // An array header's elements, or the array it refers back to
+    Value readArray(uint64_t header, Arena& heap) {
+        if (header & 8) {
+            if ((header >> 4) >= arrays_.size()) {
+                throw std::runtime_error("Malformed snapshot");
+            }
+            return arrays_[header >> 4];
+        }
+        uint64_t length = header >> 4;
+        if (length > MAX_ARRAY_LENGTH) {
+            throw std::runtime_error("Malformed snapshot");
+        }
+        if (length > remaining()) {
+            throw std::runtime_error("Truncated snapshot");
+        }
+        Value array = make_array(static_cast<uint32_t>(length), heap);
+        for (uint32_t i = 0; i < length; i++) {
+            array.array()->elements()[i] = unzigzag(readVarint());
+        }
+        arrays_.push_back(array);
+        return array;
+    }
+
+    std::string readBytes(size_t size) {
+        if (size > data_.size() - pos_) {
+            throw std::runtime_error("Truncated snapshot");
+        }
+        std::string bytes = data_.substr(pos_, size);
+        pos_ += size;
+        return bytes;
+    }
+
+    size_t remaining() const { return data_.size() - pos_; }
+
+private:
+    const std::string& data_;
+    size_t pos_;
+    // Arrays read so far, for back-references
+    std::vector<Value> arrays_;
+};
+
+} // namespace
+
+void save_snapshot(const Snapshot& snapshot, const std::string& filename) {
+    std::string out(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+    SnapshotWriter writer(out);
+    write_varint(out, snapshot.program_hash);
+    write_varint(out, snapshot.state.ip);
+
+    write_varint(out, snapshot.state.stack.size());
+    for (Value value : snapshot.state.stack) {
+        writer.writeValue(value);
+    }
+
+    // Sorted so the same state always produces the same file
+    std::vector<std::pair<std::string, Value>> globals(snapshot.state.globals.begin(),
+                                                       snapshot.state.globals.end());
+    std::sort(globals.begin(), globals.end(),
+              [](const std::pair<std::string, Value>& a, const std::pair<std::string, Value>& b) {
+                  return a.first < b.first;
+              });
+    write_varint(out, globals.size());
+    for (const auto& global : globals) {
+        write_varint(out, global.first.size());
+        out += global.first;
+        writer.writeValue(global.second);
+    }
+
+    write_varint(out, snapshot.state.frames.size());
+    for (const Frame& frame : snapshot.state.frames) {
+        write_varint(out, frame.return_ip);
+        write_varint(out, frame.base);
+        write_varint(out, frame.function);
+    }
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot write snapshot file: " + filename);
+    }
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    if (!file) {
+        throw std::runtime_error("Cannot write snapshot file: " + filename);
+    }
+}
+
+Snapshot load_snapshot(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open snapshot file: " + filename);
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.compare(0, SNAPSHOT_MAGIC_SIZE, SNAPSHOT_MAGIC) != 0) {
+        throw std::runtime_error("Not a snapshot file: " + filename);
+    }
+
+    std::string body = data.substr(SNAPSHOT_MAGIC_SIZE);
+    SnapshotReader reader(body);
+    Snapshot snapshot;
+    snapshot.program_hash = reader.readVarint();
+    snapshot.state.ip = reader.readVarint();
+
+    // Every encoded value takes at least one byte, which bounds the counts
+    uint64_t stack_size = reader.readVarint();
+    if (stack_size > reader.remaining()) {
+        throw std::runtime_error("Truncated snapshot");
+    }
+    snapshot.state.stack.reserve(stack_size);
+    for (uint64_t i = 0; i < stack_size; i++) {
+        snapshot.state.stack.push_back(reader.readValue(snapshot.state.heap));
+    }
+
+    uint64_t globals_count = reader.readVarint();
+    if (globals_count > reader.remaining()) {
+        throw std::runtime_error("Truncated snapshot");
+    }
+    for (uint64_t i = 0; i < globals_count; i++) {
+        std::string name = reader.readBytes(reader.readVarint());
+        snapshot.state.globals[name] = reader.readValue(snapshot.state.heap);
+    }
+
+    uint64_t frames_count = reader.readVarint();
+    if (frames_count > reader.remaining()) {
+        throw std::runtime_error("Truncated snapshot");
+    }
+    for (uint64_t i = 0; i < frames_count; i++) {
+        Frame frame;
+        frame.return_ip = reader.readVarint();
+        frame.base = reader.readVarint();
+        uint64_t function = reader.readVarint();
+        if (function > UINT32_MAX) {
+            throw std::runtime_error("Malformed snapshot");
+        }
+        frame.function = static_cast<uint32_t>(function);
+        snapshot.state.frames.push_back(frame);
+    }
+    return snapshot;
+}
+
+} // namespace minipy
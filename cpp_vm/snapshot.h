@@ -0,0 +1,32 @@
+#ifndef MINIPY_SNAPSHOT_H
+#define MINIPY_SNAPSHOT_H
+
+#include "vm.h"
+#include <cstdint>
+#include <string>
+
+namespace minipy {
+
+// VM state captured at a CHECKPOINT, tied to the program it was taken from
+struct Snapshot {
+    uint64_t program_hash = 0;
+    VMState state;
+};
+
+// Binary format: "MPSNAP7\n" magic, then varint-encoded fields:
+//   program_hash, ip, stack size, stack values,
+//   globals count, then per global: name length, name bytes, value,
+//   frames count, then per frame: return ip, base, function index.
+// A value is a varint header: small ints are (zigzag << 1); bools are
+// (value << 3 | 3); floats are 5 followed by their IEEE bits; BigInts are
+// (limb count << 4 | negative << 3 | 1) followed by one varint per limb;
+// arrays are (length << 4 | 7) followed by their zigzag elements the first
+// time they are written, and (n << 4 | 8 | 7) for the n-th array written
+// (from 0) after that, so aliases still share one array when loaded; strings
+// are (length << 4 | 8 | 5) followed by their bytes.
+void save_snapshot(const Snapshot& snapshot, const std::string& filename);
+Snapshot load_snapshot(const std::string& filename);
+
+} // namespace minipy
+
+#endif // MINIPY_SNAPSHOT_H
@@ -0,0 +1,304 @@
+#include "value.h"
+#include "bigint.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+namespace minipy {
+
+namespace {
+
+constexpr size_t MIN_CHUNK_SIZE = 4096;
+constexpr size_t MAX_CHUNK_SIZE = 1 << 20;
+constexpr size_t ALIGNMENT = 16;
+
+size_t object_size(const HeapObject* object) {
+    switch (object->kind) {
+        case HeapKind::BigInt:
+            return sizeof(BigIntObject) + object->length * sizeof(uint32_t);
+        case HeapKind::Float:
+            return sizeof(FloatObject);
+        case HeapKind::Array:
+            return sizeof(ArrayObject) + object->length * sizeof(int64_t);
+        case HeapKind::String:
+            return sizeof(StringObject) + object->length;
+        case HeapKind::Rope:
+            return sizeof(RopeObject);
+    }
+    return sizeof(HeapObject);
+}
+
+// Uninitialized heap string of length bytes (more than INLINE_STRING_MAX)
+StringObject* allocate_string(size_t length, Arena& arena, uint8_t flags) {
+    StringObject* object = new (arena.allocate(sizeof(StringObject) + length)) StringObject();
+    object->kind = HeapKind::String;
+    object->flags = flags;
+    object->reserved = 0;
+    object->length = static_cast<uint32_t>(length);
+    return object;
+}
+
+// Body of a double-quoted string constant, unescaped
+std::string parse_string_literal(const std::string& text) {
+    std::string bytes;
+    for (size_t i = 1; i + 1 < text.size(); i++) {
+        char c = text[i];
+        if (c == '"') {
+            throw std::runtime_error("Invalid constant: " + text);
+        }
+        if (c == '\\') {
+            switch (i + 2 < text.size() ? text[++i] : '\0') {
+                case '\\': c = '\\'; break;
+                case '"': c = '"'; break;
+                case '\'': c = '\''; break;
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                default: throw std::runtime_error("Invalid constant: " + text);
+            }
+        }
+        bytes.push_back(c);
+    }
+    return bytes;
+}
+
+bool is_integer_literal(const std::string& text) {
+    size_t start = (!text.empty() && (text[0] == '-' || text[0] == '+')) ? 1 : 0;
+    if (start == text.size()) {
+        return false;
+    }
+    return std::all_of(text.begin() + static_cast<std::ptrdiff_t>(start), text.end(),
+                       [](char c) { return c >= '0' && c <= '9'; });
+}
+
+// Python's repr(): the shortest digits that round-trip, in fixed notation
+// for exponents in [-4, 16) and scientific notation otherwise
+std::string float_to_string(double value) {
+    if (std::isnan(value)) {
+        return "nan";
+    }
+    if (std::isinf(value)) {
+        return value > 0 ? "inf" : "-inf";
+    }
+    char buffer[40];
+    for (int precision = 0; precision < 17; precision++) {
+        std::snprintf(buffer, sizeof(buffer), "%.*e", precision, value);
+        if (std::strtod(buffer, nullptr) == value) {
+            break;
+        }
+    }
+
+    std::string text(buffer);
+    std::string sign;
+    if (text[0] == '-') {
+        sign = "-";
+        text.erase(0, 1);
+    }
+    size_t e = text.find('e');
+    int exponent = std::atoi(text.c_str() + e + 1);
+    std::string digits = text.substr(0, e);
+    digits.erase(std::remove(digits.begin(), digits.end(), '.'), digits.end());
+    while (digits.size() > 1 && digits.back() == '0') {
+        digits.pop_back();
+    }
+
+    if (exponent >= -4 && exponent < 16) {
+        if (exponent < 0) {
+            return sign + "0." + std::string(static_cast<size_t>(-exponent - 1), '0') + digits;
+        }
+        size_t point = static_cast<size_t>(exponent) + 1;
+        if (digits.size() <= point) {
+            return sign + digits + std::string(point - digits.size(), '0') + ".0";
+        }
+        return sign + digits.substr(0, point) + "." + digits.substr(point);
+    }
+    std::string mantissa = digits.substr(0, 1);
+    if (digits.size() > 1) {
+        mantissa += "." + digits.substr(1);
+    }
+    std::snprintf(buffer, sizeof(buffer), "e%c%02d", exponent < 0 ? '-' : '+', std::abs(exponent));
+    return sign + mantissa + buffer;
+}
+
+} // namespace
+
+void* Arena::allocate(size_t bytes) {
+    bytes = std::max(ALIGNMENT, (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1));
+    if (bytes > remaining_) {
+        // Chunks grow with the arena so small VMs stay small
+        size_t size = std::min(MAX_CHUNK_SIZE, std::max(MIN_CHUNK_SIZE, allocated_));
+        size = std::max(size, bytes);
+        chunks_.emplace_back(new char[size]);
+        cursor_ = chunks_.back().get();
+        remaining_ = size;
+    }
+    void* result = cursor_;
+    cursor_ += bytes;
+    remaining_ -= bytes;
+    allocated_ += bytes;
+    return result;
+}
+
+Value make_float(double value, Arena& arena, uint8_t flags) {
+    FloatObject* object = new (arena.allocate(sizeof(FloatObject))) FloatObject();
+    object->kind = HeapKind::Float;
+    object->flags = flags;
+    object->reserved = 0;
+    object->length = 0;
+    object->value = value;
+    return Value::fromHeap(object);
+}
+
+Value make_array(uint32_t length, Arena& arena) {
+    size_t bytes = sizeof(ArrayObject) + length * sizeof(int64_t);
+    ArrayObject* object = new (arena.allocate(bytes)) ArrayObject();
+    object->kind = HeapKind::Array;
+    object->flags = 0;
+    object->reserved = 0;
+    object->length = length;
+    std::memset(object->elements(), 0, length * sizeof(int64_t));
+    return Value::fromHeap(object);
+}
+
+Value make_string(const char* chars, size_t length, Arena& arena, uint8_t flags) {
+    if (length <= INLINE_STRING_MAX) {
+        return Value::fromInlineString(chars, length);
+    }
+    StringObject* object = allocate_string(length, arena, flags);
+    std::memcpy(object->chars(), chars, length);
+    return Value::fromHeap(object);
+}
+
+Value make_rope(Value left, Value right, Arena& arena) {
+    RopeObject* object = new (arena.allocate(sizeof(RopeObject))) RopeObject();
+    object->kind = HeapKind::Rope;
+    object->flags = 0;
+    object->reserved = 0;
+    object->length = static_cast<uint32_t>(string_length(left) + string_length(right));
+    object->left = left;
+    object->right = right;
+    return Value::fromHeap(object);
+}
+
+std::string_view string_bytes(Value value, std::string& scratch) {
+    if (value.isHeap() && value.heap()->kind == HeapKind::String) {
+        return std::string_view(value.flatString()->chars(), value.heap()->length);
+    }
+    scratch.resize(string_length(value));
+    write_string(value, &scratch[0]);
+    return scratch;
+}
+
+void write_string(Value value, char* out) {
+    // Filled from the end, right child first, so the left-deep ropes that
+    // s = s + t builds need only one pending node at a time
+    std::vector<Value> pending;
+    size_t end = string_length(value);
+    for (;;) {
+        while (value.isRope()) {
+            const RopeObject* rope = static_cast<const RopeObject*>(value.heap());
+            pending.push_back(rope->left);
+            value = rope->right;
+        }
+        size_t length = string_length(value);
+        end -= length;
+        if (value.isInlineString()) {
+            for (size_t i = 0; i < length; i++) {
+                out[end + i] = value.inlineChar(i);
+            }
+        } else {
+            std::memcpy(out + end, value.flatString()->chars(), length);
+        }
+        if (pending.empty()) {
+            return;
+        }
+        value = pending.back();
+        pending.pop_back();
+    }
+}
+
+Value parse_constant(const std::string& text, Arena& arena, uint8_t flags) {
+    if (text.size() >= 2 && text.front() == '"' && text.back() == '"') {
+        std::string bytes = parse_string_literal(text);
+        if (bytes.size() > MAX_STRING_LENGTH) {
+            throw std::runtime_error("String too long");
+        }
+        return make_string(bytes.data(), bytes.size(), arena, flags);
+    }
+    if (text == "True" || text == "False") {
+        return Value::fromBool(text == "True");
+    }
+    if (is_integer_literal(text)) {
+        return BigNum::fromString(text).toValue(arena, flags);
+    }
+    char* end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+    if (text.empty() || *end != '\0') {
+        throw std::runtime_error("Invalid constant: " + text);
+    }
+    return make_float(value, arena, flags);
+}
+
+std::string value_to_string(Value value) {
+    if (value.isSmall()) {
+        return std::to_string(value.small());
+    }
+    if (value.isBool()) {
+        return value.boolean() ? "True" : "False";
+    }
+    if (value.isFloat()) {
+        return float_to_string(value.floating());
+    }
+    if (value.isArray()) {
+        const ArrayObject* array = value.array();
+        std::string text = "[";
+        for (uint32_t i = 0; i < array->length; i++) {
+            text += (i ? ", " : "") + std::to_string(array->elements()[i]);
+        }
+        return text + "]";
+    }
+    if (value.isString()) {
+        std::string scratch;
+        return std::string(string_bytes(value, scratch));
+    }
+    return BigNum::fromValue(value).toString();
+}
+
+double value_to_double(Value value) {
+    if (value.isSmall()) {
+        return static_cast<double>(value.small());
+    }
+    if (value.isFloat()) {
+        return value.floating();
+    }
+    return BigNum::fromValue(value).toDouble();
+}
+
+Value HeapCopier::copy(Value value) {
+    if (!value.isHeap()) {
+        return value;
+    }
+    auto it = copies_.find(value.heap());
+    if (it != copies_.end()) {
+        return it->second;
+    }
+    Value result;
+    if (value.isRope()) {
+        StringObject* flat = allocate_string(value.heap()->length, *to_, 0);
+        write_string(value, flat->chars());
+        result = Value::fromHeap(flat);
+    } else {
+        size_t bytes = object_size(value.heap());
+        void* copy = to_->allocate(bytes);
+        std::memcpy(copy, value.heap(), bytes);
+        static_cast<HeapObject*>(copy)->flags &= static_cast<uint8_t>(~(HEAP_PINNED | STRING_INTERNED));
+        result = Value::fromHeap(static_cast<HeapObject*>(copy));
+    }
+    copies_.emplace(value.heap(), result);
+    return result;
+}
+
+} // namespace minipy
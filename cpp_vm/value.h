@@ -0,0 +1,225 @@
+#ifndef MINIPY_VALUE_H
+#define MINIPY_VALUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace minipy {
+
+// Heap objects live in an Arena and start with this header
+enum class HeapKind : uint8_t {
+    BigInt,
+    Float,
+    Array,
+    String,
+    Rope,
+};
+
+struct HeapObject {
+    HeapKind kind;
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t length;   // kind-specific (limb count for BigInt, element count for Array, bytes for String and Rope)
+};
+
+constexpr uint8_t HEAP_PINNED = 1;    // owned by a Program; never moved or freed by a VM
+constexpr uint8_t BIGINT_NEGATIVE = 2;
+// The Program's only string constant with these bytes, so two interned
+// strings are equal exactly when they are the same object
+constexpr uint8_t STRING_INTERNED = 4;
+
+// Arbitrary-precision integer: sign in flags, little-endian 32-bit limbs
+// follow the header. Always normalized: no leading zero limbs, and never a
+// value that fits in a small int.
+struct BigIntObject : HeapObject {
+    uint32_t* limbs() { return reinterpret_cast<uint32_t*>(this + 1); }
+    const uint32_t* limbs() const { return reinterpret_cast<const uint32_t*>(this + 1); }
+    bool negative() const { return (flags & BIGINT_NEGATIVE) != 0; }
+};
+
+// Most limbs of an integer arithmetic produces (2^19 bits, about 158k digits)
+constexpr uint32_t MAX_BIGINT_LIMBS = uint32_t(1) << 14;
+
+// Boxed double
+struct FloatObject : HeapObject {
+    double value;
+};
+
+// Fixed-size array: length int64 elements follow the header. Unlike the
+// other kinds it is mutable, so copies must keep aliases sharing one object.
+struct ArrayObject : HeapObject {
+    int64_t* elements() { return reinterpret_cast<int64_t*>(this + 1); }
+    const int64_t* elements() const { return reinterpret_cast<const int64_t*>(this + 1); }
+};
+
+// Longest array NEW_ARRAY creates
+constexpr uint32_t MAX_ARRAY_LENGTH = uint32_t(1) << 24;
+
+// Immutable string of more than INLINE_STRING_MAX bytes (shorter ones are
+// always stored in the Value itself); length bytes follow the header
+struct StringObject : HeapObject {
+    char* chars() { return reinterpret_cast<char*>(this + 1); }
+    const char* chars() const { return reinterpret_cast<const char*>(this + 1); }
+};
+
+// Longest string ADD builds
+constexpr uint32_t MAX_STRING_LENGTH = uint32_t(1) << 28;
+
+// Bump allocator; everything is freed together when the arena goes away
+class Arena {
+public:
+    Arena() = default;
+    Arena(Arena&&) = default;
+    Arena& operator=(Arena&&) = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // 16-byte aligned, at least 16 bytes
+    void* allocate(size_t bytes);
+    size_t bytesAllocated() const { return allocated_; }
+
+private:
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char* cursor_ = nullptr;
+    size_t remaining_ = 0;
+    size_t allocated_ = 0;
+};
+
+// Tagged 64-bit value.
+//   ...xxx1  small int: the upper 63 bits, two's complement
+//   ...b010  bool: b is the value
+//   ...n100  string of n (0-7) bytes, held in bits 8-63 (first byte lowest)
+//   ...0000  pointer to a 16-byte aligned HeapObject (BigInt, Float, Array, String, Rope)
+// Small ints cover [-2^62, 2^62); anything larger is promoted to a BigInt.
+// Strings of up to 7 bytes are always inline, so two of them are equal
+// exactly when their bits are. The remaining low-bit pattern (110) is free
+// for future immediates.
+class Value {
+public:
+    static constexpr int64_t SMALL_MIN = -(int64_t(1) << 62);
+    static constexpr int64_t SMALL_MAX = (int64_t(1) << 62) - 1;
+
+    Value() : bits_(1) {}
+
+    static Value fromSmall(int64_t v) { return Value((static_cast<uint64_t>(v) << 1) | 1); }
+    static bool fitsSmall(int64_t v) { return v >= SMALL_MIN && v <= SMALL_MAX; }
+    static Value fromBool(bool b) { return Value(b ? BOOL_TAG | 8 : BOOL_TAG); }
+    static Value fromHeap(const HeapObject* object) { return Value(reinterpret_cast<uint64_t>(object)); }
+    static Value fromBits(uint64_t bits) { return Value(bits); }
+    // length must be at most INLINE_STRING_MAX
+    static Value fromInlineString(const char* chars, size_t length) {
+        uint64_t bits = STRING_TAG | (length << 3);
+        for (size_t i = 0; i < length; i++) {
+            bits |= static_cast<uint64_t>(static_cast<uint8_t>(chars[i])) << (8 * (i + 1));
+        }
+        return Value(bits);
+    }
+
+    bool isSmall() const { return (bits_ & 1) != 0; }
+    bool isBool() const { return (bits_ & 7) == BOOL_TAG; }
+    bool isHeap() const { return (bits_ & 7) == 0; }
+    bool isBigInt() const { return isHeap() && heap()->kind == HeapKind::BigInt; }
+    bool isFloat() const { return isHeap() && heap()->kind == HeapKind::Float; }
+    bool isArray() const { return isHeap() && heap()->kind == HeapKind::Array; }
+    bool isInlineString() const { return (bits_ & 7) == STRING_TAG; }
+    bool isRope() const { return isHeap() && heap()->kind == HeapKind::Rope; }
+    bool isString() const {
+        return isInlineString() || (isHeap() && (heap()->kind == HeapKind::String || heap()->kind == HeapKind::Rope));
+    }
+
+    int64_t small() const { return static_cast<int64_t>(bits_) >> 1; }
+    bool boolean() const { return (bits_ & 8) != 0; }
+    const HeapObject* heap() const { return reinterpret_cast<const HeapObject*>(bits_); }
+    const BigIntObject* bigint() const { return static_cast<const BigIntObject*>(heap()); }
+    double floating() const { return static_cast<const FloatObject*>(heap())->value; }
+    // Values refer to arrays the way Python names do, so stores go through any copy of the Value
+    ArrayObject* array() const { return reinterpret_cast<ArrayObject*>(bits_); }
+    size_t inlineLength() const { return (bits_ >> 3) & 7; }
+    char inlineChar(size_t i) const { return static_cast<char>(bits_ >> (8 * (i + 1))); }
+    // A heap string that is not a rope
+    const StringObject* flatString() const { return static_cast<const StringObject*>(heap()); }
+    uint64_t bits() const { return bits_; }
+
+    // Both operands small, tested with a single AND
+    static bool bothSmall(Value a, Value b) { return (a.bits_ & b.bits_ & 1) != 0; }
+
+    bool operator==(Value other) const { return bits_ == other.bits_; }
+    bool operator!=(Value other) const { return bits_ != other.bits_; }
+
+private:
+    static constexpr uint64_t BOOL_TAG = 2;
+    static constexpr uint64_t STRING_TAG = 4;
+
+    explicit Value(uint64_t bits) : bits_(bits) {}
+    uint64_t bits_;
+};
+
+static_assert(sizeof(Value) == 8, "Value must stay one machine word");
+
+constexpr size_t INLINE_STRING_MAX = 7;
+
+// Concatenation of two strings, built by ADD so that appending in a loop
+// copies nothing; length is the total. Copying one (as the collector does)
+// flattens it into a StringObject.
+struct RopeObject : HeapObject {
+    Value left;
+    Value right;
+};
+
+// Boxed float allocated in the arena
+Value make_float(double value, Arena& arena, uint8_t flags = 0);
+
+// Zero-filled array of length elements (at most MAX_ARRAY_LENGTH) allocated in the arena
+Value make_array(uint32_t length, Arena& arena);
+
+// String of the given bytes: inline when it fits, else allocated in the arena
+Value make_string(const char* chars, size_t length, Arena& arena, uint8_t flags = 0);
+
+// Rope of two strings whose lengths add up to at most MAX_STRING_LENGTH
+Value make_rope(Value left, Value right, Arena& arena);
+
+// Length in bytes of any string
+inline size_t string_length(Value value) {
+    return value.isInlineString() ? value.inlineLength() : value.heap()->length;
+}
+
+// Bytes of any string; scratch holds them when they are not already
+// contiguous (inline strings and ropes)
+std::string_view string_bytes(Value value, std::string& scratch);
+
+// Copy a string's string_length(value) bytes to out; ropes of any depth are
+// walked without recursion
+void write_string(Value value, char* out);
+
+// Bytecode constant from its text: True/False, an integer of any size, a
+// float, or a double-quoted string with \\, \", \', \n and \t escapes
+Value parse_constant(const std::string& text, Arena& arena, uint8_t flags = 0);
+
+// Printed form, matching Python's str()
+std::string value_to_string(Value value);
+
+// Numeric value as a double (bools count as 0/1)
+double value_to_double(Value value);
+
+// Copies values' heap objects into another arena, each object once: values
+// sharing an object before share its copy afterwards. Ropes are flattened,
+// and copies are neither pinned nor interned.
+class HeapCopier {
+public:
+    explicit HeapCopier(Arena& to) : to_(&to) {}
+
+    Value copy(Value value);
+
+private:
+    Arena* to_;
+    std::unordered_map<const HeapObject*, Value> copies_;
+};
+
+} // namespace minipy
+
+#endif // MINIPY_VALUE_H
@@ -1,14 +1,516 @@
 #include "vm.h"
+#include "bigint.h"
+#include "array_kernels.h"
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
+#include <cmath>
 #include <cstring>
+#include <sstream>
 
 namespace minipy {
 
-VM::VM(const std::vector<Instruction>& code,
-       const std::vector<Value>& consts,
-       const std::vector<std::string>& names)
-    : code_(code), consts_(consts), names_(names), ip_(0) {
+namespace {
+
+const char* const OPCODE_NAMES[] = {
+    "LOAD_CONST",
+    "LOAD_NAME",
+    "STORE_NAME",
+    "LOAD_FAST",
+    "STORE_FAST",
+    "ADD",
+    "SUB",
+    "MUL",
+    "DIV",
+    "ADD_INT",
+    "SUB_INT",
+    "MUL_INT",
+    "DIV_INT",
+    "CMP_LT_INT",
+    "CMP_GT_INT",
+    "CMP_LE_INT",
+    "CMP_GE_INT",
+    "CMP_EQ_INT",
+    "CMP_NEQ_INT",
+    "CMP_LT",
+    "CMP_GT",
+    "CMP_LE",
+    "CMP_GE",
+    "CMP_EQ",
+    "CMP_NEQ",
+    "JUMP",
+    "JUMP_IF_FALSE",
+    "JUMP_IF_TRUE",
+    "JUMP_IF_LT",
+    "JUMP_IF_GT",
+    "JUMP_IF_LE",
+    "JUMP_IF_GE",
+    "JUMP_IF_EQ",
+    "JUMP_IF_NEQ",
+    "FOR_RANGE",
+    "CALL",
+    "TAIL_CALL",
+    "RETURN",
+    "POP",
+    "DUP",
+    "SWAP",
+    "ROT",
+    "NEW_ARRAY",
+    "ARRAY_LEN",
+    "LOAD_INDEX",
+    "LOAD_INDEX_UNCHECKED",
+    "STORE_INDEX",
+    "STORE_INDEX_UNCHECKED",
+    "ARRAY_SUM",
+    "ARRAY_MIN",
+    "ARRAY_MAX",
+    "ARRAY_FILL",
+    "ARRAY_ADD",
+    "ARRAY_COUNT_LT",
+    "PRINT",
+    "CHECKPOINT",
+    "HALT",
+};
+
+constexpr size_t OPCODE_COUNT = sizeof(OPCODE_NAMES) / sizeof(OPCODE_NAMES[0]);
+static_assert(OPCODE_COUNT == static_cast<size_t>(Opcode::HALT) + 1, "OPCODE_NAMES out of sync with Opcode");
+
+const Value ZERO = Value::fromSmall(0);
+
+// Zero, 0.0, False, empty strings and empty arrays are false (a BigInt is
+// never zero, and the empty string is always inline)
+inline bool is_truthy(Value value) {
+    if (value.isSmall()) {
+        return value != ZERO;
+    }
+    if (value.isBool()) {
+        return value.boolean();
+    }
+    if (value.isInlineString()) {
+        return value.inlineLength() != 0;
+    }
+    if (value.isFloat()) {
+        return value.floating() != 0.0;
+    }
+    if (value.isArray()) {
+        return value.array()->length != 0;
+    }
+    return true;
+}
+
+inline ArrayObject* array_operand(Value value) {
+    if (!value.isArray()) {
+        throw std::runtime_error("Not an array");
+    }
+    return value.array();
+}
+
+// Element of a LOAD_INDEX or STORE_INDEX, after checking the operands
+inline int64_t& checked_element(Value array, Value index) {
+    ArrayObject* object = array_operand(array);
+    if (!index.isSmall() || index.small() < 0 || index.small() >= object->length) {
+        throw std::runtime_error("Array index out of range");
+    }
+    return object->elements()[index.small()];
+}
+
+// An integer as an element; false when it does not fit 64 bits
+bool element_value(Value value, int64_t& element) {
+    if (value.isSmall()) {
+        element = value.small();
+        return true;
+    }
+    if (value.isBool()) {
+        element = value.boolean() ? 1 : 0;
+        return true;
+    }
+    if (!value.isBigInt()) {
+        throw std::runtime_error("Array elements must be int");
+    }
+    const BigIntObject* big = value.bigint();
+    if (big->length > 2) {
+        return false;
+    }
+    uint64_t magnitude = big->limbs()[0] | (big->length > 1 ? uint64_t(big->limbs()[1]) << 32 : 0);
+    if (magnitude > (big->negative() ? uint64_t(1) << 63 : uint64_t(INT64_MAX))) {
+        return false;
+    }
+    // Negated without overflowing at -2^63
+    element = big->negative() ? -static_cast<int64_t>(magnitude - 1) - 1 : static_cast<int64_t>(magnitude);
+    return true;
+}
+
+// An integer stored into an array; elements are 64-bit
+int64_t to_element(Value value) {
+    int64_t element;
+    if (!element_value(value, element)) {
+        throw std::runtime_error("Array value out of range");
+    }
+    return element;
+}
+
+template <typename T>
+inline bool apply_comparison(Opcode opcode, T x, T y) {
+    switch (opcode) {
+        case Opcode::CMP_LT: case Opcode::CMP_LT_INT: case Opcode::JUMP_IF_LT: return x < y;
+        case Opcode::CMP_GT: case Opcode::CMP_GT_INT: case Opcode::JUMP_IF_GT: return x > y;
+        case Opcode::CMP_LE: case Opcode::CMP_LE_INT: case Opcode::JUMP_IF_LE: return x <= y;
+        case Opcode::CMP_GE: case Opcode::CMP_GE_INT: case Opcode::JUMP_IF_GE: return x >= y;
+        case Opcode::CMP_EQ: case Opcode::CMP_EQ_INT: case Opcode::JUMP_IF_EQ: return x == y;
+        default: return x != y;
+    }
+}
+
+// CMP_* on two strings. Equality rarely reads the bytes: short strings are
+// equal exactly when their bits are, strings of different lengths differ, and
+// so do two interned constants that are not the same object.
+bool compare_strings(Opcode opcode, Value a, Value b) {
+    if (!a.isString() || !b.isString()) {
+        throw std::runtime_error("Unsupported operand type: str");
+    }
+    std::string a_scratch;
+    std::string b_scratch;
+    if (opcode == Opcode::CMP_EQ || opcode == Opcode::CMP_NEQ || opcode == Opcode::JUMP_IF_EQ ||
+        opcode == Opcode::JUMP_IF_NEQ) {
+        bool equal;
+        if (a == b) {
+            equal = true;
+        } else if (a.isInlineString() || b.isInlineString() || a.heap()->length != b.heap()->length ||
+                   (a.heap()->flags & b.heap()->flags & STRING_INTERNED)) {
+            equal = false;
+        } else {
+            equal = string_bytes(a, a_scratch) == string_bytes(b, b_scratch);
+        }
+        return equal == (opcode == Opcode::CMP_EQ || opcode == Opcode::JUMP_IF_EQ);
+    }
+    return apply_comparison(opcode, string_bytes(a, a_scratch).compare(string_bytes(b, b_scratch)), 0);
+}
+
+// CMP_* on any two numbers or strings. Tagged small ints order the same as
+// their raw bits, so the common case needs no untagging.
+inline bool compare(Opcode opcode, Value a, Value b) {
+    if (Value::bothSmall(a, b)) {
+        return apply_comparison(opcode, static_cast<int64_t>(a.bits()), static_cast<int64_t>(b.bits()));
+    }
+    if (a.isString() || b.isString()) {
+        return compare_strings(opcode, a, b);
+    }
+    if (a.isFloat() || b.isFloat()) {
+        return apply_comparison(opcode, value_to_double(a), value_to_double(b));
+    }
+    return apply_comparison(opcode, compare_values(a, b), 0);
+}
+
+// CMP_*_INT: both operands are small ints or BigInts, so no float check
+inline bool compare_integers(Opcode opcode, Value a, Value b) {
+    if (Value::bothSmall(a, b)) {
+        return apply_comparison(opcode, static_cast<int64_t>(a.bits()), static_cast<int64_t>(b.bits()));
+    }
+    return apply_comparison(opcode, compare_values(a, b), 0);
+}
+
+// Python's float floor division
+double floor_divide(double x, double y) {
+    double mod = std::fmod(x, y);
+    double div = (x - mod) / y;
+    if (mod != 0.0 && (y < 0) != (mod < 0)) {
+        div -= 1.0;
+    }
+    if (div == 0.0) {
+        return std::copysign(0.0, x / y);
+    }
+    double floored = std::floor(div);
+    if (div - floored > 0.5) {
+        floored += 1.0;
+    }
+    return floored;
+}
+
+// "func <name> <entry> <nparams> <nlocals>"; false for any other constant
+bool parse_function(const std::string& text, Function& function) {
+    if (text.compare(0, 5, "func ") != 0) {
+        return false;
+    }
+    std::istringstream in(text.substr(5));
+    std::string extra;
+    if (!(in >> function.name >> function.entry >> function.nparams >> function.nlocals) || (in >> extra) ||
+        function.nparams > function.nlocals) {
+        throw std::runtime_error("Invalid function constant: " + text);
+    }
+    return true;
+}
+
+inline bool is_jump(Opcode opcode) {
+    switch (opcode) {
+        case Opcode::JUMP:
+        case Opcode::JUMP_IF_FALSE:
+        case Opcode::JUMP_IF_TRUE:
+        case Opcode::JUMP_IF_LT:
+        case Opcode::JUMP_IF_GT:
+        case Opcode::JUMP_IF_LE:
+        case Opcode::JUMP_IF_GE:
+        case Opcode::JUMP_IF_EQ:
+        case Opcode::JUMP_IF_NEQ:
+        case Opcode::FOR_RANGE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Instructions after which control never falls through to the next one
+inline bool ends_region(Opcode opcode) {
+    return opcode == Opcode::RETURN || opcode == Opcode::TAIL_CALL || opcode == Opcode::JUMP ||
+           opcode == Opcode::HALT;
+}
+
+// Jump threading and dead code removal over validated code, the same pass the
+// compiler runs (so it only changes bytecode from older compilers). Jumps to
+// an unconditional JUMP go to its final target, a JUMP to HALT or RETURN
+// becomes a copy of it, and unreachable instructions and JUMPs to the next
+// surviving instruction are dropped; targets and entry points are re-patched.
+// Then STORE_NAME x; LOAD_NAME x becomes DUP; STORE_NAME x where the load is
+// not a jump target.
+void peephole(std::vector<Instruction>& code, std::vector<Function>& functions) {
+    while (!code.empty()) {
+        bool changed = false;
+        for (Instruction& instr : code) {
+            if (!is_jump(instr.opcode)) {
+                continue;
+            }
+            size_t target = static_cast<size_t>(instr.arg);
+            // Bounded, since a loop made only of jumps never ends
+            for (size_t hops = 0; code[target].opcode == Opcode::JUMP && hops < code.size(); hops++) {
+                target = static_cast<size_t>(code[target].arg);
+            }
+            if (code[target].opcode == Opcode::JUMP) {
+                continue;
+            }
+            if (instr.opcode == Opcode::JUMP &&
+                (code[target].opcode == Opcode::HALT || code[target].opcode == Opcode::RETURN)) {
+                instr = Instruction(code[target].opcode);
+                changed = true;
+            } else if (static_cast<int64_t>(target) != instr.arg) {
+                instr.arg = static_cast<int64_t>(target);
+                changed = true;
+            }
+        }
+
+        std::vector<bool> reachable(code.size(), false);
+        std::vector<size_t> work = {0};
+        for (const Function& function : functions) {
+            work.push_back(function.entry);
+        }
+        while (!work.empty()) {
+            size_t i = work.back();
+            work.pop_back();
+            if (i >= code.size() || reachable[i]) {
+                continue;
+            }
+            reachable[i] = true;
+            if (is_jump(code[i].opcode)) {
+                work.push_back(static_cast<size_t>(code[i].arg));
+            }
+            if (!ends_region(code[i].opcode)) {
+                work.push_back(i + 1);
+            }
+        }
+
+        std::vector<bool> keep(code.size());
+        size_t next_reachable = code.size();
+        for (size_t i = code.size(); i-- > 0;) {
+            keep[i] = reachable[i] && !(code[i].opcode == Opcode::JUMP &&
+                                        static_cast<size_t>(code[i].arg) == next_reachable);
+            if (reachable[i]) {
+                next_reachable = i;
+            }
+        }
+        if (!changed && std::find(keep.begin(), keep.end(), false) == keep.end()) {
+            break;
+        }
+
+        // A removed instruction maps to where the next kept one ends up
+        std::vector<size_t> new_index(code.size());
+        std::vector<Instruction> compacted;
+        for (size_t i = 0; i < code.size(); i++) {
+            new_index[i] = compacted.size();
+            if (keep[i]) {
+                compacted.push_back(code[i]);
+            }
+        }
+        for (Instruction& instr : compacted) {
+            if (is_jump(instr.opcode)) {
+                instr.arg = static_cast<int64_t>(new_index[static_cast<size_t>(instr.arg)]);
+            }
+        }
+        for (Function& function : functions) {
+            function.entry = new_index[function.entry];
+        }
+        code = std::move(compacted);
+    }
+
+    std::vector<bool> target(code.size() + 1, false);
+    for (const Instruction& instr : code) {
+        if (is_jump(instr.opcode)) {
+            target[std::min(static_cast<size_t>(instr.arg), code.size())] = true;
+        }
+    }
+    for (const Function& function : functions) {
+        target[std::min(function.entry, code.size())] = true;
+    }
+    for (size_t i = 0; i + 1 < code.size(); i++) {
+        if (code[i].opcode == Opcode::STORE_NAME && code[i + 1].opcode == Opcode::LOAD_NAME &&
+            code[i + 1].arg == code[i].arg && !target[i + 1]) {
+            code[i + 1] = code[i];
+            code[i] = Instruction(Opcode::DUP);
+        }
+    }
+}
+
+} // namespace
+
+const char* opcode_name(Opcode opcode) {
+    return OPCODE_NAMES[static_cast<size_t>(opcode)];
+}
+
+bool parse_opcode(const std::string& name, Opcode& opcode) {
+    static const std::unordered_map<std::string, Opcode> by_name = [] {
+        std::unordered_map<std::string, Opcode> table;
+        for (size_t i = 0; i < OPCODE_COUNT; i++) {
+            table[OPCODE_NAMES[i]] = static_cast<Opcode>(i);
+        }
+        return table;
+    }();
+    auto it = by_name.find(name);
+    if (it == by_name.end()) {
+        return false;
+    }
+    opcode = it->second;
+    return true;
+}
+
+Program::Program(std::vector<Instruction> code_in, const std::vector<std::string>& consts_in,
+                 std::vector<std::string> names_in)
+    : code(std::move(code_in)), names(std::move(names_in)) {
+    // Const index -> function index, or -1
+    std::vector<int64_t> function_of_const;
+    // Interned string constants by contents
+    std::unordered_map<std::string, Value> strings;
+    for (const std::string& text : consts_in) {
+        Function function;
+        if (parse_function(text, function)) {
+            if (function.entry >= code.size()) {
+                throw std::runtime_error("Invalid entry point for function " + function.name);
+            }
+            function_of_const.push_back(static_cast<int64_t>(functions.size()));
+            functions.push_back(std::move(function));
+            consts.push_back(Value::fromSmall(0));
+        } else {
+            function_of_const.push_back(-1);
+            Value value = parse_constant(text, heap, HEAP_PINNED);
+            if (value.isString() && value.isHeap()) {
+                std::string scratch;
+                auto interned = strings.emplace(std::string(string_bytes(value, scratch)), value);
+                value = interned.first->second;
+                const_cast<HeapObject*>(value.heap())->flags |= STRING_INTERNED;
+            }
+            consts.push_back(value);
+        }
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        name_slots.emplace(names[i], i);
+    }
+
+    // Split the code into regions: top-level code up to the first entry point,
+    // then each function up to the next. Jumps stay inside their region and no
+    // region falls through into the next, so LOAD_FAST/STORE_FAST slots can be
+    // checked against the function that owns them.
+    std::vector<int64_t> owner(code.size(), -1);
+    std::vector<size_t> order(functions.size());
+    for (size_t f = 0; f < functions.size(); f++) {
+        order[f] = f;
+    }
+    std::sort(order.begin(), order.end(),
+              [this](size_t a, size_t b) { return functions[a].entry < functions[b].entry; });
+    for (size_t k = 0; k < order.size(); k++) {
+        size_t begin = functions[order[k]].entry;
+        size_t end = k + 1 < order.size() ? functions[order[k + 1]].entry : code.size();
+        if (begin == end) {
+            throw std::runtime_error("Functions share an entry point: " + functions[order[k]].name);
+        }
+        std::fill(owner.begin() + static_cast<std::ptrdiff_t>(begin), owner.begin() + static_cast<std::ptrdiff_t>(end),
+                  static_cast<int64_t>(order[k]));
+        if (!ends_region(code[end - 1].opcode)) {
+            throw std::runtime_error("Function " + functions[order[k]].name + " falls off its end");
+        }
+    }
+    if (!functions.empty()) {
+        size_t main_end = functions[order[0]].entry;
+        if (main_end == 0) {
+            throw std::runtime_error("Program starts inside a function");
+        }
+        if (!ends_region(code[main_end - 1].opcode)) {
+            throw std::runtime_error("Top-level code falls into a function");
+        }
+    }
+
+    for (size_t i = 0; i < code.size(); i++) {
+        Instruction& instr = code[i];
+        size_t limit;
+        switch (instr.opcode) {
+            case Opcode::LOAD_CONST:
+                limit = consts.size();
+                if (instr.arg >= 0 && static_cast<size_t>(instr.arg) < limit && function_of_const[instr.arg] >= 0) {
+                    limit = 0;  // functions are not values
+                }
+                break;
+            case Opcode::LOAD_NAME:
+            case Opcode::STORE_NAME:
+                limit = names.size();
+                break;
+            case Opcode::LOAD_FAST:
+            case Opcode::STORE_FAST:
+                limit = owner[i] >= 0 ? functions[owner[i]].nlocals : 0;
+                break;
+            case Opcode::CALL:
+            case Opcode::TAIL_CALL:
+                // A tail call needs a frame to replace
+                limit = instr.opcode == Opcode::TAIL_CALL && owner[i] < 0 ? 0 : consts.size();
+                if (instr.arg >= 0 && static_cast<size_t>(instr.arg) < limit) {
+                    if (function_of_const[instr.arg] < 0) {
+                        limit = 0;
+                    } else {
+                        instr.arg = function_of_const[instr.arg];
+                        limit = functions.size();
+                    }
+                }
+                break;
+            default:
+                if (!is_jump(instr.opcode)) {
+                    continue;
+                }
+                limit = code.size();
+                if (instr.arg >= 0 && static_cast<size_t>(instr.arg) < limit && owner[instr.arg] != owner[i]) {
+                    limit = 0;
+                }
+                break;
+        }
+        if (instr.arg < 0 || static_cast<size_t>(instr.arg) >= limit) {
+            throw std::runtime_error(std::string("Invalid argument for ") + opcode_name(instr.opcode) +
+                                     " at instruction " + std::to_string(i));
+        }
+    }
+
+    peephole(code, functions);
+}
+
+VM::VM(std::shared_ptr<const Program> program)
+    : program_(std::move(program)), base_(0), floor_(0), ip_(0), out_(&std::cout), stop_at_checkpoint_(false),
+      preemptible_(false), instruction_budget_(0), time_budget_(0),
+      charged_(0), clock_checked_at_(0) {
+    globals_.resize(program_->names.size());
+    defined_.resize(program_->names.size());
+    gc_threshold_ = MIN_GC_THRESHOLD;
 }
 
 void VM::push(Value value) {
@@ -19,7 +521,7 @@ void VM::push(Value value) {
 }
 
 Value VM::pop() {
-    if (stack_.empty()) {
+    if (stack_.size() <= floor_) {
         throw std::runtime_error("Stack underflow");
     }
     Value value = stack_.back();
@@ -28,146 +530,776 @@ Value VM::pop() {
 }
 
 Value VM::peek() const {
-    if (stack_.empty()) {
+    if (stack_.size() <= floor_) {
         throw std::runtime_error("Stack underflow");
     }
     return stack_.back();
 }
 
-void VM::run() {
-    ip_ = 0;
-    
-    while (ip_ < code_.size()) {
-        const Instruction& instr = code_[ip_];
-        const std::string& opcode = instr.opcode;
-        int64_t arg = instr.arg;
-        
-        if (opcode == "LOAD_CONST") {
-            push(consts_[arg]);
-            ip_++;
-        }
-        else if (opcode == "LOAD_NAME") {
-            const std::string& name = names_[arg];
-            if (globals_.find(name) == globals_.end()) {
-                throw std::runtime_error("Undefined variable: " + name);
-            }
-            push(globals_[name]);
-            ip_++;
-        }
-        else if (opcode == "STORE_NAME") {
-            Value value = pop();
-            const std::string& name = names_[arg];
-            globals_[name] = value;
-            ip_++;
-        }
-        else if (opcode == "ADD") {
-            Value b = pop();
-            Value a = pop();
-            push(a + b);
-            ip_++;
-        }
-        else if (opcode == "SUB") {
-            Value b = pop();
-            Value a = pop();
-            push(a - b);
-            ip_++;
-        }
-        else if (opcode == "MUL") {
-            Value b = pop();
-            Value a = pop();
-            push(a * b);
-            ip_++;
-        }
-        else if (opcode == "DIV") {
-            Value b = pop();
-            Value a = pop();
-            if (b == 0) {
-                throw std::runtime_error("Division by zero");
-            }
-            push(a / b);
-            ip_++;
+std::unordered_map<std::string, Value> VM::getGlobals() const {
+    std::unordered_map<std::string, Value> globals;
+    for (size_t slot = 0; slot < globals_.size(); slot++) {
+        if (defined_[slot]) {
+            globals[program_->names[slot]] = globals_[slot];
         }
-        else if (opcode == "CMP_LT") {
-            Value b = pop();
-            Value a = pop();
-            push(a < b ? 1 : 0);
-            ip_++;
+    }
+    return globals;
+}
+
+void VM::setGlobal(const std::string& name, Value value) {
+    auto it = program_->name_slots.find(name);
+    if (it != program_->name_slots.end()) {
+        globals_[it->second] = value;
+        defined_[it->second] = true;
+    }
+}
+
+// Callers must not hold heap Values outside the stack and globals across this
+// call: it may run the collector
+Value VM::makeInteger(const BigNum& number) {
+    if (number.magnitude().size() > MAX_BIGINT_LIMBS) {
+        throw std::runtime_error("Integer too large");
+    }
+    if (heap_.bytesAllocated() >= gc_threshold_) {
+        collectGarbage();
+    }
+    return number.toValue(heap_);
+}
+
+Value VM::makeFloat(double number) {
+    if (heap_.bytesAllocated() >= gc_threshold_) {
+        collectGarbage();
+    }
+    return make_float(number, heap_);
+}
+
+Value VM::makeArray(uint32_t length) {
+    if (heap_.bytesAllocated() >= gc_threshold_) {
+        collectGarbage();
+    }
+    return make_array(length, heap_);
+}
+
+Value VM::loadElement(int64_t element) {
+    return Value::fitsSmall(element) ? Value::fromSmall(element) : makeInteger(BigNum(element));
+}
+
+Value VM::arraySum(SplitSum sum) {
+    int64_t high;
+    int64_t total;
+    if (!__builtin_mul_overflow(sum.high, int64_t(1) << 32, &high) &&
+        !__builtin_add_overflow(high, static_cast<int64_t>(sum.low), &total)) {
+        return loadElement(total);
+    }
+    return makeInteger(BigNum(sum.high) * BigNum(int64_t(1) << 32) + BigNum(static_cast<int64_t>(sum.low)));
+}
+
+Value VM::concatenate(Value a, Value b) {
+    size_t length = string_length(a) + string_length(b);
+    if (length > MAX_STRING_LENGTH) {
+        throw std::runtime_error("String too long");
+    }
+    if (string_length(a) == 0 || string_length(b) == 0) {
+        return string_length(a) == 0 ? b : a;
+    }
+    if (heap_.bytesAllocated() >= gc_threshold_) {
+        // The operands were popped, so they ride out the collection on the stack
+        push(a);
+        push(b);
+        collectGarbage();
+        b = pop();
+        a = pop();
+    }
+    if (length >= MIN_ROPE_LENGTH) {
+        return make_rope(a, b, heap_);
+    }
+    char bytes[MIN_ROPE_LENGTH];
+    write_string(a, bytes);
+    write_string(b, bytes + string_length(a));
+    return make_string(bytes, length, heap_);
+}
+
+// Slow path of ADD/SUB/MUL/DIV once either operand is not a small int:
+// strings concatenate, floats win, otherwise the result is an integer of any size
+Value VM::arithmetic(Opcode opcode, Value a, Value b) {
+    if (a.isString() || b.isString()) {
+        if (opcode != Opcode::ADD || !a.isString() || !b.isString()) {
+            throw std::runtime_error("Unsupported operand type: str");
         }
-        else if (opcode == "CMP_GT") {
-            Value b = pop();
-            Value a = pop();
-            push(a > b ? 1 : 0);
-            ip_++;
+        return concatenate(a, b);
+    }
+    if (a.isFloat() || b.isFloat()) {
+        double x = value_to_double(a);
+        double y = value_to_double(b);
+        switch (opcode) {
+            case Opcode::ADD: return makeFloat(x + y);
+            case Opcode::SUB: return makeFloat(x - y);
+            case Opcode::MUL: return makeFloat(x * y);
+            default:
+                if (y == 0.0) {
+                    throw std::runtime_error("Division by zero");
+                }
+                return makeFloat(floor_divide(x, y));
         }
-        else if (opcode == "CMP_LE") {
-            Value b = pop();
-            Value a = pop();
-            push(a <= b ? 1 : 0);
-            ip_++;
+    }
+    return integerArithmetic(opcode, a, b);
+}
+
+// Slow path of the *_INT forms (and of integer operands of the generic ones):
+// small-int overflow or BigInt operands. Multiplication and division cost
+// the product of the operands' limb counts and are charged for it.
+Value VM::integerArithmetic(Opcode opcode, Value a, Value b) {
+    BigNum x = BigNum::fromValue(a);
+    BigNum y = BigNum::fromValue(b);
+    size_t limbs = x.magnitude().size() * y.magnitude().size();
+    switch (opcode) {
+        case Opcode::ADD: case Opcode::ADD_INT: return makeInteger(x + y);
+        case Opcode::SUB: case Opcode::SUB_INT: return makeInteger(x - y);
+        case Opcode::MUL: case Opcode::MUL_INT:
+            // The product has at least this many limbs; refused before it is computed
+            if (x.magnitude().size() + y.magnitude().size() > MAX_BIGINT_LIMBS + 1) {
+                throw std::runtime_error("Integer too large");
+            }
+            chargeWork(limbs);
+            return makeInteger(x * y);
+        default:
+            chargeWork(limbs);
+            if (y.isZero()) {
+                throw std::runtime_error("Division by zero");
+            }
+            return makeInteger(BigNum::floorDiv(x, y));
+    }
+}
+
+// FOR_RANGE with a BigInt counter, bound or step (the stack holds
+// [counter, stop, step] above floor_). Returns false when the range is
+// exhausted; otherwise pushes the counter and advances it.
+bool VM::forRangeSlow() {
+    size_t top = stack_.size();
+    for (size_t i = top - 3; i < top; i++) {
+        if (stack_[i].isFloat()) {
+            throw std::runtime_error("range() arguments must be integers");
         }
-        else if (opcode == "CMP_GE") {
-            Value b = pop();
-            Value a = pop();
-            push(a >= b ? 1 : 0);
-            ip_++;
+    }
+    int direction = compare_values(stack_[top - 1], ZERO);
+    if (direction == 0) {
+        throw std::runtime_error("range() step must not be zero");
+    }
+    if (compare_values(stack_[top - 3], stack_[top - 2]) != -direction) {
+        return false;
+    }
+    // makeInteger may move heap values, so the counter is reloaded afterwards
+    Value next = makeInteger(BigNum::fromValue(stack_[top - 3]) + BigNum::fromValue(stack_[top - 1]));
+    Value counter = stack_[top - 3];
+    stack_[top - 3] = next;
+    push(counter);
+    return true;
+}
+
+// Copy the heap values still reachable from the stack and globals into a fresh
+// arena and drop the old one. Program constants are pinned and stay put.
+void VM::collectGarbage() {
+    Arena live;
+    HeapCopier copier(live);
+    auto relocate = [&copier](Value& value) {
+        if (value.isHeap() && !(value.heap()->flags & HEAP_PINNED)) {
+            value = copier.copy(value);
         }
-        else if (opcode == "CMP_EQ") {
-            Value b = pop();
-            Value a = pop();
-            push(a == b ? 1 : 0);
-            ip_++;
+    };
+    for (Value& value : stack_) {
+        relocate(value);
+    }
+    for (size_t slot = 0; slot < globals_.size(); slot++) {
+        if (defined_[slot]) {
+            relocate(globals_[slot]);
         }
-        else if (opcode == "CMP_NEQ") {
-            Value b = pop();
-            Value a = pop();
-            push(a != b ? 1 : 0);
-            ip_++;
+    }
+    heap_ = std::move(live);
+    gc_threshold_ = std::max(MIN_GC_THRESHOLD, 2 * heap_.bytesAllocated());
+}
+
+VMState VM::saveState() const {
+    VMState state;
+    state.ip = ip_;
+    HeapCopier copier(state.heap);
+    for (Value value : stack_) {
+        state.stack.push_back(copier.copy(value));
+    }
+    state.frames = frames_;
+    for (const auto& global : getGlobals()) {
+        state.globals[global.first] = copier.copy(global.second);
+    }
+    return state;
+}
+
+void VM::restoreState(const VMState& state) {
+    if (state.ip > program_->code.size()) {
+        throw std::runtime_error("Invalid instruction pointer in saved state");
+    }
+    if (state.stack.size() > MAX_STACK_SIZE) {
+        throw std::runtime_error("Stack overflow");
+    }
+    if (state.frames.size() > MAX_CALL_DEPTH) {
+        throw std::runtime_error("Maximum recursion depth exceeded");
+    }
+    // Each frame's locals must lie on the stack, above its caller's
+    size_t floor = 0;
+    for (const Frame& frame : state.frames) {
+        if (frame.function >= program_->functions.size() || frame.return_ip > program_->code.size() ||
+            frame.base < floor || frame.base + program_->functions[frame.function].nlocals > state.stack.size()) {
+            throw std::runtime_error("Invalid call frame in saved state");
         }
-        else if (opcode == "JUMP") {
-            if (arg < 0 || static_cast<size_t>(arg) >= code_.size()) {
-                throw std::runtime_error("Invalid jump target");
+        floor = frame.base + program_->functions[frame.function].nlocals;
+    }
+    ip_ = state.ip;
+    stack_.clear();
+    HeapCopier copier(heap_);
+    for (Value value : state.stack) {
+        stack_.push_back(copier.copy(value));
+    }
+    frames_ = state.frames;
+    enterFrame();
+    std::fill(defined_.begin(), defined_.end(), false);
+    for (const auto& global : state.globals) {
+        setGlobal(global.first, copier.copy(global.second));
+    }
+}
+
+void VM::setBudget(uint64_t instructions, std::chrono::nanoseconds time) {
+    instruction_budget_ = instructions;
+    time_budget_ = time;
+    preemptible_ = instructions > 0 || time.count() > 0;
+}
+
+void VM::startSlice() {
+    charged_ = 0;
+    clock_checked_at_ = 0;
+    if (time_budget_.count() > 0) {
+        deadline_ = std::chrono::steady_clock::now() + time_budget_;
+    }
+}
+
+// Returns true when the slice is used up and execution should suspend
+bool VM::charge(uint64_t instructions) {
+    charged_ += instructions;
+    if (instruction_budget_ > 0 && charged_ >= instruction_budget_) {
+        return true;
+    }
+    if (time_budget_.count() > 0 && charged_ - clock_checked_at_ >= CLOCK_CHECK_INTERVAL) {
+        clock_checked_at_ = charged_;
+        return std::chrono::steady_clock::now() >= deadline_;
+    }
+    return false;
+}
+
+// Jump to target; true when a backward jump used up the slice
+inline bool VM::jump(int64_t target) {
+    bool suspend = preemptible_ && static_cast<size_t>(target) <= ip_ && charge(ip_ - static_cast<size_t>(target) + 1);
+    ip_ = static_cast<size_t>(target);
+    return suspend;
+}
+
+// Point base_ and floor_ at the innermost frame (top-level code has neither)
+void VM::enterFrame() {
+    if (frames_.empty()) {
+        base_ = 0;
+        floor_ = 0;
+    } else {
+        base_ = frames_.back().base;
+        floor_ = base_ + program_->functions[frames_.back().function].nlocals;
+    }
+}
+
+RunStatus VM::run() {
+    ip_ = 0;
+    stack_.clear();
+    frames_.clear();
+    enterFrame();
+    return execute();
+}
+
+RunStatus VM::resume() {
+    return execute();
+}
+
+RunStatus VM::execute() {
+    if (preemptible_) {
+        startSlice();
+    }
+
+    // Arguments were validated when the Program was built
+    const std::vector<Instruction>& code = program_->code;
+    const std::vector<Value>& consts = program_->consts;
+
+    while (ip_ < code.size()) {
+        const Instruction& instr = code[ip_];
+        int64_t arg = instr.arg;
+
+        switch (instr.opcode) {
+            case Opcode::LOAD_CONST: {
+                push(consts[arg]);
+                ip_++;
+                break;
             }
-            ip_ = arg;
-        }
-        else if (opcode == "JUMP_IF_FALSE") {
-            Value value = pop();
-            if (value == 0) {
-                if (arg < 0 || static_cast<size_t>(arg) >= code_.size()) {
-                    throw std::runtime_error("Invalid jump target");
+            case Opcode::LOAD_NAME: {
+                if (!defined_[arg]) {
+                    throw std::runtime_error("Undefined variable: " + program_->names[arg]);
                 }
-                ip_ = arg;
-            } else {
+                push(globals_[arg]);
                 ip_++;
+                break;
             }
-        }
-        else if (opcode == "JUMP_IF_TRUE") {
-            Value value = pop();
-            if (value != 0) {
-                if (arg < 0 || static_cast<size_t>(arg) >= code_.size()) {
-                    throw std::runtime_error("Invalid jump target");
+            case Opcode::STORE_NAME: {
+                globals_[arg] = pop();
+                defined_[arg] = true;
+                ip_++;
+                break;
+            }
+            case Opcode::LOAD_FAST: {
+                push(stack_[base_ + arg]);
+                ip_++;
+                break;
+            }
+            case Opcode::STORE_FAST: {
+                Value value = pop();
+                stack_[base_ + arg] = value;
+                ip_++;
+                break;
+            }
+            // Small ints are stored as 2v+1, so the fast paths work on the
+            // tagged bits directly and overflow exactly when the 63-bit
+            // result would. The *_INT forms share the fast path; typed int
+            // operands may still be BigInts, but their slow path can skip
+            // the float dispatch.
+            case Opcode::ADD:
+            case Opcode::ADD_INT: {
+                Value b = pop();
+                Value a = pop();
+                int64_t sum;
+                if (Value::bothSmall(a, b) &&
+                    !__builtin_add_overflow(static_cast<int64_t>(a.bits()), static_cast<int64_t>(b.bits() - 1), &sum)) {
+                    push(Value::fromBits(static_cast<uint64_t>(sum)));
+                } else {
+                    push(instr.opcode == Opcode::ADD ? arithmetic(instr.opcode, a, b)
+                                                    : integerArithmetic(instr.opcode, a, b));
                 }
-                ip_ = arg;
-            } else {
                 ip_++;
+                break;
+            }
+            case Opcode::SUB:
+            case Opcode::SUB_INT: {
+                Value b = pop();
+                Value a = pop();
+                int64_t difference;
+                if (Value::bothSmall(a, b) &&
+                    !__builtin_sub_overflow(static_cast<int64_t>(a.bits()), static_cast<int64_t>(b.bits() - 1), &difference)) {
+                    push(Value::fromBits(static_cast<uint64_t>(difference)));
+                } else {
+                    push(instr.opcode == Opcode::SUB ? arithmetic(instr.opcode, a, b)
+                                                    : integerArithmetic(instr.opcode, a, b));
+                }
+                ip_++;
+                break;
+            }
+            case Opcode::MUL:
+            case Opcode::MUL_INT: {
+                Value b = pop();
+                Value a = pop();
+                int64_t product;
+                if (Value::bothSmall(a, b) &&
+                    !__builtin_mul_overflow(a.small(), static_cast<int64_t>(b.bits() - 1), &product)) {
+                    push(Value::fromBits(static_cast<uint64_t>(product) | 1));
+                } else {
+                    push(instr.opcode == Opcode::MUL ? arithmetic(instr.opcode, a, b)
+                                                    : integerArithmetic(instr.opcode, a, b));
+                }
+                ip_++;
+                break;
+            }
+            case Opcode::DIV:
+            case Opcode::DIV_INT: {
+                // Floor division, like the reference VM
+                Value b = pop();
+                Value a = pop();
+                if (Value::bothSmall(a, b)) {
+                    if (b == ZERO) {
+                        throw std::runtime_error("Division by zero");
+                    }
+                    int64_t x = a.small();
+                    int64_t y = b.small();
+                    int64_t quotient = x / y;
+                    if (x % y != 0 && (x < 0) != (y < 0)) {
+                        quotient--;
+                    }
+                    // Only SMALL_MIN / -1 leaves the small range
+                    push(Value::fitsSmall(quotient) ? Value::fromSmall(quotient) : makeInteger(BigNum(quotient)));
+                } else {
+                    push(instr.opcode == Opcode::DIV ? arithmetic(instr.opcode, a, b)
+                                                    : integerArithmetic(instr.opcode, a, b));
+                }
+                ip_++;
+                break;
+            }
+            case Opcode::CMP_LT_INT:
+            case Opcode::CMP_GT_INT:
+            case Opcode::CMP_LE_INT:
+            case Opcode::CMP_GE_INT:
+            case Opcode::CMP_EQ_INT:
+            case Opcode::CMP_NEQ_INT: {
+                Value b = pop();
+                Value a = pop();
+                push(Value::fromBool(compare_integers(instr.opcode, a, b)));
+                ip_++;
+                break;
+            }
+            case Opcode::CMP_LT:
+            case Opcode::CMP_GT:
+            case Opcode::CMP_LE:
+            case Opcode::CMP_GE:
+            case Opcode::CMP_EQ:
+            case Opcode::CMP_NEQ: {
+                Value b = pop();
+                Value a = pop();
+                push(Value::fromBool(compare(instr.opcode, a, b)));
+                ip_++;
+                break;
+            }
+            case Opcode::JUMP: {
+                if (jump(arg)) {
+                    return RunStatus::Suspended;
+                }
+                break;
+            }
+            case Opcode::JUMP_IF_FALSE: {
+                if (!is_truthy(pop())) {
+                    if (jump(arg)) {
+                        return RunStatus::Suspended;
+                    }
+                } else {
+                    ip_++;
+                }
+                break;
+            }
+            case Opcode::JUMP_IF_TRUE: {
+                if (is_truthy(pop())) {
+                    if (jump(arg)) {
+                        return RunStatus::Suspended;
+                    }
+                } else {
+                    ip_++;
+                }
+                break;
+            }
+            case Opcode::JUMP_IF_LT: {
+                Value b = pop();
+                Value a = pop();
+                if (compare(Opcode::JUMP_IF_LT, a, b)) {
+                    if (jump(arg)) {
+                        return RunStatus::Suspended;
+                    }
+                } else {
+                    ip_++;
+                }
+                break;
+            }
+            case Opcode::JUMP_IF_GT: {
+                Value b = pop();
+                Value a = pop();
+                if (compare(Opcode::JUMP_IF_GT, a, b)) {
+                    if (jump(arg)) {
+                        return RunStatus::Suspended;
+                    }
+                } else {
+                    ip_++;
+                }
+                break;
+            }
+            case Opcode::JUMP_IF_LE: {
+                Value b = pop();
+                Value a = pop();
+                if (compare(Opcode::JUMP_IF_LE, a, b)) {
+                    if (jump(arg)) {
+                        return RunStatus::Suspended;
+                    }
+                } else {
+                    ip_++;
+                }
+                break;
+            }
+            case Opcode::JUMP_IF_GE: {
+                Value b = pop();
+                Value a = pop();
+                if (compare(Opcode::JUMP_IF_GE, a, b)) {
+                    if (jump(arg)) {
+                        return RunStatus::Suspended;
+                    }
+                } else {
+                    ip_++;
+                }
+                break;
+            }
+            case Opcode::JUMP_IF_EQ: {
+                Value b = pop();
+                Value a = pop();
+                if (compare(Opcode::JUMP_IF_EQ, a, b)) {
+                    if (jump(arg)) {
+                        return RunStatus::Suspended;
+                    }
+                } else {
+                    ip_++;
+                }
+                break;
+            }
+            case Opcode::JUMP_IF_NEQ: {
+                Value b = pop();
+                Value a = pop();
+                if (compare(Opcode::JUMP_IF_NEQ, a, b)) {
+                    if (jump(arg)) {
+                        return RunStatus::Suspended;
+                    }
+                } else {
+                    ip_++;
+                }
+                break;
+            }
+            case Opcode::FOR_RANGE: {
+                if (stack_.size() - floor_ < 3) {
+                    throw std::runtime_error("Stack underflow");
+                }
+                Value* state = &stack_[stack_.size() - 3];
+                Value counter = state[0];
+                Value stop = state[1];
+                Value step = state[2];
+                bool more;
+                int64_t next;
+                // Tagged small ints order like their raw bits, and adding
+                // (step.bits - 1) to the tagged counter steps it, as in ADD
+                if (Value::bothSmall(counter, stop) && step.isSmall() && step != ZERO &&
+                    !__builtin_add_overflow(static_cast<int64_t>(counter.bits()), static_cast<int64_t>(step.bits() - 1), &next)) {
+                    more = step.small() > 0 ? static_cast<int64_t>(counter.bits()) < static_cast<int64_t>(stop.bits())
+                                            : static_cast<int64_t>(counter.bits()) > static_cast<int64_t>(stop.bits());
+                    if (more) {
+                        state[0] = Value::fromBits(static_cast<uint64_t>(next));
+                        push(counter);
+                    }
+                } else {
+                    more = forRangeSlow();
+                }
+                if (more) {
+                    ip_++;
+                } else {
+                    stack_.resize(stack_.size() - 3);
+                    ip_ = static_cast<size_t>(arg);
+                }
+                break;
+            }
+            case Opcode::CALL: {
+                // The arguments already on the stack become the first locals;
+                // the rest are reserved in place, so a call only moves the
+                // stack top and reuses a frame slot
+                const Function& function = program_->functions[arg];
+                if (stack_.size() - floor_ < function.nparams) {
+                    throw std::runtime_error("Stack underflow");
+                }
+                if (frames_.size() >= MAX_CALL_DEPTH) {
+                    throw std::runtime_error("Maximum recursion depth exceeded");
+                }
+                size_t base = stack_.size() - function.nparams;
+                if (base + function.nlocals > MAX_STACK_SIZE) {
+                    throw std::runtime_error("Stack overflow");
+                }
+                stack_.resize(base + function.nlocals, ZERO);
+                frames_.push_back(Frame{ip_ + 1, base, static_cast<uint32_t>(arg)});
+                base_ = base;
+                floor_ = base + function.nlocals;
+                ip_ = function.entry;
+                if (preemptible_ && charge(1)) {
+                    return RunStatus::Suspended;
+                }
+                break;
+            }
+            case Opcode::TAIL_CALL: {
+                // Move the arguments down over the current frame's locals and
+                // jump: the caller's return address and stack depth carry over,
+                // so tail recursion runs in constant space
+                const Function& function = program_->functions[arg];
+                if (stack_.size() - floor_ < function.nparams) {
+                    throw std::runtime_error("Stack underflow");
+                }
+                if (base_ + function.nlocals > MAX_STACK_SIZE) {
+                    throw std::runtime_error("Stack overflow");
+                }
+                std::copy(stack_.end() - function.nparams, stack_.end(),
+                          stack_.begin() + static_cast<std::ptrdiff_t>(base_));
+                stack_.resize(base_ + function.nparams);
+                stack_.resize(base_ + function.nlocals, ZERO);
+                frames_.back().function = static_cast<uint32_t>(arg);
+                floor_ = base_ + function.nlocals;
+                ip_ = function.entry;
+                if (preemptible_ && charge(1)) {
+                    return RunStatus::Suspended;
+                }
+                break;
+            }
+            case Opcode::RETURN: {
+                if (frames_.empty()) {
+                    throw std::runtime_error("Return outside function");
+                }
+                Value result = pop();
+                stack_.resize(base_);
+                stack_.push_back(result);
+                ip_ = frames_.back().return_ip;
+                frames_.pop_back();
+                enterFrame();
+                break;
+            }
+            case Opcode::POP: {
+                pop();
+                ip_++;
+                break;
+            }
+            case Opcode::DUP: {
+                push(peek());
+                ip_++;
+                break;
+            }
+            case Opcode::SWAP: {
+                if (stack_.size() < floor_ + 2) {
+                    throw std::runtime_error("Stack underflow");
+                }
+                std::swap(stack_[stack_.size() - 1], stack_[stack_.size() - 2]);
+                ip_++;
+                break;
+            }
+            case Opcode::ROT: {
+                if (stack_.size() < floor_ + 3) {
+                    throw std::runtime_error("Stack underflow");
+                }
+                auto third = stack_.end() - 3;
+                std::rotate(third, third + 1, stack_.end());
+                ip_++;
+                break;
+            }
+            case Opcode::NEW_ARRAY: {
+                Value length = pop();
+                if (!length.isSmall() || length.small() < 0 || length.small() > MAX_ARRAY_LENGTH) {
+                    throw std::runtime_error("Array size out of range");
+                }
+                chargeWork(static_cast<size_t>(length.small()));
+                push(makeArray(static_cast<uint32_t>(length.small())));
+                ip_++;
+                break;
+            }
+            case Opcode::ARRAY_LEN: {
+                Value value = pop();
+                push(Value::fromSmall(value.isString() ? string_length(value) : array_operand(value)->length));
+                ip_++;
+                break;
+            }
+            // Bytecode comes from outside the process, so the optimizer's bounds proofs are not
+            // trusted: the UNCHECKED forms are checked like the others
+            case Opcode::LOAD_INDEX:
+            case Opcode::LOAD_INDEX_UNCHECKED: {
+                Value index = pop();
+                Value array = pop();
+                push(loadElement(checked_element(array, index)));
+                ip_++;
+                break;
+            }
+            case Opcode::STORE_INDEX:
+            case Opcode::STORE_INDEX_UNCHECKED: {
+                Value index = pop();
+                Value array = pop();
+                int64_t& element = checked_element(array, index);
+                element = to_element(pop());
+                ip_++;
+                break;
+            }
+            case Opcode::ARRAY_SUM: {
+                ArrayObject* array = array_operand(pop());
+                chargeWork(array->length);
+                push(arraySum(array_kernels().sum(array->elements(), array->length)));
+                ip_++;
+                break;
+            }
+            case Opcode::ARRAY_MIN:
+            case Opcode::ARRAY_MAX: {
+                ArrayObject* array = array_operand(pop());
+                bool is_min = instr.opcode == Opcode::ARRAY_MIN;
+                if (array->length == 0) {
+                    throw std::runtime_error(is_min ? "array_min() of empty array" : "array_max() of empty array");
+                }
+                chargeWork(array->length);
+                const ArrayKernels& kernels = array_kernels();
+                push(loadElement((is_min ? kernels.min : kernels.max)(array->elements(), array->length)));
+                ip_++;
+                break;
+            }
+            case Opcode::ARRAY_FILL: {
+                int64_t value = to_element(pop());
+                Value array = pop();
+                chargeWork(array_operand(array)->length);
+                array_kernels().fill(array.array()->elements(), array.array()->length, value);
+                push(array);
+                ip_++;
+                break;
+            }
+            case Opcode::ARRAY_ADD: {
+                Value out = pop();
+                ArrayObject* b = array_operand(pop());
+                ArrayObject* a = array_operand(pop());
+                ArrayObject* result = array_operand(out);
+                if (a->length != b->length || a->length != result->length) {
+                    throw std::runtime_error("Array lengths differ");
+                }
+                chargeWork(a->length);
+                if (array_kernels().add(a->elements(), b->elements(), result->elements(), a->length) != a->length) {
+                    throw std::runtime_error("Array value out of range");
+                }
+                push(out);
+                ip_++;
+                break;
+            }
+            case Opcode::ARRAY_COUNT_LT: {
+                Value limit = pop();
+                ArrayObject* array = array_operand(pop());
+                chargeWork(array->length);
+                int64_t bound;
+                size_t count;
+                if (element_value(limit, bound)) {
+                    count = array_kernels().count_lt(array->elements(), array->length, bound);
+                } else {
+                    // Beyond every element one way or the other
+                    count = limit.bigint()->negative() ? 0 : array->length;
+                }
+                push(Value::fromSmall(static_cast<int64_t>(count)));
+                ip_++;
+                break;
+            }
+            case Opcode::PRINT: {
+                Value value = pop();
+                if (value.isSmall()) {
+                    *out_ << value.small() << '\n';
+                } else {
+                    *out_ << value_to_string(value) << '\n';
+                }
+                ip_++;
+                break;
+            }
+            case Opcode::CHECKPOINT: {
+                ip_++;
+                if (stop_at_checkpoint_) {
+                    return RunStatus::Checkpoint;
+                }
+                break;
+            }
+            case Opcode::HALT: {
+                return RunStatus::Halted;
             }
-        }
-        else if (opcode == "POP") {
-            pop();
-            ip_++;
-        }
-        else if (opcode == "PRINT") {
-            Value value = pop();
-            std::cout << value << std::endl;
-            ip_++;
-        }
-        else if (opcode == "HALT") {
-            break;
-        }
-        else {
-            throw std::runtime_error("Unknown opcode: " + opcode);
         }
     }
+
+    return RunStatus::Halted;
 }
 
 } // namespace minipy
-
@@ -1,50 +1,272 @@
 #ifndef MINIPY_VM_H
 #define MINIPY_VM_H
 
+#include "value.h"
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <iostream>
+#include <chrono>
+#include <memory>
 #include <cstdint>
 
 namespace minipy {
 
-// Value type - using int for simplicity (can be extended with std::variant)
-using Value = int64_t;
+class BigNum;
+struct SplitSum;
+
+// Opcodes, decoded from their names once at load time
+enum class Opcode : uint8_t {
+    LOAD_CONST,
+    LOAD_NAME,
+    STORE_NAME,
+    // Frame-local slots, by index
+    LOAD_FAST,
+    STORE_FAST,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    // Integer-only forms (operands typed int by the compiler)
+    ADD_INT,
+    SUB_INT,
+    MUL_INT,
+    DIV_INT,
+    CMP_LT_INT,
+    CMP_GT_INT,
+    CMP_LE_INT,
+    CMP_GE_INT,
+    CMP_EQ_INT,
+    CMP_NEQ_INT,
+    CMP_LT,
+    CMP_GT,
+    CMP_LE,
+    CMP_GE,
+    CMP_EQ,
+    CMP_NEQ,
+    JUMP,
+    JUMP_IF_FALSE,
+    JUMP_IF_TRUE,
+    // Fused compare-and-branch: pop b, pop a, jump if (a op b)
+    JUMP_IF_LT,
+    JUMP_IF_GT,
+    JUMP_IF_LE,
+    JUMP_IF_GE,
+    JUMP_IF_EQ,
+    JUMP_IF_NEQ,
+    // Counting loop over [counter, stop, step]: push the counter and advance
+    // it, or pop all three and jump once the range is exhausted
+    FOR_RANGE,
+    CALL,
+    // Call in tail position: replaces the current frame instead of pushing one
+    TAIL_CALL,
+    RETURN,
+    POP,
+    // Stack shuffles: DUP copies the top value, SWAP exchanges the top two,
+    // ROT moves the third value up to the top (a b c -> b c a)
+    DUP,
+    SWAP,
+    ROT,
+    // Fixed-size int arrays: NEW_ARRAY pops a length, LOAD_INDEX pops index
+    // and array, STORE_INDEX pops index, array and value. The UNCHECKED forms
+    // mark an index the optimizer proved in bounds; this VM still checks them,
+    // since a .mpbc file can claim anything. ARRAY_LEN also takes a string.
+    NEW_ARRAY,
+    ARRAY_LEN,
+    LOAD_INDEX,
+    LOAD_INDEX_UNCHECKED,
+    STORE_INDEX,
+    STORE_INDEX_UNCHECKED,
+    // Whole-array builtins, run by the kernels in array_kernels.h; arguments
+    // are pushed in order and fill/add push the array they wrote
+    ARRAY_SUM,
+    ARRAY_MIN,
+    ARRAY_MAX,
+    ARRAY_FILL,
+    ARRAY_ADD,
+    ARRAY_COUNT_LT,
+    PRINT,
+    CHECKPOINT,
+    HALT,
+};
+
+const char* opcode_name(Opcode opcode);
+// Returns false for names that are not opcodes
+bool parse_opcode(const std::string& name, Opcode& opcode);
 
 // Instruction structure
 struct Instruction {
-    std::string opcode;
+    Opcode opcode;
     int64_t arg;
-    
-    Instruction(const std::string& op, int64_t a = 0) : opcode(op), arg(a) {}
+
+    Instruction(Opcode op, int64_t a = 0) : opcode(op), arg(a) {}
+};
+
+// A function constant: CALL pops nparams arguments into the first of nlocals
+// preallocated local slots and continues at entry
+struct Function {
+    std::string name;
+    size_t entry;
+    uint32_t nparams;
+    uint32_t nlocals;
+};
+
+// Immutable, validated bytecode shared by every VM that runs it.
+// Constructing one checks all jump targets and table indices, so the
+// interpreter loop does not have to, then threads jump chains and drops
+// unreachable code (a no-op for bytecode from the current compiler).
+struct Program {
+    std::vector<Instruction> code;
+    std::vector<Value> consts;
+    std::vector<std::string> names;
+    // Function constants; CALL arguments are rewritten from const indices to
+    // indices into this table
+    std::vector<Function> functions;
+    // Name -> global slot (slots are indices into names)
+    std::unordered_map<std::string, size_t> name_slots;
+    // Constants that do not fit in a Value (pinned; VMs never move or free them)
+    Arena heap;
+
+    // Constants are given as decimal text and may be arbitrarily large, or as
+    // double-quoted strings, which are interned (see STRING_INTERNED);
+    // "func <name> <entry> <nparams> <nlocals>" declares a function
+    Program(std::vector<Instruction> code, const std::vector<std::string>& consts, std::vector<std::string> names);
+};
+
+// Why run()/resume() returned
+enum class RunStatus {
+    Halted,      // HALT or end of code
+    Checkpoint,  // stopped after a CHECKPOINT (see setStopAtCheckpoint)
+    Suspended    // budget exhausted at a backward jump or call; resume() continues
+};
+
+// Hard limits for a whole run (as opposed to a scheduling slice); zero means unlimited
+struct RunLimits {
+    uint64_t instructions = 0;
+    std::chrono::nanoseconds time{0};
+};
+
+// Activation record of a call. The callee's locals are the stack slots
+// [base, base + nlocals), directly below its operands.
+struct Frame {
+    size_t return_ip;
+    size_t base;
+    uint32_t function;  // index into Program::functions
 };
 
-// Virtual Machine
+// Resumable execution state: everything a snapshot needs besides the program.
+// Self-contained: heap values referenced from stack and globals live in its heap.
+struct VMState {
+    size_t ip = 0;
+    std::vector<Value> stack;
+    std::vector<Frame> frames;
+    std::unordered_map<std::string, Value> globals;
+    Arena heap;
+};
+
+// Virtual Machine: one execution context (operand stack, globals, ip) over a
+// shared Program. Contexts are small so that many can be kept resident.
 class VM {
 public:
-    VM(const std::vector<Instruction>& code,
-       const std::vector<Value>& consts,
-       const std::vector<std::string>& names);
-    
-    void run();
-    const std::unordered_map<std::string, Value>& getGlobals() const { return globals_; }
-    
+    explicit VM(std::shared_ptr<const Program> program);
+
+    VM(VM&&) = default;
+    VM& operator=(VM&&) = default;
+
+    // Execute from the first instruction
+    RunStatus run();
+    // Continue from the current instruction pointer (after a checkpoint, suspension or restoreState)
+    RunStatus resume();
+
+    // When set, CHECKPOINT returns control to the caller instead of being a no-op
+    void setStopAtCheckpoint(bool stop) { stop_at_checkpoint_ = stop; }
+
+    // Per-slice execution budget, reset on every run()/resume(); zero means unlimited.
+    // Checked only on backward jumps, where each loop iteration is charged the
+    // size of the loop body, and on calls, which are charged one instruction,
+    // so straight-line code never pays for it. Array builtins and NEW_ARRAY add
+    // one instruction per ELEMENTS_PER_INSTRUCTION elements they touch, and
+    // BigInt multiplication and division one per as many limb products.
+    void setBudget(uint64_t instructions, std::chrono::nanoseconds time = std::chrono::nanoseconds(0));
+
+    VMState saveState() const;
+    void restoreState(const VMState& state);
+
+    // Heap values in the result point into this VM's heap and stay valid until it runs again
+    std::unordered_map<std::string, Value> getGlobals() const;
+
+    // Bind a global before run() (used by the server for per-request inputs).
+    // Names the program never mentions are ignored.
+    void setGlobal(const std::string& name, Value value);
+    // Integer value, allocated in this VM's heap if it does not fit a small int
+    Value makeInteger(const BigNum& number);
+
+    // Redirect PRINT output (defaults to std::cout)
+    void setOutput(std::ostream& out) { out_ = &out; }
+
+    const Program& program() const { return *program_; }
+
 private:
     void push(Value value);
     Value pop();
     Value peek() const;
-    
-    std::vector<Instruction> code_;
-    std::vector<Value> consts_;
-    std::vector<std::string> names_;
+    RunStatus execute();
+    void startSlice();
+    bool charge(uint64_t instructions);
+    bool jump(int64_t target);
+    void enterFrame();
+    Value arithmetic(Opcode opcode, Value a, Value b);
+    // ADD of two strings: a flat copy when short, else a rope
+    Value concatenate(Value a, Value b);
+    Value integerArithmetic(Opcode opcode, Value a, Value b);
+    bool forRangeSlow();
+    Value makeFloat(double number);
+    Value makeArray(uint32_t length);
+    // An element as a Value (allocating when it does not fit a small int)
+    Value loadElement(int64_t element);
+    // Value of an ARRAY_SUM kernel's result, promoted to a BigInt past 64 bits
+    Value arraySum(SplitSum sum);
+    void collectGarbage();
+    void chargeWork(size_t units) { charged_ += units / ELEMENTS_PER_INSTRUCTION; }
+
+    std::shared_ptr<const Program> program_;
     std::vector<Value> stack_;
-    std::unordered_map<std::string, Value> globals_;
+    // Call stack; popped frames keep their storage, so calls do not allocate
+    // once the deepest recursion has been reached
+    std::vector<Frame> frames_;
+    size_t base_;                      // first local slot of the current frame
+    size_t floor_;                     // stack slots below this are not operands
+    std::vector<Value> globals_;       // indexed by name slot
+    std::vector<bool> defined_;        // which slots have been assigned
+    // BigInts, floats, arrays and strings produced at run time; compacted by copying out the
+    // live ones (flattening ropes) whenever it has grown past gc_threshold_
+    Arena heap_;
+    size_t gc_threshold_;
     size_t ip_;
-    
+    std::ostream* out_;
+    bool stop_at_checkpoint_;
+
+    // Preemption (only consulted when preemptible_ is set)
+    bool preemptible_;
+    uint64_t instruction_budget_;
+    std::chrono::nanoseconds time_budget_;
+    uint64_t charged_;
+    uint64_t clock_checked_at_;
+    std::chrono::steady_clock::time_point deadline_;
+
     static constexpr size_t MAX_STACK_SIZE = 10000;
+    static constexpr size_t MAX_CALL_DEPTH = 1000;
+    static constexpr size_t MIN_GC_THRESHOLD = 1 << 20;
+    // Shorter concatenations are copied; a rope node would not be much smaller
+    static constexpr size_t MIN_ROPE_LENGTH = 64;
+    // Instructions charged between clock reads when a time budget is set
+    static constexpr uint64_t CLOCK_CHECK_INTERVAL = 1024;
+    // Array elements a whole-array builtin or NEW_ARRAY's zeroing handles (or
+    // limb products a BigInt multiply or divide computes) per instruction
+    // charged; the next backward jump or call sees the total
+    static constexpr uint64_t ELEMENTS_PER_INSTRUCTION = 64;
 };
 
 } // namespace minipy
 
 #endif // MINIPY_VM_H
-
@@ -44,3 +44,9 @@ class VMError(MiniPyError):
             super().__init__(f"VMError: {message}")
         self.ip = ip
 
+
+
+class ServerError(MiniPyError):
+    """Error reported by a minipy_vm server."""
+    def __init__(self, message):
+        super().__init__(f"ServerError: {message}")
@@ -0,0 +1,1355 @@
+"""SSA intermediate representation between the AST and bytecode.
+
+The top-level code and each function become an IRFunction: a control-flow
+graph of Blocks. A Block holds Instrs (phis first) and ends in a terminator
+Instr whose targets are its successors. Every Instr is an SSA value: its args
+are the Instrs that define its operands, and each Instr keeps its users, so
+def-use chains are always at hand.
+
+build_ir constructs SSA form directly from the analyzed AST (Braun et al.,
+"Simple and Efficient Construction of Static Single Assignment Form").
+optimize_ir runs sparse conditional constant propagation, dominator-based
+global value numbering, loop-invariant code motion and dead code elimination.
+lower_ir turns the result back into stack bytecode: single-use values become
+expression trees on the operand stack, the rest are kept in slots (locals, or
+globals at top level) chosen by interference-aware coalescing, and phis become
+parallel copies pushed and then stored through the stack.
+"""
+
+import operator
+from typing import Dict, List, Optional, Set, Tuple
+from ast_nodes import (
+    Program, Assign, Print, If, While, For, Checkpoint, FunctionDef, Return, ExprStmt,
+    BinOp, Number, String, Var, Call, Index, IndexAssign, Statement, Expression, assigned_names
+)
+from bytecode import (
+    Function, LOAD_CONST, LOAD_NAME, STORE_NAME, LOAD_FAST, STORE_FAST,
+    ADD, SUB, MUL, DIV, CALL, TAIL_CALL, RETURN,
+    CMP_LT, CMP_GT, CMP_LE, CMP_GE, CMP_EQ, CMP_NEQ,
+    JUMP, JUMP_IF_FALSE, FOR_RANGE, POP, SWAP, ROT, PRINT, CHECKPOINT, HALT,
+    LOAD_INDEX, LOAD_INDEX_UNCHECKED, STORE_INDEX, STORE_INDEX_UNCHECKED
+)
+from semantic import INT, BOOL, STR, ARRAY, TYPE_NAMES, BUILTINS
+from optimizer import HOISTABLE_OPS, TEMP_PREFIX, COMMUTED, MAX_FOLDED_STRING
+from compiler import Compiler, INVERTED_BRANCH, INT_OPCODES, BUILTIN_OPCODES, ZERO_VALUES, peephole
+
+
+# Opcode for each operator when the operands are not both typed int
+GENERIC_OPCODES = {
+    "+": ADD,
+    "-": SUB,
+    "*": MUL,
+    "/": DIV,
+    "<": CMP_LT,
+    ">": CMP_GT,
+    "<=": CMP_LE,
+    ">=": CMP_GE,
+    "==": CMP_EQ,
+    "!=": CMP_NEQ,
+}
+
+# Constant folding, with the VMs' semantics (/ is floor division)
+FOLDERS = {
+    "+": operator.add,
+    "-": operator.sub,
+    "*": operator.mul,
+    "/": operator.floordiv,
+    "<": operator.lt,
+    ">": operator.gt,
+    "<=": operator.le,
+    ">=": operator.ge,
+    "==": operator.eq,
+    "!=": operator.ne,
+}
+
+# Operators whose operands may be swapped (except + on strings, which concatenates)
+COMMUTATIVE = {"+", "*", "==", "!="}
+
+# Opcode for each array op, and for index and store_index once their bounds
+# check is known to be unneeded (their value is then "unchecked")
+ARRAY_OPCODES = dict(BUILTIN_OPCODES, index=LOAD_INDEX, store_index=STORE_INDEX)
+UNCHECKED_OPCODES = {"index": LOAD_INDEX_UNCHECKED, "store_index": STORE_INDEX_UNCHECKED}
+
+# Ops executed for their effect: never removed, reordered or hoisted. A call
+# may print or fail; for_init pushes the range and for_var pops the counter.
+# array makes a new array (or fails), index may be out of bounds and sees
+# earlier stores, and store_index writes an element; the whole-array builtins
+# other than len read or write elements.
+EFFECT_OPS = {"call", "print", "store", "checkpoint", "for_init", "for_var", "array", "index", "store_index",
+              "array_sum", "array_min", "array_max", "array_fill", "array_add", "array_count_lt"}
+
+# Ops that end a block
+TERMINATOR_OPS = {"jump", "branch", "return", "halt", "for_iter"}
+
+# Prefix of slots the lowering invents (at top level they are globals)
+SLOT_PREFIX = TEMP_PREFIX + "r"
+
+
+class Instr:
+    """One SSA value or effect: op applied to args, the Instrs defining its operands.
+    
+    value holds the op's immediate: the constant, operator, variable or
+    function name, or parameter index. var names the source variable the
+    value was first assigned to, which the lowering prefers as its slot.
+    """
+    
+    def __init__(self, op: str, args=(), type=None, value=None):
+        self.op = op
+        self.type = type
+        self.value = value
+        self.args = []
+        self.users = []  # Instrs with this one among their args (once per occurrence)
+        self.block = None
+        self.targets = []  # Successor blocks, for a terminator
+        self.var = None
+        for arg in args:
+            self.add_arg(arg)
+    
+    def add_arg(self, arg: 'Instr') -> None:
+        """Append an operand."""
+        self.args.append(arg)
+        arg.users.append(self)
+    
+    def set_arg(self, index: int, arg: 'Instr') -> None:
+        """Replace operand index."""
+        self.args[index].users.remove(self)
+        self.args[index] = arg
+        arg.users.append(self)
+    
+    def remove_arg(self, index: int) -> None:
+        """Drop operand index (a phi losing a predecessor)."""
+        self.args.pop(index).users.remove(self)
+    
+    def replace_uses(self, other: 'Instr') -> None:
+        """Make every user read other instead."""
+        for user in list(self.users):
+            for index, arg in enumerate(user.args):
+                if arg is self:
+                    user.set_arg(index, other)
+    
+    def remove(self) -> None:
+        """Unlink from the block and from the operands' user lists."""
+        for arg in self.args:
+            arg.users.remove(self)
+        self.args = []
+        if self.block is not None and self in self.block.instrs:
+            self.block.instrs.remove(self)
+        self.block = None
+    
+    def __repr__(self):
+        return f"Instr({self.op}, {self.value})"
+
+
+class Block:
+    """A basic block: phis, then straight-line Instrs, then the terminator."""
+    
+    def __init__(self, label: int):
+        self.label = label
+        self.instrs = []
+        self.preds = []  # In phi operand order
+        self.terminator = None
+    
+    @property
+    def succs(self) -> List['Block']:
+        """Successor blocks."""
+        return self.terminator.targets if self.terminator else []
+    
+    def phis(self) -> List[Instr]:
+        """The phis at the start of the block."""
+        return [instr for instr in self.instrs if instr.op == "phi"]
+    
+    def append(self, instr: Instr) -> Instr:
+        """Add instr at the end of the block (before the terminator)."""
+        instr.block = self
+        self.instrs.append(instr)
+        return instr
+    
+    def insert(self, index: int, instr: Instr) -> Instr:
+        """Add instr at position index."""
+        instr.block = self
+        self.instrs.insert(index, instr)
+        return instr
+    
+    def __repr__(self):
+        return f"b{self.label}"
+
+
+class IRFunction:
+    """The CFG of a function body, or of the top-level code when name is None."""
+    
+    def __init__(self, name: Optional[str] = None, params=(), return_type: str = "int"):
+        self.name = name
+        self.params = list(params)
+        self.return_type = return_type
+        self.blocks = []
+        self.constants = {}  # (type, value) -> const Instr in the entry block
+        self.next_label = 0
+        self.entry = self.new_block()
+    
+    @property
+    def is_main(self) -> bool:
+        """Whether this is the top-level code, whose variables are globals."""
+        return self.name is None
+    
+    def new_block(self) -> Block:
+        """Create an empty block."""
+        block = Block(self.next_label)
+        self.next_label += 1
+        self.blocks.append(block)
+        return block
+    
+    def constant(self, value, value_type=None) -> Instr:
+        """The const Instr for value, created in the entry block on first use."""
+        key = (type(value), value)  # True and 1 stay distinct
+        if key not in self.constants:
+            value_type = value_type or (BOOL if isinstance(value, bool) else STR if isinstance(value, str) else INT)
+            instr = Instr("const", type=value_type, value=value)
+            self.constants[key] = self.entry.insert(0, instr)
+        return self.constants[key]
+    
+    def format(self) -> str:
+        """Readable listing, one Instr per line."""
+        numbers = {}
+        
+        def name(instr):
+            if instr.op == "const":
+                return repr(instr.value)
+            if instr not in numbers:
+                numbers[instr] = len(numbers)
+            return f"v{numbers[instr]}"
+        
+        lines = [f"function {self.name or '<main>'}({', '.join(self.params)}):"]
+        for block in reverse_postorder(self):
+            preds = ", ".join(repr(pred) for pred in block.preds)
+            lines.append(f"  {block!r}:" + (f"  ; preds {preds}" if preds else ""))
+            for instr in block.instrs + [block.terminator]:
+                if instr.op == "const":
+                    continue
+                operands = [name(arg) for arg in instr.args]
+                if instr.op == "phi":
+                    operands = [f"{arg} {pred!r}" for arg, pred in zip(operands, block.preds)]
+                text = instr.op
+                if instr.value is not None:
+                    text += f" {instr.value}"
+                if operands:
+                    text += " " + ", ".join(operands)
+                if instr.targets:
+                    text += " -> " + ", ".join(repr(target) for target in instr.targets)
+                if instr.op in TERMINATOR_OPS or instr.op in ("print", "store", "store_index", "checkpoint", "for_init"):
+                    lines.append(f"    {text}")
+                else:
+                    lines.append(f"    {name(instr)} = {text}")
+        return "\n".join(lines)
+
+
+def terminate(block: Block, instr: Instr, targets: List[Block]) -> None:
+    """End block with instr, adding block to each target's predecessors."""
+    instr.block = block
+    instr.targets = list(targets)
+    block.terminator = instr
+    for target in targets:
+        target.preds.append(block)
+
+
+def remove_edge(pred: Block, succ: Block) -> None:
+    """Forget the edge pred -> succ, dropping its phi operands."""
+    index = succ.preds.index(pred)
+    succ.preds.pop(index)
+    for phi in succ.phis():
+        phi.remove_arg(index)
+
+
+def may_trap(instr: Instr) -> bool:
+    """Whether instr may fail: division by anything but a nonzero constant, or
+    a concatenation (the result may be too long)."""
+    if instr.op == "binop" and instr.type == STR:
+        return True
+    if instr.op != "binop" or instr.value != "/":
+        return False
+    divisor = instr.args[1]
+    return not (divisor.op == "const" and divisor.value != 0)
+
+
+def has_effects(instr: Instr) -> bool:
+    """Whether instr must run even if its value is unused, and in order."""
+    return instr.op in EFFECT_OPS or instr.op in TERMINATOR_OPS or may_trap(instr)
+
+
+def reverse_postorder(function: IRFunction) -> List[Block]:
+    """Blocks reachable from the entry, each before its successors except along back edges.
+    
+    A block's first target is placed right after it when possible, so branches
+    fall through into their taken-if-true side.
+    """
+    order = []
+    visited = {function.entry}
+    stack = [(function.entry, iter(reversed(function.entry.succs)))]
+    while stack:
+        block, succs = stack[-1]
+        for succ in succs:
+            if succ not in visited:
+                visited.add(succ)
+                stack.append((succ, iter(reversed(succ.succs))))
+                break
+        else:
+            stack.pop()
+            order.append(block)
+    order.reverse()
+    return order
+
+
+def dominators(function: IRFunction) -> Dict[Block, Block]:
+    """Immediate dominator of each reachable block (Cooper, Harvey and Kennedy).
+    
+    The entry is its own immediate dominator.
+    """
+    order = reverse_postorder(function)
+    index = {block: n for n, block in enumerate(order)}
+    idom = {function.entry: function.entry}
+    changed = True
+    while changed:
+        changed = False
+        for block in order[1:]:
+            new_idom = None
+            for pred in block.preds:
+                if pred not in idom:
+                    continue
+                if new_idom is None:
+                    new_idom = pred
+                    continue
+                a, b = pred, new_idom
+                while a is not b:
+                    while index[a] > index[b]:
+                        a = idom[a]
+                    while index[b] > index[a]:
+                        b = idom[b]
+                new_idom = a
+            if idom.get(block) is not new_idom:
+                idom[block] = new_idom
+                changed = True
+    return idom
+
+
+def dominates(idom: Dict[Block, Block], a: Block, b: Block) -> bool:
+    """Whether block a dominates block b."""
+    while b is not a:
+        if idom[b] is b:
+            return False
+        b = idom[b]
+    return True
+
+
+class IRBuilder:
+    """Builds SSA form from an analyzed AST, one IRFunction per body.
+    
+    Variables are renamed on the fly: each block records the value every
+    variable has at its end, and a read in a block with several predecessors
+    becomes a phi. Loop headers stay unsealed (their phis incomplete) until
+    the back edge is known.
+    """
+    
+    def __init__(self):
+        self.function = None
+        self.block = None  # None after a return: following code is unreachable
+        self.locals = None  # Variable names of a function body; None at top level
+        self.current_def = {}  # name -> {block: value}
+        self.var_types = {}
+        self.sealed = set()
+        self.incomplete = {}  # block -> {name: phi}
+        self.entry_globals = {}  # Top level: name -> value the global has on entry
+    
+    def build_program(self, program: Program) -> List[IRFunction]:
+        """The top-level code's IRFunction, then one per function."""
+        statements = [stmt for stmt in program.statements if not isinstance(stmt, FunctionDef)]
+        functions = [self.build_body(IRFunction(), statements, None)]
+        for stmt in program.statements:
+            if isinstance(stmt, FunctionDef):
+                functions.append(self.build_function(stmt))
+        return functions
+    
+    def build_function(self, node: FunctionDef) -> IRFunction:
+        """SSA form of a function body; parameters are the first values."""
+        function = IRFunction(node.name, node.params, node.return_type)
+        self.start(function, set(node.params) | set(assigned_names(node.body)))
+        for index, (name, type_name) in enumerate(zip(node.params, node.param_types)):
+            param = function.entry.append(Instr("param", type=TYPE_NAMES[type_name], value=index))
+            param.var = name
+            self.write_variable(name, function.entry, param)
+        return self.finish(node.body)
+    
+    def build_body(self, function: IRFunction, statements: List[Statement],
+                   local_names: Optional[Set[str]]) -> IRFunction:
+        """SSA form of a statement list as the whole of function."""
+        self.start(function, local_names)
+        return self.finish(statements)
+    
+    def start(self, function: IRFunction, local_names: Optional[Set[str]]) -> None:
+        """Reset the per-function state."""
+        self.function = function
+        self.block = function.entry
+        self.locals = local_names
+        self.current_def = {}
+        self.var_types = {}
+        self.sealed = {function.entry}
+        self.incomplete = {}
+        self.entry_globals = {}
+    
+    def finish(self, statements: List[Statement]) -> IRFunction:
+        """Build statements, then end the body (HALT, or return the zero value)."""
+        self.build_statements(statements)
+        if self.block is not None:
+            if self.function.is_main:
+                terminate(self.block, Instr("halt"), [])
+            else:
+                zero = self.function.constant(ZERO_VALUES.get(self.function.return_type, 0))
+                if self.function.return_type == "array":
+                    zero = self.emit(Instr("array", [zero], ARRAY))
+                terminate(self.block, Instr("return", [zero]), [])
+        return self.function
+    
+    def build_statements(self, statements: List[Statement]) -> None:
+        """Build each statement until control cannot reach the next one."""
+        for stmt in statements:
+            if self.block is None:
+                return
+            self.build_statement(stmt)
+    
+    def build_statement(self, stmt: Statement) -> None:
+        """Build one statement."""
+        if isinstance(stmt, Assign):
+            self.assign(stmt.name, self.build_expr(stmt.expr))
+        elif isinstance(stmt, IndexAssign):
+            # The value first, as in Python
+            args = [self.build_expr(stmt.expr), self.build_expr(stmt.array), self.build_expr(stmt.index)]
+            self.emit(Instr("store_index", args, value=None if stmt.checked else "unchecked"))
+        elif isinstance(stmt, Print):
+            self.emit(Instr("print", [self.build_expr(stmt.expr)]))
+        elif isinstance(stmt, ExprStmt):
+            self.build_expr(stmt.expr)
+        elif isinstance(stmt, Checkpoint):
+            self.emit(Instr("checkpoint"))
+        elif isinstance(stmt, Return):
+            terminate(self.block, Instr("return", [self.build_expr(stmt.expr)]), [])
+            self.block = None
+        elif isinstance(stmt, If):
+            self.build_if(stmt)
+        elif isinstance(stmt, While):
+            self.build_while(stmt)
+        elif isinstance(stmt, For):
+            self.build_for(stmt)
+        elif not isinstance(stmt, FunctionDef):
+            raise ValueError(f"Unknown statement type: {type(stmt)}")
+    
+    def build_if(self, node: If) -> None:
+        """Branch to then and else blocks that meet at a join block."""
+        cond = self.build_expr(node.cond)
+        then_block = self.function.new_block()
+        else_block = self.function.new_block()
+        terminate(self.block, Instr("branch", [cond]), [then_block, else_block])
+        self.sealed |= {then_block, else_block}
+        ends = []
+        for block, body in ((then_block, node.then_body), (else_block, node.else_body or [])):
+            self.block = block
+            self.build_statements(body)
+            if self.block is not None:
+                ends.append(self.block)
+        if not ends:
+            self.block = None
+            return
+        join = self.function.new_block()
+        for end in ends:
+            terminate(end, Instr("jump"), [join])
+        self.seal(join)
+        self.block = join
+    
+    def build_while(self, node: While) -> None:
+        """Header testing the condition, body jumping back to it, then the exit."""
+        header = self.function.new_block()
+        terminate(self.block, Instr("jump"), [header])
+        self.block = header
+        cond = self.build_expr(node.cond)
+        body = self.function.new_block()
+        exit = self.function.new_block()
+        terminate(self.block, Instr("branch", [cond]), [body, exit])
+        self.sealed |= {body, exit}
+        self.block = body
+        self.build_statements(node.body)
+        if self.block is not None:
+            terminate(self.block, Instr("jump"), [header])
+        self.seal(header)
+        self.block = exit
+    
+    def build_for(self, node: For) -> None:
+        """for_init pushes the range; the header's for_iter yields each counter.
+        
+        This keeps FOR_RANGE's shape: the counter, bound and step stay on the
+        operand stack, and the body starts with the for_var taking the counter.
+        """
+        start = self.build_expr(node.start)
+        stop = self.build_expr(node.stop)
+        step = self.build_expr(node.step)
+        self.emit(Instr("for_init", [start, stop, step]))
+        header = self.function.new_block()
+        terminate(self.block, Instr("jump"), [header])
+        body = self.function.new_block()
+        exit = self.function.new_block()
+        terminate(header, Instr("for_iter"), [body, exit])
+        self.sealed |= {body, exit}
+        self.block = body
+        self.assign(node.var, self.emit(Instr("for_var", type=INT)))
+        self.build_statements(node.body)
+        if self.block is not None:
+            terminate(self.block, Instr("jump"), [header])
+        self.seal(header)
+        self.block = exit
+    
+    def assign(self, name: str, value: Instr) -> None:
+        """Make value the variable's current definition.
+        
+        At top level the variables are globals: the program's result, and read
+        by the functions it calls, so each assignment also stores the value
+        (compiler temporaries excepted).
+        """
+        if value.var is None and value.op != "const":
+            value.var = name
+        self.var_types[name] = value.type
+        self.write_variable(name, self.block, value)
+        if self.locals is None and not name.startswith(TEMP_PREFIX):
+            self.emit(Instr("store", [value], value=name))
+    
+    def build_expr(self, node: Expression) -> Instr:
+        """The value of an expression, emitting its Instrs into the current block."""
+        if isinstance(node, (Number, String)):
+            return self.function.constant(node.value, node.type)
+        elif isinstance(node, Var):
+            self.var_types.setdefault(node.name, node.type)
+            if self.locals is not None and node.name not in self.locals:
+                # Functions never assign globals, so a read is pure
+                return self.emit(Instr("global", type=node.type, value=node.name))
+            return self.read_variable(node.name, self.block)
+        elif isinstance(node, BinOp):
+            left = self.build_expr(node.left)
+            right = self.build_expr(node.right)
+            return self.emit(Instr("binop", [left, right], node.type, node.op))
+        elif isinstance(node, Call):
+            args = [self.build_expr(arg) for arg in node.args]
+            if node.name in BUILTINS:
+                return self.emit(Instr(node.name, args, node.type))
+            return self.emit(Instr("call", args, node.type, node.name))
+        elif isinstance(node, Index):
+            args = [self.build_expr(node.array), self.build_expr(node.index)]
+            return self.emit(Instr("index", args, node.type, None if node.checked else "unchecked"))
+        else:
+            raise ValueError(f"Unknown expression type: {type(node)}")
+    
+    def emit(self, instr: Instr) -> Instr:
+        """Append instr to the current block."""
+        return self.block.append(instr)
+    
+    def write_variable(self, name: str, block: Block, value: Instr) -> None:
+        """Record value as the variable's definition at the end of block."""
+        self.current_def.setdefault(name, {})[block] = value
+    
+    def read_variable(self, name: str, block: Block) -> Instr:
+        """The variable's value at the end of block."""
+        defs = self.current_def.get(name, {})
+        if block in defs:
+            return defs[block]
+        if block not in self.sealed:
+            # Predecessors still unknown: complete the phi when sealing
+            value = block.insert(len(block.phis()), Instr("phi", type=self.var_types.get(name)))
+            value.var = name
+            self.incomplete.setdefault(block, {})[name] = value
+        elif len(block.preds) == 1:
+            value = self.read_variable(name, block.preds[0])
+        elif not block.preds:
+            value = self.undefined(name)
+        else:
+            phi = block.insert(len(block.phis()), Instr("phi", type=self.var_types.get(name)))
+            phi.var = name
+            self.write_variable(name, block, phi)
+            value = self.add_phi_operands(name, phi)
+        self.write_variable(name, block, value)
+        return value
+    
+    def undefined(self, name: str) -> Instr:
+        """Value of a variable read before any assignment reaches it.
+        
+        At top level that is an extern: the global as the program starts. The
+        analyzer rules out anything else, so a function gets the zero value.
+        """
+        if self.locals is not None:
+            zero = {BOOL: False, STR: ""}.get(self.var_types.get(name), 0)
+            return self.function.constant(zero)
+        if name not in self.entry_globals:
+            value = self.function.entry.insert(0, Instr("global", type=INT, value=name))
+            value.var = name
+            self.entry_globals[name] = value
+        return self.entry_globals[name]
+    
+    def add_phi_operands(self, name: str, phi: Instr) -> Instr:
+        """Fill in a phi from its block's predecessors; returns the value it simplifies to."""
+        for pred in phi.block.preds:
+            phi.add_arg(self.read_variable(name, pred))
+        return self.remove_trivial_phi(phi)
+    
+    def remove_trivial_phi(self, phi: Instr) -> Instr:
+        """Replace a phi whose operands are one value (or itself) by that value."""
+        same = None
+        for arg in phi.args:
+            if arg is same or arg is phi:
+                continue
+            if same is not None:
+                return phi
+            same = arg
+        if same is None:
+            same = self.undefined(phi.var)
+        users = [user for user in phi.users if user is not phi]
+        phi.replace_uses(same)
+        for defs in self.current_def.values():
+            for block, value in defs.items():
+                if value is phi:
+                    defs[block] = same
+        phi.remove()
+        for user in users:
+            if user.op == "phi" and user.block is not None:
+                self.remove_trivial_phi(user)
+        return same
+    
+    def seal(self, block: Block) -> None:
+        """All predecessors of block are known: complete its phis."""
+        for name, phi in self.incomplete.pop(block, {}).items():
+            self.add_phi_operands(name, phi)
+        self.sealed.add(block)
+
+
+def simplify_phis(function: IRFunction) -> None:
+    """Replace phis whose operands are all one value (besides the phi itself)."""
+    changed = True
+    while changed:
+        changed = False
+        for block in function.blocks:
+            for phi in block.phis():
+                others = {id(arg): arg for arg in phi.args if arg is not phi}
+                if len(others) == 1:
+                    phi.replace_uses(next(iter(others.values())))
+                    phi.remove()
+                    changed = True
+
+
+def remove_unreachable_blocks(function: IRFunction) -> None:
+    """Drop blocks the entry cannot reach, and their edges."""
+    reachable = set(reverse_postorder(function))
+    for block in [block for block in function.blocks if block not in reachable]:
+        for succ in block.succs:
+            if succ in reachable:
+                remove_edge(block, succ)
+        for instr in block.instrs + [block.terminator]:
+            for arg in instr.args:
+                arg.users.remove(instr)
+            instr.args = []
+        function.blocks.remove(block)
+    simplify_phis(function)
+
+
+# Lattice values for constant propagation besides constants, which are
+# (type, value) pairs so that True and 1 stay distinct
+UNDEFINED = "undefined"
+VARYING = "varying"
+
+
+def propagate_constants(function: IRFunction) -> None:
+    """Sparse conditional constant propagation (Wegman and Zadeck).
+    
+    Values are assumed undefined and blocks unreachable until shown
+    otherwise, so a branch on a constant keeps its other side (and the phi
+    operands that come from it) out of the analysis. Constant values are then
+    replaced by const Instrs and constant branches by jumps.
+    """
+    lattice = {}
+    reached = set()
+    edges = set()
+    flow = [(None, function.entry)]
+    values = []
+    
+    def get(instr):
+        if instr.op == "const":
+            return (instr.value.__class__, instr.value)
+        return lattice.get(instr, UNDEFINED)
+    
+    def evaluate(instr):
+        if instr.op == "phi":
+            result = UNDEFINED
+            for pred, arg in zip(instr.block.preds, instr.args):
+                if (pred, instr.block) not in edges:
+                    continue
+                value = get(arg)
+                if value == UNDEFINED:
+                    continue
+                if result == UNDEFINED:
+                    result = value
+                elif result != value:
+                    return VARYING
+            return result
+        if instr.op == "binop":
+            left, right = get(instr.args[0]), get(instr.args[1])
+            if VARYING in (left, right):
+                return VARYING
+            if UNDEFINED in (left, right):
+                return UNDEFINED
+            if instr.value == "/" and right[1] == 0:
+                return VARYING  # Fails at run time
+            result = FOLDERS[instr.value](left[1], right[1])
+            if isinstance(result, str) and len(result) > MAX_FOLDED_STRING:
+                return VARYING  # Built at run time rather than stored in the constants
+            return (result.__class__, result)
+        return VARYING
+    
+    def visit_terminator(block):
+        term = block.terminator
+        if term.op == "branch":
+            cond = get(term.args[0])
+            if cond == UNDEFINED:
+                return
+            if cond != VARYING:
+                flow.append((block, term.targets[0] if cond[1] else term.targets[1]))
+                return
+        for target in term.targets:
+            flow.append((block, target))
+    
+    def visit(instr):
+        if instr.op in TERMINATOR_OPS:
+            visit_terminator(instr.block)
+            return
+        value = evaluate(instr)
+        if value != lattice.get(instr, UNDEFINED):
+            lattice[instr] = value
+            values.extend(instr.users)
+    
+    while flow or values:
+        if flow:
+            pred, block = flow.pop()
+            if (pred, block) in edges:
+                continue
+            edges.add((pred, block))
+            if block in reached:
+                for phi in block.phis():
+                    visit(phi)
+                continue
+            reached.add(block)
+            for instr in block.instrs:
+                visit(instr)
+            visit(block.terminator)
+        else:
+            instr = values.pop()
+            if instr.block in reached:
+                visit(instr)
+    
+    for block in function.blocks:
+        if block not in reached:
+            continue
+        for instr in list(block.instrs):
+            value = lattice.get(instr)
+            if instr.op in ("phi", "binop") and value not in (None, UNDEFINED, VARYING):
+                instr.replace_uses(function.constant(value[1], instr.type))
+                instr.remove()
+        term = block.terminator
+        if term.op == "branch" and term.args[0].op == "const":
+            taken = term.targets[0] if term.args[0].value else term.targets[1]
+            for target in term.targets:
+                if target is not taken:
+                    remove_edge(block, target)
+            term.remove_arg(0)
+            term.op = "jump"
+            term.targets = [taken]
+    remove_unreachable_blocks(function)
+
+
+def value_key(instr: Instr) -> Optional[Tuple]:
+    """Key equal for Instrs that compute the same value, or None if unique."""
+    if instr.op == "binop":
+        left, right = id(instr.args[0]), id(instr.args[1])
+        if instr.value in COMMUTATIVE and instr.type != STR and left > right:
+            left, right = right, left
+        return ("binop", instr.value, left, right)
+    if instr.op == "global":
+        return ("global", instr.value)
+    if instr.op == "len":
+        return ("len", id(instr.args[0]))
+    if instr.op == "phi":
+        return ("phi", id(instr.block)) + tuple(id(arg) for arg in instr.args)
+    return None
+
+
+def number_values(function: IRFunction) -> None:
+    """Global value numbering over the dominator tree.
+    
+    An Instr computing the same value as one in a dominating position is
+    replaced by it. Division that may fail is included: if the first one
+    did not fail, the same division will not either.
+    """
+    idom = dominators(function)
+    children = {}
+    for block, parent in idom.items():
+        if parent is not block:
+            children.setdefault(parent, []).append(block)
+    table = {}
+    # Walk the tree iteratively; (block, None) undoes a block's entries
+    stack = [(function.entry, None)]
+    while stack:
+        block, added = stack.pop()
+        if added is not None:
+            for key in added:
+                del table[key]
+            continue
+        added = []
+        for instr in list(block.instrs):
+            key = value_key(instr)
+            if key is None:
+                continue
+            if key in table:
+                instr.replace_uses(table[key])
+                instr.remove()
+            else:
+                table[key] = instr
+                added.append(key)
+        stack.append((block, added))
+        for child in children.get(block, []):
+            stack.append((child, None))
+
+
+def natural_loops(function: IRFunction) -> Dict[Block, Set[Block]]:
+    """Blocks of each loop, keyed by header: everything reaching a back edge's source without passing the header."""
+    idom = dominators(function)
+    loops = {}
+    for block in idom:
+        for succ in block.succs:
+            if succ in idom and dominates(idom, succ, block):
+                body = loops.setdefault(succ, {succ})
+                work = [block]
+                while work:
+                    current = work.pop()
+                    if current not in body:
+                        body.add(current)
+                        work.extend(current.preds)
+    return loops
+
+
+def hoist_loop_invariants(function: IRFunction) -> None:
+    """Move arithmetic and array lengths whose operands are defined outside a loop into its preheader.
+    
+    Only operations that cannot fail are moved, since the loop may run zero
+    times; comparisons stay put so loop conditions keep their fused branches.
+    Inner loops go first, so a value can move out through several levels.
+    """
+    loops = natural_loops(function)
+    order = reverse_postorder(function)
+    for header, body in sorted(loops.items(), key=lambda item: len(item[1])):
+        outside = [pred for pred in header.preds if pred not in body]
+        if len(outside) != 1 or outside[0].terminator.op != "jump":
+            continue
+        preheader = outside[0]
+        changed = True
+        while changed:
+            changed = False
+            for block in order:
+                if block not in body:
+                    continue
+                for instr in list(block.instrs):
+                    hoistable = ((instr.op == "binop" and instr.value in HOISTABLE_OPS and not may_trap(instr))
+                                 or instr.op in ("global", "len"))
+                    if hoistable and all(arg.block not in body for arg in instr.args):
+                        block.instrs.remove(instr)
+                        # The range pushed by for_init must stay last
+                        end = len(preheader.instrs)
+                        if end and preheader.instrs[-1].op == "for_init":
+                            end -= 1
+                        preheader.insert(end, instr)
+                        changed = True
+
+
+def eliminate_dead_code(function: IRFunction) -> None:
+    """Remove Instrs that no effect, branch or return depends on (mark and sweep)."""
+    live = set()
+    work = []
+    for block in function.blocks:
+        for instr in block.instrs + [block.terminator]:
+            if has_effects(instr):
+                work.append(instr)
+    while work:
+        instr = work.pop()
+        if instr in live:
+            continue
+        live.add(instr)
+        work.extend(instr.args)
+    for block in function.blocks:
+        for instr in list(block.instrs):
+            if instr not in live:
+                for arg in instr.args:
+                    arg.users.remove(instr)
+                instr.args = []
+                block.instrs.remove(instr)
+                instr.block = None
+    for key, instr in list(function.constants.items()):
+        if instr.block is None:
+            del function.constants[key]
+
+
+def optimize_ir(function: IRFunction) -> IRFunction:
+    """Run the SSA passes over one function."""
+    propagate_constants(function)
+    number_values(function)
+    hoist_loop_invariants(function)
+    number_values(function)
+    eliminate_dead_code(function)
+    return function
+
+
+def build_ir(program: Program) -> List[IRFunction]:
+    """SSA form of an analyzed program: the top-level code first, then each function."""
+    return IRBuilder().build_program(program)
+
+
+def split_critical_edges(function: IRFunction) -> None:
+    """Give each edge from a multi-way block into a block with phis a block of its own.
+    
+    Phi copies are placed at the end of the predecessor, which is only right
+    when that predecessor has no other successor.
+    """
+    for block in list(function.blocks):
+        if len(block.succs) < 2:
+            continue
+        for index, succ in enumerate(block.succs):
+            if not succ.phis():
+                continue
+            middle = function.new_block()
+            block.terminator.targets[index] = middle
+            succ.preds[succ.preds.index(block)] = middle
+            middle.preds.append(block)
+            jump = Instr("jump")
+            jump.block = middle
+            jump.targets = [succ]
+            middle.terminator = jump
+
+
+class IRLowering:
+    """Emits stack bytecode for a program in SSA form.
+    
+    In each block an Instr used once, later in the same block, is evaluated
+    on the operand stack right where it is used, provided that does not move
+    it across an effect (or an effect across another). Every other value that
+    is used lives in a slot from definition to last use. Slots are shared by
+    values whose live ranges do not overlap, preferring the variable the value
+    was assigned to, so most phi copies and top-level stores disappear.
+    
+    Operands are pushed in argument order, except that when the last operand
+    of a binop or a call of up to three arguments has to run first (it is an
+    effect that comes before the others), it is pushed first and moved back
+    into place with SWAP or ROT, or the comparison is mirrored.
+    """
+    
+    def __init__(self):
+        self.out = Compiler()
+        self.function = None
+        self.inlined = set()
+        self.rotated = set()  # Instrs whose last operand is pushed first
+        self.roots = {}  # block -> Instrs evaluated as statements, in order
+        self.homes = {}  # value -> slot name
+        self.slots = {}  # slot name -> local index, inside a function
+        self.labels = {}
+        self.fixups = []  # (instruction index, target block)
+        self.contents = {}  # slot -> value it is known to hold
+        self.end_contents = {}  # block -> contents once it has run
+    
+    def lower_program(self, functions: List[IRFunction]):
+        """Code, constants and names for the top-level IRFunction and the functions after it."""
+        for function in functions[1:]:
+            self.out.functions[function.name] = self.out.const_index(
+                Function(function.name, len(function.params)))
+        for function in functions:
+            self.lower_function(function)
+        return (peephole(self.out.code, [const for const in self.out.consts if isinstance(const, Function)]),
+                self.out.consts, self.out.names)
+    
+    def lower_function(self, function: IRFunction) -> None:
+        """Emit one body."""
+        self.function = function
+        self.inlined = set()
+        self.rotated = set()
+        self.roots = {}
+        self.homes = {}
+        self.slots = {name: index for index, name in enumerate(function.params)}
+        self.labels = {}
+        self.fixups = []
+        self.end_contents = {}
+        split_critical_edges(function)
+        order = reverse_postorder(function)
+        for block in order:
+            self.form_trees(block)
+        self.allocate(order)
+        
+        if not function.is_main:
+            const = self.out.consts[self.out.functions[function.name]]
+            const.entry = len(self.out.code)
+        for value in self.entry_values(function.entry):
+            if value.op == "global" and self.homes[value] != value.value:
+                self.out.emit(LOAD_NAME, self.out.name_index(value.value))
+                self.store(value)
+        for block in order:
+            self.labels[block] = len(self.out.code)
+            self.emit_block(block)
+        for index, target in self.fixups:
+            self.out.code[index].arg = self.labels[target]
+        if not function.is_main:
+            const.nlocals = len(self.slots)
+    
+    def rematerialized(self, instr: Instr) -> bool:
+        """Whether instr is recomputed at each use (a constant, or a global read in a function)."""
+        return instr.op == "const" or (instr.op == "global" and not self.function.is_main)
+    
+    def needs_home(self, instr: Instr) -> bool:
+        """Whether instr's value is kept in a slot."""
+        return bool(instr.users) and instr not in self.inlined and not self.rematerialized(instr)
+    
+    def entry_values(self, block: Block) -> List[Instr]:
+        """Values defined as the block starts: its phis, and parameters and top-level globals at the entry."""
+        values = block.phis()
+        if block is self.function.entry:
+            values += [instr for instr in block.instrs
+                       if instr.op == "param" or (instr.op == "global" and self.function.is_main)]
+        return [value for value in values if self.needs_home(value)]
+    
+    def form_trees(self, block: Block) -> None:
+        """Choose which Instrs are evaluated inside their user's expression tree."""
+        instrs = [instr for instr in block.instrs
+                  if instr.op not in ("phi", "param") and not self.rematerialized(instr)
+                  and not (instr.op == "global" and self.function.is_main)]
+        position = {instr: index for index, instr in enumerate(instrs)}
+        position[block.terminator] = len(instrs)
+        
+        def candidate(arg):
+            return not (arg not in position or arg in self.inlined or arg.op == "for_var"
+                        or len(arg.users) != 1 or arg.users[0].op == "phi")
+        
+        def stackify(user, root, effects):
+            args = user.args
+            if (user.op in ("binop", "call") and 2 <= len(args) <= 3 and all(map(candidate, args))
+                    and has_effects(args[-1]) and any(has_effects(arg) for arg in args[:-1])
+                    and all(position[args[-1]] < position[arg] for arg in args[:-1])):
+                self.rotated.add(user)
+                args = [args[-1]] + args[:-1]
+            for arg in reversed(args):
+                if not candidate(arg):
+                    continue
+                if has_effects(arg):
+                    # It moves past everything between it and the root that
+                    # is not part of this tree, and before the tree's effects
+                    crossed = instrs[position[arg] + 1:position[root]]
+                    if any(has_effects(other) for other in crossed if other not in self.inlined):
+                        continue
+                    if any(position[other] < position[arg] for other in effects):
+                        continue
+                    effects.append(arg)
+                self.inlined.add(arg)
+                stackify(arg, root, effects)
+            if user in self.rotated and user.args[-1] not in self.inlined:
+                self.rotated.discard(user)  # Loaded from its slot, so the order does not matter
+        
+        stackify(block.terminator, block.terminator, [])
+        for instr in reversed(instrs):
+            if instr not in self.inlined:
+                stackify(instr, instr, [instr] if has_effects(instr) else [])
+        self.roots[block] = [instr for instr in instrs if instr not in self.inlined]
+    
+    def tree_uses(self, instr: Instr, uses: List[Instr]) -> List[Instr]:
+        """Values with homes read while evaluating instr's tree."""
+        for arg in instr.args:
+            if arg in self.inlined:
+                self.tree_uses(arg, uses)
+            elif self.needs_home(arg):
+                uses.append(arg)
+        return uses
+    
+    def calls(self, instr: Instr) -> bool:
+        """Whether evaluating instr's tree calls a function."""
+        return instr.op == "call" or any(self.calls(arg) for arg in instr.args if arg in self.inlined)
+    
+    def phi_sources(self, block: Block) -> List[Tuple[Instr, Instr]]:
+        """(phi, operand) pairs copied at the end of block."""
+        pairs = []
+        for succ in block.succs:
+            index = succ.preds.index(block)
+            pairs.extend((phi, phi.args[index]) for phi in succ.phis())
+        return pairs
+    
+    def allocate(self, order: List[Block]) -> None:
+        """Assign a slot to every value that needs one.
+        
+        Two values interfere when one is live where the other is defined. A
+        top-level store interferes like a definition of its global with
+        everything live after it, except the stored value.
+        """
+        live_in = {block: set() for block in order}
+        live_out = {block: set() for block in order}
+        
+        def end_uses(block):
+            uses = [arg for _, arg in self.phi_sources(block) if self.needs_home(arg)]
+            return uses + self.tree_uses(block.terminator, [])
+        
+        changed = True
+        while changed:
+            changed = False
+            for block in reversed(order):
+                live = set(end_uses(block))
+                for succ in block.succs:
+                    live |= live_in[succ]
+                live_out[block] = set(live)
+                for root in reversed(self.roots[block]):
+                    live.discard(root)
+                    live.update(self.tree_uses(root, []))
+                live -= set(self.entry_values(block))
+                if live != live_in[block]:
+                    live_in[block] = live
+                    changed = True
+        
+        interference = {}
+        stores = []  # (store, pinned global)
+        
+        def interfere(a, b):
+            if a is not b:
+                interference.setdefault(a, set()).add(b)
+                interference.setdefault(b, set()).add(a)
+        
+        for block in order:
+            live = set(live_out[block])
+            for root in reversed(self.roots[block]):
+                if self.needs_home(root):
+                    for other in live:
+                        interfere(root, other)
+                    interference.setdefault(root, set())
+                    live.discard(root)
+                if root.op == "store":
+                    stores.append(root)
+                    for other in live:
+                        if other is not root.args[0]:
+                            interfere(root, other)
+                    interference.setdefault(root, set())
+                live.update(self.tree_uses(root, []))
+            defined = self.entry_values(block)
+            for value in defined:
+                interference.setdefault(value, set())
+                for other in live | set(defined):
+                    interfere(value, other)
+        
+        # At top level a called function reads the globals, so a value may
+        # only be computed straight into a user's global if it is stored
+        # there before the next call; phis and entry values hold it anyway
+        stored_early = set()
+        for block in order:
+            pending = set()
+            for root in self.roots[block]:
+                if self.calls(root):
+                    pending.clear()
+                if root.op == "store" and root.args[0] in pending:
+                    stored_early.add((root.args[0], root.value))
+                if self.needs_home(root):
+                    pending.add(root)
+        occupants = {}
+        
+        def fits(value, slot):
+            if (self.function.is_main and not slot.startswith(TEMP_PREFIX)
+                    and value.op not in ("phi", "global") and (value, slot) not in stored_early):
+                return False
+            return not any(other in interference[value] for other in occupants.get(slot, ()))
+        
+        def place(value, slot):
+            self.homes[value] = slot
+            occupants.setdefault(slot, []).append(value)
+            if not self.function.is_main and slot not in self.slots:
+                self.slots[slot] = len(self.slots)
+        
+        for store in stores:
+            place(store, store.value)
+        sequence = {}
+        for block in order:
+            for instr in block.instrs:
+                sequence[instr] = len(sequence)
+        # Parameters are pinned; then phis, then the rest in program order
+        rank = {"param": 0, "phi": 1}
+        values = [value for value in interference if value.op != "store"]
+        values.sort(key=lambda value: (rank.get(value.op, 2), sequence[value]))
+        for value in values:
+            if value.op == "param":
+                place(value, self.function.params[value.value])
+                continue
+            preferred = []
+            if value.var is not None:
+                preferred.append(value.var)
+            for user in value.users:
+                if user.op == "phi" and user in self.homes:
+                    preferred.append(self.homes[user])
+            for arg in value.args if value.op == "phi" else ():
+                if arg in self.homes:
+                    preferred.append(self.homes[arg])
+            if self.function.is_main:
+                # Any other global could be read by a function or the host
+                preferred += [slot for slot in occupants if slot.startswith(SLOT_PREFIX)]
+            else:
+                preferred += list(occupants)
+            for slot in preferred:
+                if fits(value, slot):
+                    place(value, slot)
+                    break
+            else:
+                place(value, f"{SLOT_PREFIX}{len([slot for slot in occupants if slot.startswith(SLOT_PREFIX)])}")
+    
+    def emit_block(self, block: Block) -> None:
+        """Emit a block's statements, its phi copies and its terminator.
+        
+        A copy is skipped when the phi's slot already holds the operand, either
+        because they share it or because it was stored there on the way (calls
+        write no slots, so what a lone predecessor left carries over).
+        """
+        self.contents = {}
+        if len(block.preds) == 1 and block.preds[0] in self.end_contents:
+            self.contents = dict(self.end_contents[block.preds[0]])
+        for root in self.roots[block]:
+            self.emit_root(root)
+        pairs = [(phi, arg) for phi, arg in self.phi_sources(block)
+                 if not (self.needs_home(arg) and self.homes[arg] == self.homes[phi])
+                 and self.contents.get(self.homes[phi]) is not arg]
+        # Parallel copy: every operand is read before any phi is written
+        for _, arg in pairs:
+            self.emit_value(arg)
+        for phi, _ in reversed(pairs):
+            self.store(phi)
+        self.end_contents[block] = self.contents
+        self.emit_terminator(block.terminator)
+    
+    def emit_root(self, instr: Instr) -> None:
+        """Emit an Instr evaluated as a statement."""
+        if instr.op == "for_var":
+            # FOR_RANGE just pushed the counter
+            if self.needs_home(instr):
+                self.store(instr)
+            else:
+                self.out.emit(POP)
+        elif instr.op == "print":
+            self.emit_value(instr.args[0])
+            self.out.emit(PRINT)
+        elif instr.op == "checkpoint":
+            self.out.emit(CHECKPOINT)
+        elif instr.op == "for_init":
+            for arg in instr.args:
+                self.emit_value(arg)
+        elif instr.op == "store_index":
+            self.emit_tree(instr)
+        elif instr.op == "store":
+            value = instr.args[0]
+            self.contents[instr.value] = value
+            if self.needs_home(value) and self.homes[value] == instr.value:
+                return  # Computed straight into the global
+            self.emit_value(value)
+            self.out.emit(STORE_NAME, self.out.name_index(instr.value))
+        else:
+            self.emit_tree(instr)
+            if self.needs_home(instr):
+                self.store(instr)
+            else:
+                self.out.emit(POP)
+    
+    def emit_value(self, instr: Instr) -> None:
+        """Push instr's value."""
+        if instr in self.inlined:
+            self.emit_tree(instr)
+        elif instr.op == "const":
+            self.out.emit(LOAD_CONST, self.out.const_index(instr.value))
+        elif instr.op == "global" and not self.function.is_main:
+            self.out.emit(LOAD_NAME, self.out.name_index(instr.value))
+        elif self.function.is_main:
+            self.out.emit(LOAD_NAME, self.out.name_index(self.homes[instr]))
+        else:
+            self.out.emit(LOAD_FAST, self.slots[self.homes[instr]])
+    
+    def store(self, instr: Instr) -> None:
+        """Pop the top of the stack into instr's slot."""
+        self.contents[self.homes[instr]] = instr
+        if self.function.is_main:
+            self.out.emit(STORE_NAME, self.out.name_index(self.homes[instr]))
+        else:
+            self.out.emit(STORE_FAST, self.slots[self.homes[instr]])
+    
+    def emit_operands(self, instr: Instr) -> Optional[str]:
+        """Push a binop's or call's operands in order; return the binop's operator, mirrored if they were not."""
+        if instr not in self.rotated:
+            for arg in instr.args:
+                self.emit_value(arg)
+            return instr.value
+        self.emit_value(instr.args[-1])
+        for arg in instr.args[:-1]:
+            self.emit_value(arg)
+        if instr.op == "binop" and instr.value in COMMUTED and instr.type != STR:
+            return COMMUTED[instr.value]
+        self.out.emit(SWAP if len(instr.args) == 2 else ROT)
+        return instr.value
+    
+    def emit_tree(self, instr: Instr) -> None:
+        """Evaluate a binop, call or array op from its operands."""
+        if instr.op in ARRAY_OPCODES:
+            for arg in instr.args:
+                self.emit_value(arg)
+            self.out.emit(UNCHECKED_OPCODES[instr.op] if instr.value == "unchecked" else ARRAY_OPCODES[instr.op])
+            return
+        op = self.emit_operands(instr)
+        if instr.op == "call":
+            self.out.emit(CALL, self.out.functions[instr.value])
+        elif instr.args[0].type == INT and instr.args[1].type == INT:
+            self.out.emit(INT_OPCODES[op])
+        else:
+            self.out.emit(GENERIC_OPCODES[op])
+    
+    def jump(self, opcode: int, target: Block) -> None:
+        """Emit a jump to a block, patched once every block is placed."""
+        self.fixups.append((self.out.emit(opcode, None), target))
+    
+    def emit_terminator(self, instr: Instr) -> None:
+        """Emit a block's final jump, branch, return or halt."""
+        if instr.op == "jump":
+            self.jump(JUMP, instr.targets[0])
+        elif instr.op == "branch":
+            cond = instr.args[0]
+            if (cond in self.inlined and cond.op == "binop" and cond.value in INVERTED_BRANCH
+                    and cond.args[0].type in (INT, BOOL) and cond.args[1].type in (INT, BOOL)):
+                self.jump(INVERTED_BRANCH[self.emit_operands(cond)], instr.targets[1])
+            else:
+                self.emit_value(cond)
+                self.jump(JUMP_IF_FALSE, instr.targets[1])
+            self.jump(JUMP, instr.targets[0])
+        elif instr.op == "for_iter":
+            self.jump(FOR_RANGE, instr.targets[1])
+            self.jump(JUMP, instr.targets[0])
+        elif instr.op == "return":
+            value = instr.args[0]
+            if value in self.inlined and value.op == "call":
+                self.emit_operands(value)
+                self.out.emit(TAIL_CALL, self.out.functions[value.value])
+            else:
+                self.emit_value(value)
+                self.out.emit(RETURN)
+        elif instr.op == "halt":
+            self.out.emit(HALT)
+        else:
+            raise ValueError(f"Unknown terminator: {instr.op}")
+
+
+def lower_ir(functions: List[IRFunction]):
+    """Stack bytecode (code, consts, names) for a program in SSA form."""
+    return IRLowering().lower_program(functions)
+
+
+def compile_ir(ast: Program):
+    """Compile an analyzed AST through the SSA form: build, optimize, lower."""
+    functions = build_ir(ast)
+    for function in functions:
+        optimize_ir(function)
+    return lower_ir(functions)
@@ -23,6 +23,7 @@ class Token:
 # Token types
 IDENT = "IDENT"
 NUMBER = "NUMBER"
+STRING = "STRING"
 KEYWORD = "KEYWORD"
 PLUS = "PLUS"
 MINUS = "MINUS"
@@ -37,7 +38,11 @@ NEQ = "NEQ"
 ASSIGN = "ASSIGN"
 LPAREN = "LPAREN"
 RPAREN = "RPAREN"
+LBRACKET = "LBRACKET"
+RBRACKET = "RBRACKET"
 COLON = "COLON"
+COMMA = "COMMA"
+ARROW = "ARROW"
 NEWLINE = "NEWLINE"
 INDENT = "INDENT"
 DEDENT = "DEDENT"
@@ -48,9 +53,17 @@ KEYWORDS = {
     "if": "if",
     "else": "else",
     "while": "while",
+    "for": "for",
+    "in": "in",
     "print": "print",
+    "checkpoint": "checkpoint",
+    "def": "def",
+    "return": "return",
 }
 
+# Escape sequences in string literals and the characters they stand for
+ESCAPES = {"n": "\n", "t": "\t", "\\": "\\", "\"": "\"", "'": "'"}
+
 
 class Lexer:
     """Tokenizes MiniPy source code."""
@@ -106,6 +119,33 @@ class Lexer:
             self.advance()
         return Token(NUMBER, int(num_str), self.line, start_col)
     
+    def read_string(self):
+        """Read a string literal in single or double quotes.
+        
+        Literals hold printable ASCII and the escapes in ESCAPES, so a
+        string's length is the same in characters and in bytes.
+        """
+        start_line, start_col = self.line, self.col
+        quote = self.current_char()
+        self.advance()
+        chars = []
+        while self.current_char() != quote:
+            char = self.current_char()
+            if char is None or char == '\n':
+                raise LexerError("Unterminated string literal", start_line, start_col)
+            if char == '\\':
+                self.advance()
+                escape = self.current_char()
+                if escape not in ESCAPES:
+                    raise LexerError(f"Unknown escape sequence: \\{escape or ''}", self.line, self.col)
+                char = ESCAPES[escape]
+            elif not ' ' <= char <= '~':
+                raise LexerError(f"Unsupported character in string literal: {repr(char)}", self.line, self.col)
+            chars.append(char)
+            self.advance()
+        self.advance()
+        return Token(STRING, "".join(chars), start_line, start_col)
+    
     def read_identifier(self):
         """Read an identifier or keyword."""
         start_col = self.col
@@ -210,8 +250,12 @@ class Lexer:
                 self.advance()
                 continue
             if char == '-':
-                self.tokens.append(Token(MINUS, '-', self.line, self.col))
                 self.advance()
+                if self.current_char() == '>':
+                    self.advance()
+                    self.tokens.append(Token(ARROW, '->', self.line, self.col - 1))
+                else:
+                    self.tokens.append(Token(MINUS, '-', self.line, self.col - 1))
                 continue
             if char == '*':
                 self.tokens.append(Token(MUL, '*', self.line, self.col))
@@ -253,16 +297,33 @@ class Lexer:
                 self.tokens.append(Token(RPAREN, ')', self.line, self.col))
                 self.advance()
                 continue
+            if char == '[':
+                self.tokens.append(Token(LBRACKET, '[', self.line, self.col))
+                self.advance()
+                continue
+            if char == ']':
+                self.tokens.append(Token(RBRACKET, ']', self.line, self.col))
+                self.advance()
+                continue
             if char == ':':
                 self.tokens.append(Token(COLON, ':', self.line, self.col))
                 self.advance()
                 continue
+            if char == ',':
+                self.tokens.append(Token(COMMA, ',', self.line, self.col))
+                self.advance()
+                continue
             
             # Numbers
             if char.isdigit():
                 self.tokens.append(self.read_number())
                 continue
             
+            # Strings
+            if char == '"' or char == "'":
+                self.tokens.append(self.read_string())
+                continue
+            
             # Identifiers and keywords
             if char.isalpha() or char == '_':
                 self.tokens.append(self.read_identifier())
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Client for the C++ VM server mode (minipy_vm --serve <socket_path>)."""
+
+import socket
+import sys
+from typing import Callable, Dict, Optional
+from errors import ServerError
+
+
+class VMClient:
+    """Talks to a minipy_vm server over a connected stream socket."""
+
+    def __init__(self, sock: socket.socket):
+        self.sock = sock
+        self.reader = sock.makefile('rb')
+
+    @classmethod
+    def connect(cls, socket_path: str) -> 'VMClient':
+        """Connect to a server listening on a Unix domain socket."""
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.connect(socket_path)
+        return cls(sock)
+
+    def close(self) -> None:
+        """Close the connection."""
+        self.reader.close()
+        self.sock.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def read_line(self) -> str:
+        """Read one response line."""
+        line = self.reader.readline()
+        if not line:
+            raise ServerError("Connection closed by server")
+        return line.decode().rstrip('\n')
+
+    def load(self, bytecode: str) -> str:
+        """Upload serialized bytecode and return its program id."""
+        data = bytecode.encode()
+        self.sock.sendall(f"LOAD {len(data)}\n".encode() + data)
+        reply = self.read_line()
+        if reply.startswith("OK "):
+            return reply[3:]
+        raise ServerError(reply[4:] if reply.startswith("ERR ") else reply)
+
+    def load_file(self, filename: str) -> str:
+        """Upload a .mpbc file and return its program id."""
+        with open(filename, 'r') as f:
+            return self.load(f.read())
+
+    def run(self, program_id: str, bindings: Optional[Dict[str, int]] = None,
+            on_output: Optional[Callable[[str], None]] = None) -> str:
+        """Run a loaded program with the given globals and return its output.
+
+        on_output, if given, is called with each chunk as it streams in.
+        """
+        bindings = bindings or {}
+        request = f"RUN {program_id} {len(bindings)}\n"
+        for name, value in bindings.items():
+            request += f"{name} {value}\n"
+        self.sock.sendall(request.encode())
+
+        chunks = []
+        while True:
+            reply = self.read_line()
+            if reply.startswith("OUT "):
+                chunk = self.reader.read(int(reply[4:])).decode()
+                chunks.append(chunk)
+                if on_output:
+                    on_output(chunk)
+            elif reply == "DONE":
+                return "".join(chunks)
+            elif reply.startswith("ERR "):
+                raise ServerError(reply[4:])
+            else:
+                raise ServerError(f"Unexpected reply: {reply}")
+
+
+def main():
+    if len(sys.argv) < 3:
+        print("Usage: minipy_client.py <socket_path> <file.mpbc> [name=value]...")
+        sys.exit(1)
+
+    socket_path, filename = sys.argv[1], sys.argv[2]
+    bindings = {}
+    for binding in sys.argv[3:]:
+        name, _, value = binding.partition('=')
+        bindings[name] = int(value)
+
+    try:
+        with VMClient.connect(socket_path) as client:
+            program_id = client.load_file(filename)
+            client.run(program_id, bindings, on_output=sys.stdout.write)
+    except Exception as e:
+        print(f"Error: {e}", file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,19 +1,42 @@
 #!/usr/bin/env python3
 """MiniPy compiler CLI - compiles .mpy files to bytecode."""
 
+import os
 import sys
-from compiler import (
-    Lexer, Parser, SemanticAnalyzer, Optimizer,
-    compile_ast, serialize_bytecode
-)
+from lexer import Lexer
+from parser import Parser
+from semantic import SemanticAnalyzer
+from optimizer import Optimizer
+from compiler import compile_ast
+from ir import compile_ir
+from bytecode_serializer import serialize_bytecode
 
 def main():
     if len(sys.argv) < 2:
-        print("Usage: minipyc <file.mpy>")
+        print("Usage: minipyc <file.mpy> [--extern NAME]... [--ssa] [--unroll N]")
         sys.exit(1)
     
     filename = sys.argv[1]
     
+    # Globals supplied at run time (e.g. server RUN bindings)
+    externs = []
+    ssa = False  # Generate code through the SSA form (ir.py)
+    unroll_factor = None  # Loop body copies per unrolled iteration (1 disables)
+    args = sys.argv[2:]
+    while args:
+        if args[0] == "--extern" and len(args) > 1:
+            externs.append(args[1])
+            args = args[2:]
+        elif args[0] == "--ssa":
+            ssa = True
+            args = args[1:]
+        elif args[0] == "--unroll" and len(args) > 1 and args[1].isdigit() and int(args[1]) > 0:
+            unroll_factor = int(args[1])
+            args = args[2:]
+        else:
+            print(f"Unknown argument: {args[0]}", file=sys.stderr)
+            sys.exit(1)
+    
     try:
         with open(filename, 'r') as f:
             source = f.read()
@@ -25,20 +48,20 @@ def main():
         parser = Parser(tokens)
         ast = parser.parse_program()
         
-        semantic = SemanticAnalyzer()
+        semantic = SemanticAnalyzer(externs)
         errors = semantic.check(ast)
         if errors:
             for error in errors:
                 print(f"Error: {error}", file=sys.stderr)
             sys.exit(1)
         
-        optimizer = Optimizer()
+        optimizer = Optimizer() if unroll_factor is None else Optimizer(unroll_factor=unroll_factor)
         ast = optimizer.optimize(ast)
         
-        code, consts, names = compile_ast(ast)
+        code, consts, names = compile_ir(ast) if ssa else compile_ast(ast)
         
-        # Output bytecode
-        bytecode_file = filename.replace('.mpy', '.mpbc')
+        # Output bytecode next to the source (never over it)
+        bytecode_file = os.path.splitext(filename)[0] + '.mpbc'
         serialize_bytecode(code, consts, names, bytecode_file)
         print(f"Compiled to {bytecode_file}")
         
@@ -48,4 +71,3 @@ def main():
 
 if __name__ == "__main__":
     main()
-
@@ -1,40 +1,290 @@
 """Constant folding and AST optimization for MiniPy."""
 
-from typing import Optional
+from typing import List, Optional, Set, Tuple
 from ast_nodes import (
-    ASTNode, Program, Assign, Print, If, While,
-    BinOp, Number, Var, Statement, Expression
+    ASTNode, Program, Assign, Print, If, While, For,
+    FunctionDef, Return, ExprStmt, BinOp, Number, String, Var, Call, Index, IndexAssign,
+    Statement, Expression, assigned_names
 )
+from semantic import INT, BOOL, STR, ARRAY
+
+
+# Operators whose loop-invariant uses may be hoisted (comparisons stay put so
+# that loop conditions still compile to fused compare-and-branch opcodes)
+HOISTABLE_OPS = {"+", "-", "*", "/"}
+
+# Prefix of compiler-generated variables; the lexer never produces it, so
+# temporaries cannot collide with user names
+TEMP_PREFIX = "$"
+
+# Operators that stay equivalent with their operands swapped (comparisons mirror)
+COMMUTED = {"+": "+", "*": "*", "<": ">", ">": "<", "<=": ">=", ">=": "<=", "==": "==", "!=": "!="}
+
+COMPARISONS = {"<", ">", "<=", ">=", "==", "!="}
+
+# Ordering comparisons and the comparison that holds when they are false
+NEGATED = {"<": ">=", ">=": "<", ">": "<=", "<=": ">"}
+
+# Instructions an induction variable update costs each iteration (load, load, add, store)
+INDUCTION_UPDATE_COST = 4
+
+# Copies of a counted loop's body per iteration of the unrolled loop, and the
+# most AST nodes the copies together may take
+UNROLL_FACTOR = 4
+UNROLL_BUDGET = 64
+
+# Builtins that can neither fail nor have side effects (an array's length
+# only changes when its name is rebound)
+PURE_BUILTINS = {"len"}
+
+# Longest string a concatenation of constants folds to; longer ones are
+# built at run time instead of being stored in the constant table
+MAX_FOLDED_STRING = 256
+
+# Widest int a fold produces, matching MAX_INT_BITS in the VMs; a wider result
+# is left to fail at run time
+MAX_FOLDED_INT_BITS = 1 << 19
+
+
+def is_safe(expr: Expression) -> bool:
+    """Whether evaluating expr can neither fail nor have side effects.
+    
+    Calls may print, element loads may be out of bounds, division may fail
+    unless the divisor is a nonzero constant, and a concatenation may be too
+    long.
+    """
+    if isinstance(expr, BinOp):
+        if expr.op == "/" and not (isinstance(expr.right, Number) and expr.right.value != 0):
+            return False
+        if expr.type == STR:
+            return False
+        return is_safe(expr.left) and is_safe(expr.right)
+    if isinstance(expr, Call):
+        return expr.name in PURE_BUILTINS and all(is_safe(arg) for arg in expr.args)
+    return not isinstance(expr, Index)
+
+
+def constant(value, node: BinOp) -> Number:
+    """Number replacing node."""
+    return Number(value, node.line, node.type)
+
+
+def is_constant(expr: Expression) -> bool:
+    """Whether expr is an int literal."""
+    return isinstance(expr, Number) and not isinstance(expr.value, bool)
+
+
+def same_var(a: Expression, b: Expression) -> bool:
+    """Whether a and b read the same variable."""
+    return isinstance(a, Var) and isinstance(b, Var) and a.name == b.name
+
+
+# Algebraic rewrite rules. Each takes a BinOp whose operands are already
+# simplified and returns a replacement, or None when it does not apply.
+# Operands are all ints (bindings and literals are integers), so the integer
+# identities below are exact.
+
+def constant_to_right(node: BinOp) -> Optional[Expression]:
+    """c op x -> x op' c, so the other rules only look for constants on the right."""
+    if node.op in COMMUTED and is_constant(node.left) and not is_constant(node.right):
+        return BinOp(node.right, COMMUTED[node.op], node.left, node.line, node.type)
+    return None
+
+
+def add_zero(node: BinOp) -> Optional[Expression]:
+    """x + 0 -> x"""
+    if is_constant(node.right) and node.right.value == 0:
+        return node.left
+    return None
+
+
+def subtract_constant(node: BinOp) -> Optional[Expression]:
+    """x - c -> x + (-c), so constants only ever cluster under +"""
+    if is_constant(node.right):
+        return BinOp(node.left, "+", constant(-node.right.value, node), node.line, node.type)
+    return None
+
+
+def subtract_self(node: BinOp) -> Optional[Expression]:
+    """x - x -> 0"""
+    if same_var(node.left, node.right):
+        return constant(0, node)
+    return None
+
+
+def multiply_identity(node: BinOp) -> Optional[Expression]:
+    """x * 1 -> x, and x * 0 -> 0 when x has no effects"""
+    if is_constant(node.right) and node.right.value == 1:
+        return node.left
+    if is_constant(node.right) and node.right.value == 0 and is_safe(node.left):
+        return constant(0, node)
+    return None
+
+
+def multiply_by_two(node: BinOp) -> Optional[Expression]:
+    """x * 2 -> x + x for a variable (an add is cheaper than a multiply)"""
+    if isinstance(node.left, Var) and is_constant(node.right) and node.right.value == 2:
+        return BinOp(node.left, "+", node.left, node.line, node.type)
+    return None
+
+
+def divide_by_one(node: BinOp) -> Optional[Expression]:
+    """x / 1 -> x"""
+    if is_constant(node.right) and node.right.value == 1:
+        return node.left
+    return None
+
+
+def reassociate(node: BinOp) -> Optional[Expression]:
+    """(x + c1) + c2 -> x + (c1 + c2), likewise for *, and for / with positive divisors"""
+    left = node.left
+    if not (isinstance(left, BinOp) and left.op == node.op and
+            is_constant(left.right) and is_constant(node.right)):
+        return None
+    c1, c2 = left.right.value, node.right.value
+    if node.op == "+":
+        combined = c1 + c2
+    elif node.op == "*":
+        combined = c1 * c2
+    elif c1 > 0 and c2 > 0:
+        combined = c1 * c2  # Floor division nests: (x / a) / b == x / (a * b)
+    else:
+        return None
+    return BinOp(left.left, node.op, constant(combined, left), node.line, node.type)
+
+
+def compare_offset(node: BinOp) -> Optional[Expression]:
+    """x + c1 < c2 -> x < c2 - c1 (for every comparison)"""
+    left = node.left
+    if isinstance(left, BinOp) and left.op == "+" and is_constant(left.right) and is_constant(node.right):
+        return BinOp(left.left, node.op, constant(node.right.value - left.right.value, left),
+                     node.line, node.type)
+    return None
+
+
+def compare_self(node: BinOp) -> Optional[Expression]:
+    """x == x -> True, x < x -> False, and so on"""
+    if same_var(node.left, node.right):
+        return constant(node.op in ("==", "<=", ">="), node)
+    return None
+
+
+ALGEBRAIC_RULES = {
+    "+": [constant_to_right, add_zero, reassociate],
+    "-": [subtract_constant, subtract_self],
+    "*": [constant_to_right, multiply_identity, reassociate, multiply_by_two],
+    "/": [divide_by_one, reassociate],
+}
+for _op in COMPARISONS:
+    ALGEBRAIC_RULES[_op] = [constant_to_right, compare_offset, compare_self]
+
+# Bound on rewrites of one node, in case two rules ever undo each other
+MAX_REWRITES = 16
 
 
 class Optimizer:
     """Performs constant folding and simple optimizations."""
     
+    def __init__(self, unroll_factor: int = UNROLL_FACTOR, unroll_budget: int = UNROLL_BUDGET):
+        self.unroll_factor = unroll_factor
+        self.unroll_budget = unroll_budget
+        self.temp_count = 0
+        # Variables known to hold a constant (Number) or to equal another
+        # variable (Var) at the current point of the statement walk
+        self.env = {}
+        # Function name -> globals it may read, including through its callees
+        self.function_reads = {}
+    
     def optimize(self, node: ASTNode) -> ASTNode:
         """Optimize an AST node."""
         if isinstance(node, Program):
             return self.optimize_program(node)
         elif isinstance(node, Assign):
             return self.optimize_assign(node)
+        elif isinstance(node, IndexAssign):
+            return IndexAssign(self.optimize(node.array), self.optimize(node.index),
+                               self.optimize(node.expr), node.line, node.checked)
         elif isinstance(node, Print):
             return self.optimize_print(node)
         elif isinstance(node, If):
             return self.optimize_if(node)
         elif isinstance(node, While):
             return self.optimize_while(node)
+        elif isinstance(node, For):
+            return self.optimize_for(node)
+        elif isinstance(node, FunctionDef):
+            return self.optimize_function_def(node)
+        elif isinstance(node, Return):
+            return Return(self.optimize(node.expr), node.line)
+        elif isinstance(node, ExprStmt):
+            return ExprStmt(self.optimize(node.expr), node.line)
         elif isinstance(node, BinOp):
             return self.optimize_binop(node)
+        elif isinstance(node, Var):
+            return self.optimize_var(node)
+        elif isinstance(node, Call):
+            return Call(node.name, [self.optimize(arg) for arg in node.args], node.line, node.type)
+        elif isinstance(node, Index):
+            return Index(self.optimize(node.array), self.optimize(node.index), node.line, node.type, node.checked)
         else:
             return node
     
     def optimize_program(self, node: Program) -> Program:
         """Optimize a program."""
-        optimized_statements = [self.optimize(stmt) for stmt in node.statements]
+        self.env = {}
+        optimized_statements = self.optimize_block(node.statements)
+        # The globals left at exit are the program's result (VM.run returns
+        # them), so only stores overwritten before a read and compiler
+        # temporaries can go at top level
+        result = {name for name in assigned_names(optimized_statements)
+                  if not name.startswith(TEMP_PREFIX)}
+        optimized_statements, _ = self.eliminate_dead_stores(optimized_statements, result)
+        optimized_statements = self.eliminate_common_subexpressions(optimized_statements)
+        optimized_statements = self.eliminate_bounds_checks(optimized_statements)
         return Program(optimized_statements)
     
+    def optimize_block(self, statements: List[Statement]) -> List[Statement]:
+        """Optimize a statement list, hoisting loop invariants in front of loops."""
+        optimized = []
+        for stmt in statements:
+            # A while loop's counter must be known to start at 0 to vectorize it
+            entry_env = dict(self.env) if isinstance(stmt, While) else {}
+            if isinstance(stmt, While):
+                # Matched before optimizing, so the closed form is optimized
+                # with what is known on entry to the loop
+                closed = self.evaluate_closed_form(stmt)
+                if closed is not None:
+                    result = self.optimize(closed)
+                    if isinstance(result.cond, Number):
+                        optimized.extend(result.then_body if result.cond.value else [])
+                    else:
+                        optimized.append(result)
+                    continue
+            result = self.optimize(stmt)
+            if isinstance(result, (While, For)):
+                vectorized = self.vectorize_loop(result, entry_env)
+                if vectorized is not None:
+                    optimized.extend(vectorized)
+                    continue
+            if isinstance(result, While):
+                *setup, result = self.reduce_induction_variables(result)
+                optimized.extend(setup)
+            if isinstance(result, (While, For)):
+                *setup, result = self.hoist_invariants(result)
+                optimized.extend(setup)
+            if isinstance(result, While):
+                optimized.extend(self.unroll_loop(result))
+            else:
+                optimized.append(result)
+        return optimized
+    
     def optimize_assign(self, node: Assign) -> Assign:
         """Optimize assignment."""
         optimized_expr = self.optimize(node.expr)
+        self.kill([node.name])
+        if isinstance(optimized_expr, (Number, String)) or \
+           (isinstance(optimized_expr, Var) and optimized_expr.name != node.name):
+            self.env[node.name] = optimized_expr
         return Assign(node.name, optimized_expr, node.line)
     
     def optimize_print(self, node: Print) -> Print:
@@ -50,69 +300,1129 @@ class Optimizer:
         if isinstance(optimized_cond, Number):
             if optimized_cond.value != 0:  # True
                 # Always take then branch
-                optimized_then = [self.optimize(stmt) for stmt in node.then_body]
+                optimized_then = self.optimize_block(node.then_body)
                 return If(optimized_cond, optimized_then, None, node.line)
             else:  # False
                 # Always take else branch
                 if node.else_body:
-                    optimized_else = [self.optimize(stmt) for stmt in node.else_body]
+                    optimized_else = self.optimize_block(node.else_body)
                     return If(optimized_cond, [], optimized_else, node.line)
                 return If(optimized_cond, [], None, node.line)
         
-        optimized_then = [self.optimize(stmt) for stmt in node.then_body]
-        optimized_else = [self.optimize(stmt) for stmt in node.else_body] if node.else_body else None
+        entry_env = dict(self.env)
+        optimized_then = self.optimize_block(node.then_body)
+        then_env = self.env
+        self.env = entry_env
+        optimized_else = self.optimize_block(node.else_body) if node.else_body else None
+        # Join point: keep only facts that hold after either branch
+        self.env = {name: value for name, value in then_env.items()
+                    if name in self.env and self.same_value(value, self.env[name])}
         return If(optimized_cond, optimized_then, optimized_else, node.line)
     
     def optimize_while(self, node: While) -> While:
         """Optimize while loop."""
+        # The condition and body may run after any number of iterations, so
+        # nothing is known about variables the loop assigns
+        entry_env = dict(self.env)
+        self.kill(assigned_names(node.body))
         optimized_cond = self.optimize(node.cond)
         
         # Constant folding: if condition is always false, remove loop
         if isinstance(optimized_cond, Number) and optimized_cond.value == 0:
+            self.env = entry_env
             return While(optimized_cond, [], node.line)
         
-        optimized_body = [self.optimize(stmt) for stmt in node.body]
+        loop_env = dict(self.env)
+        optimized_body = self.optimize_block(node.body)
+        self.env = loop_env
         return While(optimized_cond, optimized_body, node.line)
     
+    def optimize_for(self, node: For) -> For:
+        """Optimize counting loop."""
+        start, stop, step = self.optimize(node.start), self.optimize(node.stop), self.optimize(node.step)
+        self.kill(assigned_names([node]))
+        loop_env = dict(self.env)
+        optimized_body = self.optimize_block(node.body)
+        self.env = loop_env
+        return For(node.var, start, stop, step, optimized_body, node.line)
+    
+    def optimize_function_def(self, node: FunctionDef) -> FunctionDef:
+        """Optimize function body."""
+        # Globals may change between calls, and assignments here are locals
+        outer_env = self.env
+        self.env = {}
+        optimized_body = self.optimize_block(node.body)
+        self.env = outer_env
+        optimized_body, _ = self.eliminate_dead_stores(optimized_body, set())
+        optimized_body = self.eliminate_common_subexpressions(optimized_body)
+        optimized_body = self.eliminate_bounds_checks(optimized_body)
+        
+        local_names = set(node.params) | set(assigned_names(optimized_body))
+        reads = set()
+        for stmt in optimized_body:
+            self.rewrite_statement(stmt, lambda expr: reads.update(self.reads(expr)) or expr)
+        self.function_reads[node.name] = reads - local_names
+        return FunctionDef(node.name, node.params, node.param_types, node.return_type,
+                           optimized_body, node.line)
+    
+    def optimize_var(self, node: Var) -> Expression:
+        """Replace a variable with its known constant or the variable it copies."""
+        value = self.env.get(node.name)
+        if isinstance(value, Number):
+            return Number(value.value, node.line, node.type)
+        elif isinstance(value, String):
+            return String(value.value, node.line, node.type)
+        elif isinstance(value, Var):
+            return Var(value.name, node.line, node.type)
+        return node
+    
+    def kill(self, names: List[str]) -> None:
+        """Forget what is known about names and about copies of them."""
+        for name in names:
+            self.env.pop(name, None)
+        for name, value in list(self.env.items()):
+            if isinstance(value, Var) and value.name in names:
+                del self.env[name]
+    
+    def same_value(self, a: Expression, b: Expression) -> bool:
+        """Whether two propagated values are the same constant or variable."""
+        if isinstance(a, (Number, String)) and isinstance(b, (Number, String)):
+            # True == 1 in Python, but bools and ints are different constants
+            return type(a.value) is type(b.value) and a.value == b.value
+        if isinstance(a, Var) and isinstance(b, Var):
+            return a.name == b.name
+        return False
+    
+    def evaluate_closed_form(self, loop: While) -> Optional[If]:
+        """Replace a loop by the values it leaves behind (scalar evolution).
+        
+        The loop must step a basic induction variable i = i + c up to an
+        invariant bound with < or <= (down with > or >=), and its body may only
+        assign, each variable once. Every other variable is an accumulator
+        s = s + e (s added to the other terms) or a value t = e, where e is a
+        polynomial of degree at most two in i over variables the loop does not
+        assign. With i written as
+        i0 + c * k in iteration k, summing e over the trip count T gives the
+        accumulator's final value, and a value is e in the last iteration:
+        
+            if cond: T = ...; s = s + sum; t = ...; i = i + c * T
+        
+        so the work no longer depends on how often the loop would have run.
+        """
+        names = [stmt.name for stmt in loop.body if isinstance(stmt, Assign)]
+        if not names or len(names) != len(loop.body) or len(set(names)) != len(names):
+            return None
+        # Strings only concatenate, which has no closed form
+        if any(stmt.expr.type == STR for stmt in loop.body):
+            return None
+        assigned = set(names)
+        cond = loop.cond
+        if not (isinstance(cond, BinOp) and cond.op in ("<", "<=", ">", ">=")):
+            return None
+        if isinstance(cond.right, Var) and cond.right.name in assigned:
+            counter, op, bound = cond.right.name, COMMUTED[cond.op], cond.left
+        elif isinstance(cond.left, Var):
+            counter, op, bound = cond.left.name, cond.op, cond.right
+        else:
+            return None
+        if counter not in assigned or not self.is_invariant(bound, assigned):
+            return None
+        update = loop.body[names.index(counter)].expr
+        step = None
+        if isinstance(update, BinOp) and update.op in ("+", "-") and \
+           same_var(update.left, Var(counter)) and is_constant(update.right):
+            step = update.right.value if update.op == "+" else -update.right.value
+        elif isinstance(update, BinOp) and update.op == "+" and \
+             same_var(update.right, Var(counter)) and is_constant(update.left):
+            step = update.left.value
+        # Stepping away from the bound (or not at all) never terminates
+        if not step or (step > 0) != (op in ("<", "<=")):
+            return None
+        line, int_type = loop.line, update.type
+        
+        def number(value):
+            return Number(value, line, int_type)
+        
+        def var(name):
+            return Var(name, line, int_type)
+        
+        def binop(left, operator, right):
+            return BinOp(left, operator, right, line, int_type)
+        
+        # Polynomials in the iteration number k, as lists of coefficients
+        def add(p, q, operator):
+            size = max(len(p), len(q))
+            p = p + [number(0)] * (size - len(p))
+            q = q + [number(0)] * (size - len(q))
+            return [binop(a, operator, b) for a, b in zip(p, q)]
+        
+        def multiply(p, q):
+            if len(p) + len(q) > 4:
+                return None
+            product = [number(0)] * (len(p) + len(q) - 1)
+            for i, a in enumerate(p):
+                for j, b in enumerate(q):
+                    product[i + j] = binop(product[i + j], "+", binop(a, "*", b))
+            return product
+        
+        def evolution(expr, counter_value):
+            """expr as a polynomial in k, or None."""
+            if is_constant(expr):
+                return [expr]
+            if isinstance(expr, Var):
+                if expr.name == counter:
+                    return counter_value
+                return None if expr.name in assigned else [expr]
+            if isinstance(expr, BinOp) and expr.op in ("+", "-", "*"):
+                left, right = evolution(expr.left, counter_value), evolution(expr.right, counter_value)
+                if left is None or right is None:
+                    return None
+                return multiply(left, right) if expr.op == "*" else add(left, right, expr.op)
+            return None
+        
+        def without(expr, name):
+            """expr - name when expr adds name to other terms, else None."""
+            if same_var(expr, Var(name)):
+                return number(0)
+            if isinstance(expr, BinOp) and expr.op in ("+", "-"):
+                left = without(expr.left, name)
+                if left is not None:
+                    return binop(left, expr.op, expr.right)
+                right = without(expr.right, name) if expr.op == "+" else None
+                if right is not None:
+                    return binop(expr.left, "+", right)
+            return None
+        
+        before = [var(counter), number(step)]
+        after = [binop(var(counter), "+", number(step)), number(step)]
+        updated = False
+        evolutions = []
+        for stmt in loop.body:
+            if stmt.name == counter:
+                updated = True
+                continue
+            increment = without(stmt.expr, stmt.name)
+            poly = evolution(stmt.expr if increment is None else increment, after if updated else before)
+            if poly is None:
+                return None
+            evolutions.append((stmt, increment is not None, poly))
+        
+        trips = var(self.new_temp())
+        last = binop(trips, "-", number(1))
+        # Sums of k^0, k^1 and k^2 for k < T (the divisions are exact)
+        sums = [trips,
+                binop(binop(trips, "*", last), "/", number(2)),
+                binop(binop(binop(trips, "*", last), "*",
+                            binop(binop(number(2), "*", trips), "-", number(1))), "/", number(6))]
+        # k^0, k^1 and k^2 in the last iteration
+        powers = [number(1), last, binop(last, "*", last)]
+        
+        def combine(poly, terms):
+            total = number(0)
+            for coefficient, term in zip(poly, terms):
+                total = binop(total, "+", binop(coefficient, "*", term))
+            return total
+        
+        finals = []
+        for stmt, accumulates, poly in evolutions:
+            if accumulates:
+                finals.append(Assign(stmt.name, binop(var(stmt.name), "+", combine(poly, sums)), stmt.line))
+            else:
+                finals.append(Assign(stmt.name, combine(poly, powers), stmt.line))
+        
+        if op in ("<", "<="):
+            distance, size = binop(bound, "-", var(counter)), step
+        else:
+            distance, size = binop(var(counter), "-", bound), -step
+        slack = size - 1 if op in ("<", ">") else size
+        count = binop(binop(distance, "+", number(slack)), "/", number(size))
+        # Every final value reads the counter's value on entry, so it goes last
+        return If(cond, [Assign(trips.name, count, line)] + finals +
+                  [Assign(counter, binop(var(counter), "+", binop(number(step), "*", trips)), line)],
+                  None, line)
+    
+    def reduce_induction_variables(self, loop: While) -> List[Statement]:
+        """Induction-variable strength reduction.
+        
+        A basic induction variable is assigned once per iteration, as
+        i = i + c at the top level of the body. An expression i * k + b over it
+        (k and b invariant) is kept in a temporary that is set before the loop
+        and advanced by c * k after each increment, turning the multiply into
+        an add. It is only done when the uses it replaces cost more than the
+        update.
+        """
+        modified = assigned_names([loop])
+        counts = {}
+        for stmt in self.all_statements(loop.body):
+            if isinstance(stmt, (Assign, For)):
+                name = stmt.name if isinstance(stmt, Assign) else stmt.var
+                counts[name] = counts.get(name, 0) + 1
+        steps = {}
+        for stmt in loop.body:
+            if isinstance(stmt, Assign) and counts[stmt.name] == 1 and \
+               isinstance(stmt.expr, BinOp) and stmt.expr.op == "+" and \
+               same_var(stmt.expr.left, Var(stmt.name)) and is_constant(stmt.expr.right):
+                steps[stmt.name] = stmt.expr.right.value
+        if not steps:
+            return [loop]
+        
+        def invariant(expr):
+            return is_constant(expr) or (isinstance(expr, Var) and expr.name not in modified)
+        
+        def affine(expr):
+            """(variable, k, b) when expr is i * k + b or i * k, else None."""
+            offset = None
+            if isinstance(expr, BinOp) and expr.op == "+" and invariant(expr.right):
+                expr, offset = expr.left, expr.right
+            if isinstance(expr, BinOp) and expr.op == "*" and isinstance(expr.left, Var) and \
+               expr.left.name in steps and invariant(expr.right):
+                return expr.left.name, expr.right, offset
+            return None
+        
+        # Candidate expressions and the instructions their uses would save
+        savings = {}
+        
+        def count(expr):
+            if affine(expr) is not None:
+                saved = 2 if isinstance(expr.left, Var) else 4
+                savings[repr(expr)] = (expr, savings.get(repr(expr), (expr, 0))[1] + saved)
+                return expr
+            if isinstance(expr, BinOp):
+                count(expr.left)
+                count(expr.right)
+            elif isinstance(expr, Call):
+                for arg in expr.args:
+                    count(arg)
+            elif isinstance(expr, Index):
+                count(expr.array)
+                count(expr.index)
+            return expr
+        
+        self.rewrite_statement(loop, count)
+        temps = {key: self.new_temp() for key, (_, saved) in savings.items()
+                 if saved > INDUCTION_UPDATE_COST}
+        if not temps:
+            return [loop]
+        
+        def rewrite(expr):
+            if repr(expr) in temps:
+                return Var(temps[repr(expr)], expr.line, expr.type)
+            if isinstance(expr, BinOp):
+                return BinOp(rewrite(expr.left), expr.op, rewrite(expr.right), expr.line, expr.type)
+            if isinstance(expr, Call):
+                return Call(expr.name, [rewrite(arg) for arg in expr.args], expr.line, expr.type)
+            if isinstance(expr, Index):
+                return Index(rewrite(expr.array), rewrite(expr.index), expr.line, expr.type, expr.checked)
+            return expr
+        
+        loop = self.rewrite_statement(loop, rewrite)
+        setup = []
+        body = []
+        for stmt in loop.body:
+            body.append(stmt)
+            if isinstance(stmt, Assign) and stmt.name in steps:
+                for key, temp in temps.items():
+                    expr = savings[key][0]
+                    name, factor, _ = affine(expr)
+                    if name != stmt.name:
+                        continue
+                    if is_constant(factor):
+                        step = Number(steps[name] * factor.value, expr.line, expr.type)
+                    else:
+                        step = self.simplify(BinOp(factor, "*", Number(steps[name], expr.line, expr.type),
+                                                   expr.line, expr.type))
+                    body.append(Assign(temp, BinOp(Var(temp, expr.line, expr.type), "+", step,
+                                                   expr.line, expr.type), expr.line))
+        for key, temp in temps.items():
+            expr = savings[key][0]
+            setup.append(Assign(temp, expr, expr.line))
+        return setup + [While(loop.cond, body, loop.line)]
+    
+    def unroll_loop(self, loop: While) -> List[Statement]:
+        """Unroll a counted loop, with a remainder loop for the last iterations.
+        
+        The loop must step a basic induction variable i = i + c towards an
+        invariant bound and hold no nested loop. While i is at least U - 1
+        steps from the bound, the next U iterations all run, so
+        
+            while i < n: body
+        
+        becomes
+        
+            while i < n - (U - 1) * c: body; body; ...  (U copies)
+            while i < n: body
+        
+        which tests the condition (and jumps back) once per U iterations. U is
+        the unroll factor, lowered so the copies fit the size budget. When i
+        is read at most once per iteration, the copies read i + k * c instead
+        and only the last one stores i.
+        """
+        if not (isinstance(loop.cond, BinOp) and loop.cond.op in ("<", "<=", ">", ">=") and
+                isinstance(loop.cond.left, Var)):
+            return [loop]
+        counter, bound = loop.cond.left.name, loop.cond.right
+        statements = self.all_statements(loop.body)
+        if any(isinstance(stmt, (While, For)) for stmt in statements) or \
+           not self.is_invariant(bound, set(assigned_names(loop.body))):
+            return [loop]
+        updates = [stmt for stmt in statements if isinstance(stmt, Assign) and stmt.name == counter]
+        if len(updates) != 1 or updates[0] not in loop.body:
+            return [loop]
+        update = updates[0]
+        if not (isinstance(update.expr, BinOp) and update.expr.op == "+" and
+                same_var(update.expr.left, Var(counter)) and is_constant(update.expr.right)):
+            return [loop]
+        step = update.expr.right.value
+        if not step or (step > 0) != (loop.cond.op in ("<", "<=")):
+            return [loop]
+        
+        size = len(statements)
+        uses = 0
+        called = set()
+        
+        def count(expr):
+            nonlocal size, uses
+            size += 1
+            if same_var(expr, Var(counter)):
+                uses += 1
+            elif isinstance(expr, BinOp):
+                count(expr.left)
+                count(expr.right)
+            elif isinstance(expr, Call):
+                called.add(expr.name)
+                for arg in expr.args:
+                    count(arg)
+            elif isinstance(expr, Index):
+                count(expr.array)
+                count(expr.index)
+            return expr
+        
+        for stmt in loop.body:
+            self.rewrite_statement(stmt, count)
+        factor = min(self.unroll_factor, self.unroll_budget // size)
+        if factor < 2:
+            return [loop]
+        uses -= 1  # The update's own read
+        # A called function reading the global i needs every store
+        offsets = 2 * uses < INDUCTION_UPDATE_COST and \
+            not any(counter in self.function_reads.get(name, ()) for name in called)
+        
+        def shift(amount):
+            def rewrite(expr):
+                if same_var(expr, Var(counter)):
+                    return BinOp(expr, "+", Number(amount, expr.line, expr.type), expr.line, expr.type)
+                if isinstance(expr, BinOp):
+                    return BinOp(rewrite(expr.left), expr.op, rewrite(expr.right), expr.line, expr.type)
+                if isinstance(expr, Call):
+                    return Call(expr.name, [rewrite(arg) for arg in expr.args], expr.line, expr.type)
+                if isinstance(expr, Index):
+                    return Index(rewrite(expr.array), rewrite(expr.index), expr.line, expr.type, expr.checked)
+                return expr
+            return rewrite
+        
+        body = []
+        advanced = 0  # Steps i has taken since the top of the unrolled body
+        stored = 0  # Steps stored into i so far
+        for copy in range(factor):
+            for stmt in loop.body:
+                if stmt is update:
+                    advanced += step
+                    if not offsets:
+                        body.append(stmt)
+                    elif copy == factor - 1:
+                        stored = advanced
+                        body.append(Assign(counter, BinOp(update.expr.left, "+",
+                                                          constant(advanced, update.expr.right),
+                                                          update.expr.line, update.expr.type), stmt.line))
+                elif offsets and advanced != stored:
+                    body.append(self.rewrite_statement(stmt, shift(advanced - stored)))
+                else:
+                    body.append(stmt)
+        
+        setup = []
+        margin = (factor - 1) * step
+        if is_constant(bound):
+            limit = constant(bound.value - margin, bound)
+        else:
+            limit = Var(self.new_temp(), bound.line, bound.type)
+            setup.append(Assign(limit.name, BinOp(bound, "-", constant(margin, bound), bound.line, bound.type),
+                                bound.line))
+        cond = BinOp(loop.cond.left, loop.cond.op, limit, loop.cond.line, loop.cond.type)
+        return setup + [While(cond, body, loop.line), loop]
+    
+    def vectorize_loop(self, loop: Statement, entry_env) -> Optional[List[Statement]]:
+        """Replace a loop over a whole array by an array builtin (a SIMD kernel in the C++ VM).
+        
+        The loop must visit each index of an array x once, in order: for i in
+        range(len(x)), or while i < len(x) with i = i + 1 last and i known to
+        be 0 on entry (entry_env). Its only other statement must be one of
+        
+            s = s + x[i]                 s = s + array_sum(x)
+            if x[i] < k: c = c + 1       c = c + array_count_lt(x, k)
+            if x[i] < m: m = x[i]        m = array_min(x) when that is less (> for max)
+            x[i] = v                     array_fill(x, v)
+            o[i] = p[i] + q[i]           array_add(p, q, o)
+        
+        where k and v cannot fail and the loop does not change them (other
+        comparisons count below k + 1, or subtract the count from len(x)).
+        Anything else, a print or a store at another index included, keeps
+        the loop. array_add() needs arrays of one length, so the loop stays for
+        the other lengths; which arrays alias does not matter, since every
+        iteration reads and writes index i only. i ends as the loop leaves it.
+        """
+        if isinstance(loop, For):
+            if not (is_constant(loop.start) and loop.start.value == 0 and
+                    is_constant(loop.step) and loop.step.value == 1 and len(loop.body) == 1):
+                return None
+            counter, length = loop.var, loop.stop
+        elif isinstance(loop, While):
+            cond, update = loop.cond, loop.body[-1]
+            if not (isinstance(cond, BinOp) and cond.op == "<" and isinstance(cond.left, Var) and
+                    len(loop.body) == 2 and isinstance(update, Assign) and update.name == cond.left.name):
+                return None
+            counter, length, start = cond.left.name, cond.right, entry_env.get(cond.left.name)
+            if not (is_constant(start) and start.value == 0 and isinstance(update.expr, BinOp) and
+                    update.expr.op == "+" and same_var(update.expr.left, Var(counter)) and
+                    is_constant(update.expr.right) and update.expr.right.value == 1):
+                return None
+        else:
+            return None
+        if not (isinstance(length, Call) and length.name == "len" and isinstance(length.args[0], Var)) or \
+           length.args[0].name == counter:
+            return None
+        array, body, line = length.args[0], loop.body[0], loop.line
+        
+        def element(expr):
+            """The array expr indexes at i, or None."""
+            if isinstance(expr, Index) and isinstance(expr.array, Var) and same_var(expr.index, Var(counter)):
+                return expr.array
+            return None
+        
+        def invariant(expr, *names):
+            return is_safe(expr) and not (self.reads(expr) & {counter, *names})
+        
+        def binop(left, operator, right, node_type=INT):
+            return BinOp(left, operator, right, line, node_type)
+        
+        def call(name, *args):
+            return Call(name, list(args), line, ARRAY if name in ("array_fill", "array_add") else INT)
+        
+        def size(name):
+            return call("len", name)
+        
+        def accumulate(stmt):
+            """(s, e) for s = s + e or s = e + s."""
+            if isinstance(stmt, Assign) and isinstance(stmt.expr, BinOp) and stmt.expr.op == "+":
+                if same_var(stmt.expr.left, Var(stmt.name)):
+                    return stmt.name, stmt.expr.right
+                if same_var(stmt.expr.right, Var(stmt.name)):
+                    return stmt.name, stmt.expr.left
+            return None, None
+        
+        def accumulator(name):
+            return Var(name, line, INT)
+        
+        vector, arrays = None, []
+        total, term = accumulate(body)
+        if total not in (None, counter, array.name) and same_var(element(term), array):
+            vector = [Assign(total, binop(accumulator(total), "+", call("array_sum", array)), body.line)]
+        elif isinstance(body, If) and not body.else_body and len(body.then_body) == 1 and \
+             isinstance(body.cond, BinOp) and body.cond.op in NEGATED:
+            op, left, right = body.cond.op, body.cond.left, body.cond.right
+            if not same_var(element(left), array):
+                op, left, right = COMMUTED[op], right, left
+            then = body.then_body[0]
+            count, one = accumulate(then)
+            if not same_var(element(left), array):
+                pass
+            elif count not in (None, counter, array.name) and is_constant(one) and one.value == 1 and \
+                 invariant(right, count):
+                # x[i] <= k and x[i] > k compare with k + 1
+                limit = binop(right, "+", Number(1, line, INT)) if op in ("<=", ">") else right
+                counted = call("array_count_lt", array, limit)
+                if op in (">", ">="):
+                    counted = binop(size(array), "-", counted)
+                vector = [Assign(count, binop(accumulator(count), "+", counted), then.line)]
+            elif isinstance(then, Assign) and then.name not in (counter, array.name) and \
+                 same_var(right, Var(then.name)) and same_var(element(then.expr), array) and op in ("<", ">"):
+                best = Var(self.new_temp(), line, INT)
+                vector = [Assign(best.name, call("array_min" if op == "<" else "array_max", array), then.line),
+                          If(binop(best, op, accumulator(then.name), body.cond.type), [Assign(then.name, best, then.line)],
+                             None, body.line)]
+        elif isinstance(body, IndexAssign) and isinstance(body.array, Var) and same_var(body.index, Var(counter)):
+            target = body.array
+            if same_var(target, array) and invariant(body.expr):
+                vector = [ExprStmt(call("array_fill", target, body.expr), body.line)]
+            elif isinstance(body.expr, BinOp) and body.expr.op == "+" and \
+                 element(body.expr.left) is not None and element(body.expr.right) is not None:
+                left, right = element(body.expr.left), element(body.expr.right)
+                vector = [ExprStmt(call("array_add", left, right, target), body.line)]
+                arrays = [other for other in (left, right, target) if other.name != array.name]
+        if vector is None:
+            return None
+        
+        # The loop leaves i at its last index, or unchanged when x is empty
+        nonempty = binop(size(array), ">", Number(0, line, INT), BOOL)
+        if isinstance(loop, For):
+            result = [If(nonempty, vector + [Assign(counter, binop(size(array), "-", Number(1, line, INT)), line)],
+                         None, line)]
+        else:
+            result = [If(nonempty, vector, None, line), Assign(counter, size(array), line)]
+        checked = set()
+        for other in reversed(arrays):
+            if other.name not in checked:
+                checked.add(other.name)
+                result = [If(binop(size(other), "==", size(array), BOOL), result, [loop], line)]
+        return result
+    
+    def all_statements(self, statements: List[Statement]) -> List[Statement]:
+        """Every statement in a statement list, nested ones included."""
+        found = []
+        for stmt in statements:
+            found.append(stmt)
+            if isinstance(stmt, If):
+                found.extend(self.all_statements(stmt.then_body))
+                found.extend(self.all_statements(stmt.else_body or []))
+            elif isinstance(stmt, (While, For)):
+                found.extend(self.all_statements(stmt.body))
+        return found
+    
+    def hoist_invariants(self, loop: Statement) -> List[Statement]:
+        """Loop-invariant code motion.
+        
+        Arithmetic over variables the loop never assigns is computed once into
+        a temporary before the loop. Only expressions that cannot fail and have
+        no side effects move, since the loop may run zero times and the hoisted
+        code runs unconditionally.
+        """
+        modified = set(assigned_names([loop]))
+        
+        # Temporaries hoisted out of inner loops move further out when they can
+        moved = []
+        for stmt in loop.body:
+            if isinstance(stmt, Assign) and stmt.name.startswith(TEMP_PREFIX) and \
+               self.is_invariant(stmt.expr, modified):
+                moved.append(stmt)
+                modified.discard(stmt.name)
+        if moved:
+            body = [stmt for stmt in loop.body if stmt not in moved]
+            if isinstance(loop, For):
+                loop = For(loop.var, loop.start, loop.stop, loop.step, body, loop.line)
+            else:
+                loop = While(loop.cond, body, loop.line)
+        
+        hoisted = []  # (expression, temporary) in evaluation order
+        temps = {}  # Structural form (repr ignores lines) -> temporary
+        
+        def rewrite(expr: Expression) -> Expression:
+            # Bottom-up, so a hoisted expression reuses temporaries of its parts
+            if isinstance(expr, Call):
+                return Call(expr.name, [rewrite(arg) for arg in expr.args], expr.line, expr.type)
+            if isinstance(expr, Index):
+                return Index(rewrite(expr.array), rewrite(expr.index), expr.line, expr.type, expr.checked)
+            if not isinstance(expr, BinOp):
+                return expr
+            expr = BinOp(rewrite(expr.left), expr.op, rewrite(expr.right), expr.line, expr.type)
+            if expr.op not in HOISTABLE_OPS or not self.is_invariant(expr, modified):
+                return expr
+            key = repr(expr)
+            if key not in temps:
+                temps[key] = self.new_temp()
+                hoisted.append((expr, temps[key]))
+            return Var(temps[key], expr.line, expr.type)
+        
+        if isinstance(loop, For):
+            # The range bounds are evaluated once already
+            body = [self.rewrite_statement(stmt, rewrite) for stmt in loop.body]
+            loop = For(loop.var, loop.start, loop.stop, loop.step, body, loop.line)
+        else:
+            loop = self.rewrite_statement(loop, rewrite)
+        return moved + [Assign(temp, expr, expr.line) for expr, temp in hoisted] + [loop]
+    
+    def eliminate_dead_stores(self, statements: List[Statement],
+                              live: Set[str]) -> Tuple[List[Statement], Set[str]]:
+        """Drop assignments whose value is never read (backward liveness).
+        
+        live holds the names read after the statements; returns the surviving
+        statements and the names live before them. A dead assignment whose
+        expression may fail or print is kept as an expression statement.
+        """
+        live = set(live)
+        result = []
+        for stmt in reversed(statements):
+            if isinstance(stmt, Assign):
+                if stmt.name in live:
+                    live.discard(stmt.name)
+                elif is_safe(stmt.expr):
+                    continue
+                else:
+                    stmt = ExprStmt(stmt.expr, stmt.line)
+                live |= self.reads(stmt.expr)
+            elif isinstance(stmt, If):
+                then_body, then_live = self.eliminate_dead_stores(stmt.then_body, live)
+                else_body, else_live = self.eliminate_dead_stores(stmt.else_body or [], live)
+                if not then_body and not else_body and is_safe(stmt.cond):
+                    continue
+                stmt = If(stmt.cond, then_body, else_body or None, stmt.line)
+                live = then_live | else_live | self.reads(stmt.cond)
+            elif isinstance(stmt, While):
+                # Iterate to the names live at the loop head
+                head = live | self.reads(stmt.cond)
+                while True:
+                    _, body_live = self.eliminate_dead_stores(stmt.body, head)
+                    if body_live <= head:
+                        break
+                    head |= body_live
+                body, _ = self.eliminate_dead_stores(stmt.body, head)
+                stmt = While(stmt.cond, body, stmt.line)
+                live = head
+            elif isinstance(stmt, For):
+                # FOR_RANGE assigns the loop variable before every iteration
+                head = set(live)
+                while True:
+                    _, body_live = self.eliminate_dead_stores(stmt.body, head)
+                    body_live.discard(stmt.var)
+                    if body_live <= head:
+                        break
+                    head |= body_live
+                body, _ = self.eliminate_dead_stores(stmt.body, head)
+                stmt = For(stmt.var, stmt.start, stmt.stop, stmt.step, body, stmt.line)
+                live = head | self.reads(stmt.start) | self.reads(stmt.stop) | self.reads(stmt.step)
+            elif isinstance(stmt, Return):
+                live = self.reads(stmt.expr)
+            elif isinstance(stmt, (Print, ExprStmt)):
+                live |= self.reads(stmt.expr)
+            elif isinstance(stmt, IndexAssign):
+                live |= self.reads(stmt.array) | self.reads(stmt.index) | self.reads(stmt.expr)
+            result.append(stmt)
+        result.reverse()
+        return result, live
+    
+    def eliminate_common_subexpressions(self, statements: List[Statement]) -> List[Statement]:
+        """Compute arithmetic repeated over unchanged operands once, into a temporary.
+        
+        An occurrence of a safe arithmetic expression is available to later
+        ones until a variable it reads is assigned. Expressions seen before an
+        if or a loop stay available inside it (those the loop assigns are
+        dropped first), but ones first seen inside are not available after,
+        so every reuse is dominated by the temporary's assignment, which goes
+        just before the statement holding the first occurrence. A while
+        condition only reuses, since it runs again every iteration. Larger
+        expressions are chosen first, and only when the uses it saves cost
+        more than the store and loads ((n - 1) * size > n + 1 for n uses).
+        """
+        def size(expr):
+            if isinstance(expr, BinOp):
+                return 1 + size(expr.left) + size(expr.right)
+            return 1
+        
+        def key(expr):
+            """Structural form, with the operands of + and * in a fixed order (not for strings)."""
+            if isinstance(expr, BinOp):
+                left, right = key(expr.left), key(expr.right)
+                if expr.op in COMMUTED and expr.type != STR and right < left:
+                    left, right = right, left
+                return f"({left} {expr.op} {right})"
+            return repr(expr)
+        
+        temps = {}  # id of a replaced occurrence -> temporary
+        inserts = {}  # id of a statement -> windows whose temporary is set before it
+        
+        def rewrite(expr):
+            if id(expr) in temps:
+                return Var(temps[id(expr)], expr.line, expr.type)
+            if isinstance(expr, BinOp):
+                return BinOp(rewrite(expr.left), expr.op, rewrite(expr.right), expr.line, expr.type)
+            if isinstance(expr, Call):
+                return Call(expr.name, [rewrite(arg) for arg in expr.args], expr.line, expr.type)
+            if isinstance(expr, Index):
+                return Index(rewrite(expr.array), rewrite(expr.index), expr.line, expr.type, expr.checked)
+            return expr
+        
+        def rebuild(statements):
+            result = []
+            for stmt in statements:
+                # Inner expressions' temporaries are set first
+                for expr, _, _, temp in sorted(inserts.get(id(stmt), []), key=lambda window: size(window[0])):
+                    result.append(Assign(temp, BinOp(rewrite(expr.left), expr.op, rewrite(expr.right),
+                                                     expr.line, expr.type), expr.line))
+                if isinstance(stmt, If):
+                    stmt = If(rewrite(stmt.cond), rebuild(stmt.then_body),
+                              rebuild(stmt.else_body) if stmt.else_body else stmt.else_body, stmt.line)
+                elif isinstance(stmt, While):
+                    stmt = While(rewrite(stmt.cond), rebuild(stmt.body), stmt.line)
+                elif isinstance(stmt, For):
+                    stmt = For(stmt.var, rewrite(stmt.start), rewrite(stmt.stop), rewrite(stmt.step),
+                               rebuild(stmt.body), stmt.line)
+                elif not isinstance(stmt, FunctionDef):
+                    stmt = self.rewrite_statement(stmt, rewrite)
+                result.append(stmt)
+            return result
+        
+        # Other passes share nodes (unrolled copies, x * 2 -> x + x), so every
+        # occurrence is made a node of its own before they are told apart by id
+        statements = rebuild(statements)
+        windows = []  # [expression, statement of first occurrence, uses] in order found
+        
+        def visit(expr, available, stmt, ancestors, new=True):
+            if isinstance(expr, BinOp):
+                if expr.op in HOISTABLE_OPS and is_safe(expr):
+                    window = available.get(key(expr))
+                    if window is None and new:
+                        window = available[key(expr)] = [expr, stmt, []]
+                        windows.append(window)
+                    if window is not None:
+                        window[2].append((expr, ancestors))
+                visit(expr.left, available, stmt, ancestors | {id(expr)}, new)
+                visit(expr.right, available, stmt, ancestors | {id(expr)}, new)
+            elif isinstance(expr, Call):
+                for arg in expr.args:
+                    visit(arg, available, stmt, ancestors, new)
+            elif isinstance(expr, Index):
+                visit(expr.array, available, stmt, ancestors, new)
+                visit(expr.index, available, stmt, ancestors, new)
+        
+        def kill(available, names):
+            for k, window in list(available.items()):
+                if self.reads(window[0]) & set(names):
+                    del available[k]
+        
+        def scan(statements, available):
+            for stmt in statements:
+                if isinstance(stmt, Assign):
+                    visit(stmt.expr, available, stmt, frozenset())
+                    kill(available, [stmt.name])
+                elif isinstance(stmt, (Print, Return, ExprStmt)):
+                    visit(stmt.expr, available, stmt, frozenset())
+                elif isinstance(stmt, IndexAssign):
+                    for expr in (stmt.expr, stmt.array, stmt.index):
+                        visit(expr, available, stmt, frozenset())
+                elif isinstance(stmt, If):
+                    visit(stmt.cond, available, stmt, frozenset())
+                    scan(stmt.then_body, dict(available))
+                    scan(stmt.else_body or [], dict(available))
+                    kill(available, assigned_names([stmt]))
+                elif isinstance(stmt, While):
+                    kill(available, assigned_names([stmt]))
+                    visit(stmt.cond, available, stmt, frozenset(), new=False)
+                    scan(stmt.body, dict(available))
+                elif isinstance(stmt, For):
+                    for expr in (stmt.start, stmt.stop, stmt.step):
+                        visit(expr, available, stmt, frozenset())
+                    kill(available, assigned_names([stmt]))
+                    scan(stmt.body, dict(available))
+        
+        scan(statements, {})
+        removed = set()  # ids of occurrences no longer evaluated
+        for window in sorted(windows, key=lambda window: -size(window[0])):
+            expr, stmt, uses = window
+            uses = [use for use, ancestors in uses if not ancestors & removed]
+            if not uses or uses[0] is not expr or (len(uses) - 1) * size(expr) <= len(uses) + 1:
+                continue
+            window.append(self.new_temp())
+            for use in uses:
+                temps[id(use)] = window[3]
+            removed.update(id(use) for use in uses[1:])
+            inserts.setdefault(id(stmt), []).append(window)
+        return rebuild(statements) if temps else statements
+    
+    def eliminate_bounds_checks(self, statements: List[Statement]) -> List[Statement]:
+        """Clear the checked flag of element accesses proven to be in bounds.
+        
+        A forward walk tracks facts about variables: an exact value, a lower
+        bound and an exclusive upper bound, each a constant or len(a) plus a
+        constant, and the length of arrays made by array(n) with a constant
+        n. An if or while condition comparing a variable bounds it in the
+        branch or body it guards (and the negation after a loop), for i in
+        range(...) bounds i in the body, and i = i + c shifts i's bounds. A
+        loop first forgets the variables it assigns, except for the lower
+        bound of one only ever increased and the upper bound of one only
+        ever decreased. a[i] needs no check when i's lower bound is at least
+        0 and its upper bound at most len(a).
+        """
+        def shift(bound, amount):
+            return None if bound is None else (bound[0], bound[1] + amount)
+        
+        def offset(expr):
+            """c for expr + c or expr - c, else None."""
+            if isinstance(expr, BinOp) and expr.op in ("+", "-") and is_constant(expr.right):
+                return expr.right.value if expr.op == "+" else -expr.right.value
+            return None
+        
+        def term(expr, facts):
+            """expr's value as (None, c) for a constant or (a, c) for len(a) + c, or None."""
+            if is_constant(expr):
+                return None, expr.value
+            if isinstance(expr, Var):
+                return facts.get(("value", expr.name))
+            if isinstance(expr, Call) and expr.name == "len" and isinstance(expr.args[0], Var):
+                length = facts.get(("length", expr.args[0].name))
+                return (expr.args[0].name, 0) if length is None else (None, length)
+            if offset(expr) is not None:
+                return shift(term(expr.left, facts), offset(expr))
+            return None
+        
+        def interval(expr, facts):
+            """(lower, upper) with lower <= expr < upper; either may be None."""
+            value = term(expr, facts)
+            if value is not None:
+                # len(a) is never negative
+                return value[1], shift(value, 1)
+            if isinstance(expr, Var):
+                return facts.get(("low", expr.name)), facts.get(("high", expr.name))
+            if offset(expr) is not None:
+                low, high = interval(expr.left, facts)
+                return (None if low is None else low + offset(expr)), shift(high, offset(expr))
+            return None, None
+        
+        def in_bounds(array, index, facts):
+            if not isinstance(array, Var):
+                return False
+            low, high = interval(index, facts)
+            if low is None or low < 0 or high is None:
+                return False
+            if high[0] is None:
+                length = facts.get(("length", array.name))
+                return length is not None and high[1] <= length
+            return high[0] == array.name and high[1] <= 0
+        
+        def mark(facts):
+            def rewrite(expr):
+                if isinstance(expr, BinOp):
+                    return BinOp(rewrite(expr.left), expr.op, rewrite(expr.right), expr.line, expr.type)
+                if isinstance(expr, Call):
+                    return Call(expr.name, [rewrite(arg) for arg in expr.args], expr.line, expr.type)
+                if isinstance(expr, Index):
+                    return Index(rewrite(expr.array), rewrite(expr.index), expr.line, expr.type,
+                                 expr.checked and not in_bounds(expr.array, expr.index, facts))
+                return expr
+            return rewrite
+        
+        def kill(facts, name):
+            """Forget facts about name, and bounds on the length of an array it held."""
+            for key, fact in list(facts.items()):
+                if key[1] == name or (isinstance(fact, tuple) and fact[0] == name):
+                    del facts[key]
+        
+        def bound(facts, name, low, high):
+            """Record low <= name < high, keeping tighter bounds already known."""
+            if low is not None:
+                facts[("low", name)] = max(low, facts.get(("low", name), low))
+            old = facts.get(("high", name))
+            if high is not None and high[0] != name and \
+               (old is None or old[0] != high[0] or high[1] < old[1]):
+                facts[("high", name)] = high
+        
+        def assign(facts, stmt):
+            name, expr = stmt.name, stmt.expr
+            if same_var(expr.left if isinstance(expr, BinOp) else None, Var(name)) and \
+               offset(expr) is not None:
+                # Stepping shifts what is known
+                amount = offset(expr)
+                known = {key: facts[key] for key in (("value", name), ("low", name), ("high", name))
+                         if key in facts}
+                kill(facts, name)
+                for key, fact in known.items():
+                    facts[key] = fact + amount if key[0] == "low" else shift(fact, amount)
+                return
+            value = term(expr, facts)
+            low, high = interval(expr, facts)
+            length = None
+            if isinstance(expr, Call) and expr.name == "array" and is_constant(expr.args[0]):
+                length = expr.args[0].value
+            elif isinstance(expr, Var):
+                length = facts.get(("length", expr.name))
+            kill(facts, name)
+            if value is not None and value[0] != name:
+                facts[("value", name)] = value
+            bound(facts, name, low, high)
+            if length is not None:
+                facts[("length", name)] = length
+        
+        def refine(facts, cond, negate=False):
+            """Record the bounds cond (or its negation) puts on a variable it compares."""
+            if not (isinstance(cond, BinOp) and cond.op in NEGATED):
+                return
+            op = NEGATED[cond.op] if negate else cond.op
+            for var, relation, other in ((cond.left, op, cond.right), (cond.right, COMMUTED[op], cond.left)):
+                if not isinstance(var, Var):
+                    continue
+                low, high = interval(other, facts)
+                if relation == "<":
+                    bound(facts, var.name, None, shift(high, -1))
+                elif relation == "<=":
+                    bound(facts, var.name, None, high)
+                elif relation == ">":
+                    bound(facts, var.name, None if low is None else low + 1, None)
+                else:
+                    bound(facts, var.name, low, None)
+        
+        def enter_loop(facts, loop):
+            """Forget what loop assigns, keeping one-sided bounds of variables it only steps one way."""
+            statements = self.all_statements([loop])
+            assigned = assigned_names([loop])
+            for name in assigned:
+                steps = [offset(stmt.expr) if same_var(stmt.expr.left if isinstance(stmt.expr, BinOp) else None,
+                                                       Var(name)) else None
+                         for stmt in statements if isinstance(stmt, Assign) and stmt.name == name]
+                stepped = None not in steps and \
+                    not any(isinstance(stmt, For) and stmt.var == name for stmt in statements)
+                low, high = facts.get(("low", name)), facts.get(("high", name))
+                kill(facts, name)
+                if stepped and low is not None and all(step >= 0 for step in steps):
+                    facts[("low", name)] = low
+                if stepped and high is not None and high[0] not in assigned and all(step <= 0 for step in steps):
+                    facts[("high", name)] = high
+        
+        def join(a, b):
+            """Facts holding after either of two branches."""
+            facts = {key: fact for key, fact in a.items() if b.get(key) == fact}
+            for key, fact in a.items():
+                if key[0] == "low" and key in b:
+                    facts[key] = min(fact, b[key])
+            return facts
+        
+        def walk(statements, facts):
+            result = []
+            for stmt in statements:
+                if isinstance(stmt, Assign):
+                    result.append(self.rewrite_statement(stmt, mark(facts)))
+                    assign(facts, stmt)
+                elif isinstance(stmt, IndexAssign):
+                    stmt = self.rewrite_statement(stmt, mark(facts))
+                    stmt.checked = stmt.checked and not in_bounds(stmt.array, stmt.index, facts)
+                    result.append(stmt)
+                elif isinstance(stmt, If):
+                    cond = mark(facts)(stmt.cond)
+                    then_facts, else_facts = dict(facts), dict(facts)
+                    refine(then_facts, stmt.cond)
+                    refine(else_facts, stmt.cond, negate=True)
+                    then_body = walk(stmt.then_body, then_facts)
+                    else_body = walk(stmt.else_body, else_facts) if stmt.else_body else stmt.else_body
+                    facts.clear()
+                    facts.update(join(then_facts, else_facts))
+                    result.append(If(cond, then_body, else_body, stmt.line))
+                elif isinstance(stmt, While):
+                    enter_loop(facts, stmt)
+                    cond = mark(facts)(stmt.cond)
+                    body_facts = dict(facts)
+                    refine(body_facts, stmt.cond)
+                    body = walk(stmt.body, body_facts)
+                    refine(facts, stmt.cond, negate=True)
+                    result.append(While(cond, body, stmt.line))
+                elif isinstance(stmt, For):
+                    start, stop, step = (mark(facts)(expr) for expr in (stmt.start, stmt.stop, stmt.step))
+                    # The bounds are evaluated once, on entry
+                    low, high = None, None
+                    if is_constant(stmt.step) and stmt.step.value > 0:
+                        low, high = interval(stmt.start, facts)[0], term(stmt.stop, facts)
+                    elif is_constant(stmt.step):
+                        low, high = interval(stmt.stop, facts)[0], interval(stmt.start, facts)[1]
+                        low = None if low is None else low + 1
+                    assigned = assigned_names([stmt])
+                    if high is not None and high[0] in assigned:
+                        high = None
+                    enter_loop(facts, stmt)
+                    body_facts = dict(facts)
+                    bound(body_facts, stmt.var, low, high)
+                    body = walk(stmt.body, body_facts)
+                    result.append(For(stmt.var, start, stop, step, body, stmt.line))
+                elif isinstance(stmt, (Print, Return, ExprStmt)):
+                    result.append(self.rewrite_statement(stmt, mark(facts)))
+                else:
+                    result.append(stmt)
+            return result
+        
+        return walk(statements, {})
+    
+    def reads(self, expr: Expression) -> Set[str]:
+        """Names an expression reads, including globals read by called functions."""
+        if isinstance(expr, Var):
+            return {expr.name}
+        elif isinstance(expr, BinOp):
+            return self.reads(expr.left) | self.reads(expr.right)
+        elif isinstance(expr, Call):
+            names = set(self.function_reads.get(expr.name, ()))
+            for arg in expr.args:
+                names |= self.reads(arg)
+            return names
+        elif isinstance(expr, Index):
+            return self.reads(expr.array) | self.reads(expr.index)
+        return set()
+    
+    def is_invariant(self, expr: Expression, modified: Set[str]) -> bool:
+        """Whether expr reads no modified variable and can be evaluated early."""
+        return is_safe(expr) and not (self.reads(expr) & modified)
+    
+    def rewrite_statement(self, stmt: Statement, rewrite) -> Statement:
+        """Apply rewrite to every expression a statement evaluates."""
+        if isinstance(stmt, Assign):
+            return Assign(stmt.name, rewrite(stmt.expr), stmt.line)
+        elif isinstance(stmt, IndexAssign):
+            return IndexAssign(rewrite(stmt.array), rewrite(stmt.index), rewrite(stmt.expr), stmt.line, stmt.checked)
+        elif isinstance(stmt, Print):
+            return Print(rewrite(stmt.expr), stmt.line)
+        elif isinstance(stmt, If):
+            cond = rewrite(stmt.cond)
+            then_body = [self.rewrite_statement(s, rewrite) for s in stmt.then_body]
+            else_body = [self.rewrite_statement(s, rewrite) for s in stmt.else_body] \
+                if stmt.else_body else stmt.else_body
+            return If(cond, then_body, else_body, stmt.line)
+        elif isinstance(stmt, While):
+            cond = rewrite(stmt.cond)
+            body = [self.rewrite_statement(s, rewrite) for s in stmt.body]
+            return While(cond, body, stmt.line)
+        elif isinstance(stmt, For):
+            start, stop, step = rewrite(stmt.start), rewrite(stmt.stop), rewrite(stmt.step)
+            body = [self.rewrite_statement(s, rewrite) for s in stmt.body]
+            return For(stmt.var, start, stop, step, body, stmt.line)
+        elif isinstance(stmt, Return):
+            return Return(rewrite(stmt.expr), stmt.line)
+        elif isinstance(stmt, ExprStmt):
+            return ExprStmt(rewrite(stmt.expr), stmt.line)
+        return stmt
+    
+    def new_temp(self) -> str:
+        """Fresh compiler-generated variable name."""
+        name = f"{TEMP_PREFIX}t{self.temp_count}"
+        self.temp_count += 1
+        return name
+    
     def optimize_binop(self, node: BinOp) -> Expression:
         """Optimize binary operation with constant folding."""
         left = self.optimize(node.left)
         right = self.optimize(node.right)
         
-        # Constant folding: both operands are numbers
+        # Constant folding: both operands are numbers, or both strings
         if isinstance(left, Number) and isinstance(right, Number):
             result = self.evaluate_constants(left.value, node.op, right.value)
-            if result is not None:
-                return Number(result, node.line)
-        
-        # Simple optimizations
-        if node.op == "+":
-            # x + 0 → x
-            if isinstance(right, Number) and right.value == 0:
-                return left
-            # 0 + x → x
-            if isinstance(left, Number) and left.value == 0:
-                return right
-        elif node.op == "*":
-            # x * 1 → x
-            if isinstance(right, Number) and right.value == 1:
-                return left
-            # 1 * x → x
-            if isinstance(left, Number) and left.value == 1:
-                return right
-            # x * 0 → 0
-            if (isinstance(left, Number) and left.value == 0) or \
-               (isinstance(right, Number) and right.value == 0):
-                return Number(0, node.line)
-        elif node.op == "-":
-            # x - 0 → x
-            if isinstance(right, Number) and right.value == 0:
-                return left
-        
-        return BinOp(left, node.op, right, node.line)
+            if result is not None and not (isinstance(result, int) and result.bit_length() > MAX_FOLDED_INT_BITS):
+                return Number(result, node.line, node.type)
+        if isinstance(left, String) and isinstance(right, String):
+            result = self.evaluate_constants(left.value, node.op, right.value)
+            if isinstance(result, bool):
+                return Number(result, node.line, node.type)
+            if result is not None and len(result) <= MAX_FOLDED_STRING:
+                return String(result, node.line, node.type)
+        
+        return self.simplify(BinOp(left, node.op, right, node.line, node.type))
+    
+    def simplify(self, node: Expression) -> Expression:
+        """Apply ALGEBRAIC_RULES until none matches."""
+        for _ in range(MAX_REWRITES):
+            if not isinstance(node, BinOp):
+                return node
+            for rule in ALGEBRAIC_RULES.get(node.op, ()):
+                result = rule(node)
+                if result is not None:
+                    node = result
+                    break
+            else:
+                return node
+        return node
     
     def evaluate_constants(self, left: int, op: str, right: int) -> Optional[int]:
-        """Evaluate constant expression."""
+        """Evaluate constant expression (comparisons give bools)."""
         try:
             if op == "+":
                 return left + right
@@ -125,17 +1435,17 @@ class Optimizer:
                     return None  # Division by zero
                 return left // right
             elif op == "<":
-                return 1 if left < right else 0
+                return left < right
             elif op == ">":
-                return 1 if left > right else 0
+                return left > right
             elif op == "<=":
-                return 1 if left <= right else 0
+                return left <= right
             elif op == ">=":
-                return 1 if left >= right else 0
+                return left >= right
             elif op == "==":
-                return 1 if left == right else 0
+                return left == right
             elif op == "!=":
-                return 1 if left != right else 0
+                return left != right
         except:
             return None
         return None
@@ -1,13 +1,14 @@
 """Recursive descent parser for MiniPy."""
 
 from lexer import (
-    Token, IDENT, NUMBER, KEYWORD, PLUS, MINUS, MUL, DIV,
-    LT, GT, LE, GE, EQEQ, NEQ, ASSIGN, LPAREN, RPAREN, COLON,
+    Token, IDENT, NUMBER, STRING, KEYWORD, PLUS, MINUS, MUL, DIV,
+    LT, GT, LE, GE, EQEQ, NEQ, ASSIGN, LPAREN, RPAREN, LBRACKET, RBRACKET,
+    COLON, COMMA, ARROW,
     NEWLINE, INDENT, DEDENT, EOF
 )
 from ast_nodes import (
-    Program, Assign, Print, If, While,
-    BinOp, Number, Var
+    Program, Assign, Print, If, While, For, Checkpoint,
+    FunctionDef, Return, ExprStmt, BinOp, Number, String, Var, Call, Index, IndexAssign
 )
 from errors import ParserError, SemanticError
 
@@ -80,13 +81,27 @@ class Parser:
                 return self.parse_if()
             elif token.value == "while":
                 return self.parse_while()
+            elif token.value == "for":
+                return self.parse_for()
             elif token.value == "print":
                 return self.parse_print()
+            elif token.value == "checkpoint":
+                return self.parse_checkpoint()
+            elif token.value == "def":
+                return self.parse_def()
+            elif token.value == "return":
+                return self.parse_return()
         
         if token.type == IDENT:
             # Could be assignment
             if self.peek_token().type == ASSIGN:
                 return self.parse_assignment()
+            # Or a store to an array element
+            if self.peek_token().type == LBRACKET:
+                return self.parse_index_assign()
+            # Or a call whose result is discarded
+            if self.peek_token().type == LPAREN:
+                return ExprStmt(self.parse_call(), token.line)
         
         raise ParserError(
             f"Unexpected token in statement: {token.type}",
@@ -121,6 +136,13 @@ class Parser:
         expr = self.parse_expression()
         return Assign(name, expr, name_token.line)
     
+    def parse_index_assign(self):
+        """Parse element store: name[expression] = expression"""
+        target = self.parse_index()
+        self.expect(ASSIGN)
+        expr = self.parse_expression()
+        return IndexAssign(target.array, target.index, expr, target.line)
+    
     def parse_print(self):
         """Parse print statement: print(expression)"""
         print_token = self.expect(KEYWORD, "print")
@@ -129,6 +151,69 @@ class Parser:
         self.expect(RPAREN)
         return Print(expr, print_token.line)
     
+    def parse_checkpoint(self):
+        """Parse checkpoint statement: checkpoint"""
+        checkpoint_token = self.expect(KEYWORD, "checkpoint")
+        return Checkpoint(checkpoint_token.line)
+    
+    def parse_def(self):
+        """Parse function definition: def name(param[: type], ...) [-> type]: block"""
+        def_token = self.expect(KEYWORD, "def")
+        name = self.expect(IDENT).value
+        self.expect(LPAREN)
+        params = []
+        param_types = []
+        if self.current_token().type != RPAREN:
+            while True:
+                params.append(self.expect(IDENT).value)
+                param_types.append(self.parse_annotation(COLON))
+                if self.current_token().type != COMMA:
+                    break
+                self.advance()
+        self.expect(RPAREN)
+        return_type = self.parse_annotation(ARROW)
+        self.expect(COLON)
+        self.skip_newlines()
+        body = self.parse_block()
+        return FunctionDef(name, params, param_types, return_type, body, def_token.line)
+    
+    def parse_annotation(self, marker):
+        """Parse an optional type annotation introduced by marker (defaults to int)."""
+        if self.current_token().type != marker:
+            return "int"
+        self.advance()
+        token = self.expect(IDENT)
+        if token.value not in ("int", "bool", "str", "array"):
+            raise ParserError(f"Unknown type: {token.value}", token.line, token.col)
+        return token.value
+    
+    def parse_return(self):
+        """Parse return statement: return expression"""
+        return_token = self.expect(KEYWORD, "return")
+        expr = self.parse_expression()
+        return Return(expr, return_token.line)
+    
+    def parse_call(self):
+        """Parse function call: name(expression, ...)"""
+        name_token = self.expect(IDENT)
+        self.expect(LPAREN)
+        args = []
+        if self.current_token().type != RPAREN:
+            args.append(self.parse_expression())
+            while self.current_token().type == COMMA:
+                self.advance()
+                args.append(self.parse_expression())
+        self.expect(RPAREN)
+        return Call(name_token.value, args, name_token.line)
+    
+    def parse_index(self):
+        """Parse element access: name[expression]"""
+        name_token = self.expect(IDENT)
+        self.expect(LBRACKET)
+        index = self.parse_expression()
+        self.expect(RBRACKET)
+        return Index(Var(name_token.value, name_token.line), index, name_token.line)
+    
     def parse_if(self):
         """Parse if statement: if expr: block else: block"""
         if_token = self.expect(KEYWORD, "if")
@@ -155,6 +240,31 @@ class Parser:
         body = self.parse_block()
         return While(cond, body, while_token.line)
     
+    def parse_for(self):
+        """Parse counting loop: for name in range([start,] stop[, step]): block"""
+        for_token = self.expect(KEYWORD, "for")
+        var = self.expect(IDENT).value
+        self.expect(KEYWORD, "in")
+        range_token = self.expect(IDENT, "range")
+        self.expect(LPAREN)
+        args = [self.parse_expression()]
+        while self.current_token().type == COMMA:
+            self.advance()
+            args.append(self.parse_expression())
+        self.expect(RPAREN)
+        if len(args) > 3:
+            raise ParserError("range() takes at most 3 arguments", range_token.line, range_token.col)
+        self.expect(COLON)
+        self.skip_newlines()
+        body = self.parse_block()
+        
+        if len(args) == 1:
+            args.insert(0, Number(0, range_token.line))
+        if len(args) == 2:
+            args.append(Number(1, range_token.line))
+        start, stop, step = args
+        return For(var, start, stop, step, body, for_token.line)
+    
     def parse_expression(self):
         """Parse an expression (comparison level)."""
         left = self.parse_additive()
@@ -226,13 +336,23 @@ class Parser:
         return left
     
     def parse_factor(self):
-        """Parse a factor (number, variable, or parenthesized expression)."""
+        """Parse a factor (number, string, variable, call, element access, or parenthesized expression)."""
         token = self.current_token()
         
         if token.type == NUMBER:
             self.advance()
             return Number(token.value, token.line)
         
+        if token.type == STRING:
+            self.advance()
+            return String(token.value, token.line)
+        
+        if token.type == IDENT and self.peek_token().type == LPAREN:
+            return self.parse_call()
+        
+        if token.type == IDENT and self.peek_token().type == LBRACKET:
+            return self.parse_index()
+        
         if token.type == IDENT:
             name = token.value
             self.advance()
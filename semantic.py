@@ -3,8 +3,9 @@
 from typing import Dict, Optional, List, Set
 from dataclasses import dataclass
 from ast_nodes import (
-    ASTNode, Program, Assign, Print, If, While,
-    BinOp, Number, Var, Statement, Expression
+    ASTNode, Program, Assign, Print, If, While, For, Checkpoint,
+    FunctionDef, Return, ExprStmt, BinOp, Number, String, Var, Call, Index, IndexAssign,
+    Statement, Expression, assigned_names
 )
 from errors import SemanticError
 
@@ -27,6 +28,18 @@ class BoolType(Type):
     pass
 
 
+@dataclass(frozen=True)
+class StrType(Type):
+    """Immutable string."""
+    pass
+
+
+@dataclass(frozen=True)
+class ArrayType(Type):
+    """Fixed-size array of ints."""
+    pass
+
+
 @dataclass(frozen=True)
 class ErrorType(Type):
     """Error type for type checking failures."""
@@ -36,8 +49,13 @@ class ErrorType(Type):
 # Type constants
 INT = IntType()
 BOOL = BoolType()
+STR = StrType()
+ARRAY = ArrayType()
 ERROR = ErrorType()
 
+# Annotation names accepted by the parser
+TYPE_NAMES = {"int": INT, "bool": BOOL, "str": STR, "array": ARRAY}
+
 
 @dataclass
 class VariableInfo:
@@ -48,6 +66,27 @@ class VariableInfo:
     line: int
 
 
+@dataclass
+class FunctionSignature:
+    """Parameter and return types of a function (a builtin's parameter may accept a tuple of types)."""
+    name: str
+    param_types: List[Type]
+    return_type: Type
+
+
+# Functions provided by the language; their names cannot be redefined
+BUILTINS = {
+    "array": FunctionSignature("array", [INT], ARRAY),
+    "len": FunctionSignature("len", [(ARRAY, STR)], INT),
+    "array_sum": FunctionSignature("array_sum", [ARRAY], INT),
+    "array_min": FunctionSignature("array_min", [ARRAY], INT),
+    "array_max": FunctionSignature("array_max", [ARRAY], INT),
+    "array_fill": FunctionSignature("array_fill", [ARRAY, INT], ARRAY),
+    "array_add": FunctionSignature("array_add", [ARRAY, ARRAY, ARRAY], ARRAY),
+    "array_count_lt": FunctionSignature("array_count_lt", [ARRAY, INT], INT),
+}
+
+
 class Scope:
     """Represents a variable scope."""
     
@@ -84,28 +123,60 @@ class Scope:
 class SemanticAnalyzer:
     """Performs semantic analysis and type checking."""
     
-    def __init__(self):
+    def __init__(self, externs: Optional[List[str]] = None):
         self.current_scope: Scope = Scope()
         self.errors: List[SemanticError] = []
+        # Globals bound by the host before the program runs (int-typed)
+        self.externs: List[str] = list(dict.fromkeys(externs)) if externs else []
+        self.functions: Dict[str, FunctionSignature] = {}
+        self.global_scope: Scope = self.current_scope
+        # Set while analyzing a function body
+        self.function: Optional[FunctionSignature] = None
+        self.function_locals: Set[str] = set()
     
     def analyze(self, node: ASTNode) -> Type:
-        """Analyze an AST node and return its type."""
+        """Analyze an AST node and return its type, recording it on expressions."""
         if isinstance(node, Program):
             return self.analyze_program(node)
         elif isinstance(node, Assign):
             return self.analyze_assign(node)
+        elif isinstance(node, IndexAssign):
+            return self.analyze_index_assign(node)
         elif isinstance(node, Print):
             return self.analyze_print(node)
         elif isinstance(node, If):
             return self.analyze_if(node)
         elif isinstance(node, While):
             return self.analyze_while(node)
+        elif isinstance(node, For):
+            return self.analyze_for(node)
+        elif isinstance(node, Checkpoint):
+            return ERROR  # Checkpoint has no type
+        elif isinstance(node, FunctionDef):
+            return self.analyze_function_def(node)
+        elif isinstance(node, Return):
+            return self.analyze_return(node)
+        elif isinstance(node, ExprStmt):
+            self.analyze(node.expr)
+            return ERROR  # The result is discarded
+        elif isinstance(node, Call):
+            node.type = self.analyze_call(node)
+            return node.type
+        elif isinstance(node, Index):
+            node.type = self.analyze_index(node)
+            return node.type
         elif isinstance(node, BinOp):
-            return self.analyze_binop(node)
+            node.type = self.analyze_binop(node)
+            return node.type
         elif isinstance(node, Number):
-            return self.analyze_number(node)
+            node.type = self.analyze_number(node)
+            return node.type
+        elif isinstance(node, String):
+            node.type = STR
+            return node.type
         elif isinstance(node, Var):
-            return self.analyze_var(node)
+            node.type = self.analyze_var(node)
+            return node.type
         else:
             return ERROR
     
@@ -119,6 +190,10 @@ class SemanticAnalyzer:
         """Analyze assignment: check expr type and declare/update variable."""
         expr_type = self.analyze(node.expr)
         
+        if node.name in self.functions:
+            self.errors.append(SemanticError(f"Cannot assign to function '{node.name}'", node.line))
+            return ERROR
+        
         var_info = self.current_scope.lookup(node.name)
         if var_info is None:
             # New variable declaration
@@ -137,6 +212,14 @@ class SemanticAnalyzer:
         
         return expr_type
     
+    def analyze_index_assign(self, node: IndexAssign) -> Type:
+        """Analyze element store: an int stored at an int index of an array."""
+        self.check_index(node.array, node.index, node.line)
+        expr_type = self.analyze(node.expr)
+        if expr_type != INT and expr_type != ERROR:
+            self.errors.append(SemanticError(f"Array elements must be int, got {expr_type}", node.line))
+        return ERROR  # IndexAssign has no type
+    
     def analyze_print(self, node: Print) -> Type:
         """Analyze print statement."""
         expr_type = self.analyze(node.expr)
@@ -187,11 +270,125 @@ class SemanticAnalyzer:
         
         return ERROR  # While has no return type
     
+    def analyze_for(self, node: For) -> Type:
+        """Analyze counting loop: int bounds, and an int loop variable.
+        
+        The loop variable is assigned like any other variable: it must be
+        int if it already exists, and is otherwise declared in the body scope.
+        """
+        for label, expr in (("start", node.start), ("stop", node.stop), ("step", node.step)):
+            expr_type = self.analyze(expr)
+            if expr_type != INT and expr_type != ERROR:
+                self.errors.append(SemanticError(
+                    f"range() {label} must be int, got {expr_type}",
+                    node.line
+                ))
+        if isinstance(node.step, Number) and node.step.value == 0:
+            self.errors.append(SemanticError("range() step must not be zero", node.line))
+        
+        # Analyze body in new scope
+        old_scope = self.current_scope
+        self.current_scope = Scope(old_scope)
+        var_info = self.current_scope.lookup(node.var)
+        if node.var in self.functions:
+            self.errors.append(SemanticError(f"Cannot assign to function '{node.var}'", node.line))
+        elif var_info is None:
+            self.current_scope.declare(node.var, INT, node.line)
+        elif var_info.type != INT:
+            self.errors.append(SemanticError(
+                f"Type mismatch: cannot assign {INT} to {var_info.type} variable '{node.var}'",
+                node.line
+            ))
+        for stmt in node.body:
+            self.analyze(stmt)
+        self.current_scope = old_scope
+        
+        return ERROR  # For has no return type
+    
+    def analyze_function_def(self, node: FunctionDef) -> Type:
+        """Analyze function definition.
+        
+        The body gets a fresh scope holding the parameters. Names assigned
+        anywhere in the body are locals; other names resolve to globals
+        declared before the definition, which are always bound by the time
+        the function can be called.
+        """
+        if self.current_scope is not self.global_scope or self.function is not None:
+            self.errors.append(SemanticError("Functions must be defined at top level", node.line))
+            return ERROR
+        if node.name in self.functions or node.name in BUILTINS or self.global_scope.lookup(node.name):
+            self.errors.append(SemanticError(f"'{node.name}' is already defined", node.line))
+            return ERROR
+        if len(set(node.params)) != len(node.params):
+            self.errors.append(SemanticError(f"Duplicate parameter in function '{node.name}'", node.line))
+            return ERROR
+        
+        signature = FunctionSignature(
+            node.name,
+            [TYPE_NAMES[name] for name in node.param_types],
+            TYPE_NAMES[node.return_type]
+        )
+        # Registered first so the body may call itself
+        self.functions[node.name] = signature
+        
+        old_scope = self.current_scope
+        self.current_scope = Scope()
+        for name, param_type in zip(node.params, signature.param_types):
+            self.current_scope.declare(name, param_type, node.line)
+        self.function = signature
+        self.function_locals = set(node.params) | set(assigned_names(node.body))
+        for stmt in node.body:
+            self.analyze(stmt)
+        self.function = None
+        self.function_locals = set()
+        self.current_scope = old_scope
+        
+        return ERROR  # FunctionDef has no type
+    
+    def analyze_return(self, node: Return) -> Type:
+        """Analyze return statement against the enclosing function's return type."""
+        expr_type = self.analyze(node.expr)
+        if self.function is None:
+            self.errors.append(SemanticError("'return' outside function", node.line))
+            return ERROR
+        if expr_type != ERROR and expr_type != self.function.return_type:
+            self.errors.append(SemanticError(
+                f"Return type mismatch in '{self.function.name}': expected {self.function.return_type}, got {expr_type}",
+                node.line
+            ))
+        return ERROR  # Return has no type
+    
+    def analyze_call(self, node: Call) -> Type:
+        """Analyze function or builtin call: arity and argument types."""
+        arg_types = [self.analyze(arg) for arg in node.args]
+        signature = self.functions.get(node.name) or BUILTINS.get(node.name)
+        if signature is None:
+            self.errors.append(SemanticError(f"Undefined function: {node.name}", node.line))
+            return ERROR
+        if len(arg_types) != len(signature.param_types):
+            self.errors.append(SemanticError(
+                f"Function '{node.name}' takes {len(signature.param_types)} arguments, got {len(arg_types)}",
+                node.line
+            ))
+            return ERROR
+        for i, (arg_type, param_type) in enumerate(zip(arg_types, signature.param_types)):
+            accepted = param_type if isinstance(param_type, tuple) else (param_type,)
+            if arg_type != ERROR and arg_type not in accepted:
+                self.errors.append(SemanticError(
+                    f"Argument {i + 1} of '{node.name}' must be {' or '.join(map(str, accepted))}, got {arg_type}",
+                    node.line
+                ))
+        return signature.return_type
+    
     def analyze_binop(self, node: BinOp) -> Type:
         """Analyze binary operation."""
         left_type = self.analyze(node.left)
         right_type = self.analyze(node.right)
         
+        # + also concatenates two strings
+        if node.op == "+" and left_type == STR and right_type == STR:
+            return STR
+        
         # Arithmetic operations require int operands
         if node.op in ("+", "-", "*", "/"):
             if left_type != INT or right_type != INT:
@@ -202,11 +399,11 @@ class SemanticAnalyzer:
                 return ERROR
             return INT
         
-        # Comparison operations
+        # Comparison operations (strings order by character codes)
         if node.op in ("<", ">", "<=", ">="):
-            if left_type != INT or right_type != INT:
+            if (left_type, right_type) not in ((INT, INT), (STR, STR)):
                 self.errors.append(SemanticError(
-                    f"Comparison '{node.op}' requires int operands, got {left_type} and {right_type}",
+                    f"Comparison '{node.op}' requires two int or two str operands, got {left_type} and {right_type}",
                     node.line
                 ))
                 return ERROR
@@ -214,6 +411,9 @@ class SemanticAnalyzer:
         
         # Equality operations
         if node.op in ("==", "!="):
+            if left_type == ARRAY or right_type == ARRAY:
+                self.errors.append(SemanticError(f"Equality '{node.op}' is not defined for arrays", node.line))
+                return ERROR
             if left_type != right_type:
                 self.errors.append(SemanticError(
                     f"Equality '{node.op}' requires compatible types, got {left_type} and {right_type}",
@@ -224,13 +424,35 @@ class SemanticAnalyzer:
         
         return ERROR
     
+    def analyze_index(self, node: Index) -> Type:
+        """Analyze element load: an int index into an array gives an int."""
+        if not self.check_index(node.array, node.index, node.line):
+            return ERROR
+        return INT
+    
+    def check_index(self, array: Expression, index: Expression, line: int) -> bool:
+        """Check the array and index of an element access, reporting any mismatch."""
+        array_type = self.analyze(array)
+        index_type = self.analyze(index)
+        if array_type != ARRAY and array_type != ERROR:
+            self.errors.append(SemanticError(f"Cannot index {array_type}", line))
+            return False
+        if index_type != INT and index_type != ERROR:
+            self.errors.append(SemanticError(f"Array index must be int, got {index_type}", line))
+            return False
+        return array_type != ERROR and index_type != ERROR
+    
     def analyze_number(self, node: Number) -> Type:
-        """Analyze number literal."""
+        """Analyze number literal (folded comparisons are bool literals)."""
+        if isinstance(node.value, bool):
+            return BOOL
         return INT
     
     def analyze_var(self, node: Var) -> Type:
         """Analyze variable reference."""
         var_info = self.current_scope.lookup(node.name)
+        if var_info is None and self.function is not None and node.name not in self.function_locals:
+            var_info = self.global_scope.lookup(node.name)
         if var_info is None:
             self.errors.append(SemanticError(
                 f"Undefined variable: {node.name}",
@@ -243,6 +465,10 @@ class SemanticAnalyzer:
         """Run semantic analysis and return list of errors."""
         self.errors = []
         self.current_scope = Scope()
+        self.global_scope = self.current_scope
+        self.functions = {}
+        for name in self.externs:
+            self.current_scope.declare(name, INT, 0)
         self.analyze(node)
         return self.errors
 
@@ -7,8 +7,14 @@ sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
 
 from lexer import Lexer
 from parser import Parser
+from semantic import SemanticAnalyzer
 from compiler import compile_ast
-from bytecode import CMP_LE, CMP_GE, CMP_NEQ, JUMP_IF_TRUE, POP
+from optimizer import Optimizer
+from bytecode import CMP_LT, CMP_LE, CMP_GE, CMP_NEQ, JUMP_IF_FALSE, JUMP_IF_GE, JUMP_IF_NEQ, JUMP_IF_TRUE, POP
+from bytecode import ADD, ADD_INT, MUL_INT, CMP_LT_INT, CMP_EQ
+from bytecode import LOAD_FAST, STORE_FAST, LOAD_NAME, STORE_NAME, CALL, TAIL_CALL, RETURN, HALT, Function
+from bytecode import FOR_RANGE, JUMP, PRINT, LOAD_CONST, SUB, DUP, SWAP, ROT, Instruction
+from vm import VM
 
 
 class TestBytecode(unittest.TestCase):
@@ -42,6 +48,165 @@ class TestBytecode(unittest.TestCase):
         code, consts, names = self.parse_and_compile(source)
         opcodes = [instr.opcode for instr in code]
         self.assertIn(CMP_NEQ, opcodes)
+    
+    
+    def analyze_and_compile(self, source):
+        """Parse, type check and compile source."""
+        ast = Parser(Lexer(source).tokenize()).parse_program()
+        self.assertEqual(SemanticAnalyzer().check(ast), [])
+        return compile_ast(ast)
+    
+    def test_typed_condition_uses_fused_branch(self):
+        """Test a typed comparison in a condition compiles to one compare-and-branch."""
+        code, consts, names = self.analyze_and_compile("x = 0\nwhile x < 3:\n    x = x + 1")
+        opcodes = [instr.opcode for instr in code]
+        self.assertIn(JUMP_IF_GE, opcodes)
+        self.assertNotIn(CMP_LT, opcodes)
+        self.assertNotIn(JUMP_IF_FALSE, opcodes)
+        self.assertEqual(VM(code, consts, names).run(), {"x": 3})
+    
+    def test_fused_branch_inverts_equality(self):
+        """Test == in an if jumps to the else branch on inequality."""
+        code, consts, names = self.analyze_and_compile("x = 1\nif x == 2:\n    y = 1\nelse:\n    y = 2")
+        self.assertIn(JUMP_IF_NEQ, [instr.opcode for instr in code])
+        self.assertEqual(VM(code, consts, names).run()["y"], 2)
+    
+    def test_untyped_condition_keeps_generic_branch(self):
+        """Test conditions without type information still use JUMP_IF_FALSE."""
+        code, consts, names = self.parse_and_compile("x = 0\nwhile x < 3:\n    x = x + 1")
+        opcodes = [instr.opcode for instr in code]
+        self.assertIn(CMP_LT, opcodes)
+        self.assertIn(JUMP_IF_FALSE, opcodes)
+    
+    def test_comparison_value_is_bool(self):
+        """Test a stored comparison is a bool, not the int 1."""
+        code, consts, names = self.analyze_and_compile("x = 5 < 10")
+        self.assertIs(VM(code, consts, names).run()["x"], True)
+    
+    
+    def test_typed_int_operations_are_specialized(self):
+        """Test int-typed arithmetic and comparisons use the *_INT opcodes."""
+        code, consts, names = self.analyze_and_compile("x = 2\ny = x * x + 1\nz = x < y")
+        opcodes = [instr.opcode for instr in code]
+        self.assertIn(ADD_INT, opcodes)
+        self.assertIn(MUL_INT, opcodes)
+        self.assertIn(CMP_LT_INT, opcodes)
+        self.assertNotIn(ADD, opcodes)
+        self.assertEqual(VM(code, consts, names).run(), {"x": 2, "y": 5, "z": True})
+    
+    def test_bool_equality_stays_generic(self):
+        """Test == on bool operands keeps the generic opcode."""
+        code, consts, names = self.analyze_and_compile("x = 1\nb = (x < 2) == (x < 3)")
+        opcodes = [instr.opcode for instr in code]
+        self.assertIn(CMP_EQ, opcodes)
+        self.assertIn(CMP_LT_INT, opcodes)
+        self.assertIs(VM(code, consts, names).run()["b"], True)
+    
+    def test_function_locals_use_slots(self):
+        """Test function bodies follow HALT and address locals by slot."""
+        code, consts, names = self.analyze_and_compile("""g = 5
+def f(a, b):
+    c = a * b
+    return c + g
+print(f(2, 3))""")
+        halt = [instr.opcode for instr in code].index(HALT)
+        body = [instr.opcode for instr in code[halt + 1:]]
+        self.assertIn(LOAD_FAST, body)
+        self.assertIn(STORE_FAST, body)
+        self.assertNotIn(STORE_NAME, body)
+        self.assertIn(LOAD_NAME, body)  # the global g
+        self.assertEqual(body[-1], RETURN)
+        
+        function = consts[code[[instr.opcode for instr in code].index(CALL)].arg]
+        self.assertIsInstance(function, Function)
+        self.assertEqual((function.entry, function.nparams, function.nlocals), (halt + 1, 2, 3))
+        self.assertEqual(names, ["g"])
+    
+    def test_returned_call_is_tail_call(self):
+        """Test return f(...) reuses the frame instead of calling and returning."""
+        code, consts, names = self.analyze_and_compile("""def f(n, acc):
+    if n == 0:
+        return acc
+    return f(n - 1, acc + n)
+print(f(3, 0))""")
+        opcodes = [instr.opcode for instr in code]
+        self.assertEqual(opcodes.count(CALL), 1)  # the top-level call
+        self.assertEqual(opcodes[-1], TAIL_CALL)
+    
+    def test_for_range_loop_overhead(self):
+        """Test a for loop costs FOR_RANGE, the store and the back jump per iteration."""
+        code, consts, names = self.analyze_and_compile("for i in range(10):\n    print(i)")
+        opcodes = [instr.opcode for instr in code]
+        loop = opcodes.index(FOR_RANGE)
+        self.assertEqual(opcodes[loop:], [FOR_RANGE, DUP, STORE_NAME, PRINT, JUMP, HALT])
+        self.assertEqual(code[loop].arg, len(code) - 1)
+        self.assertEqual(code[loop + 4].arg, loop)
+    
+    def test_propagated_constant_condition_has_no_branch(self):
+        """Test a condition folded through propagated constants emits only the taken branch."""
+        ast = Parser(Lexer("x = 3\nif x * 4 > 10:\n    print(1)\nelse:\n    print(2)").tokenize()).parse_program()
+        self.assertEqual(SemanticAnalyzer().check(ast), [])
+        code, consts, names = compile_ast(Optimizer().optimize(ast))
+        opcodes = [instr.opcode for instr in code]
+        self.assertNotIn(JUMP, opcodes)
+        self.assertNotIn(JUMP_IF_FALSE, opcodes)
+        self.assertEqual(opcodes.count(PRINT), 1)
+    
+    def test_peephole_threads_nested_if_jumps(self):
+        """Test nested ifs jump straight to the end and no jump lands on the next instruction."""
+        code, consts, names = self.analyze_and_compile("""x = 5
+if x > 1:
+    if x > 2:
+        print(1)
+    else:
+        print(2)
+print(3)""")
+        for i, instr in enumerate(code):
+            if instr.opcode == JUMP:
+                self.assertNotEqual(instr.arg, i + 1)
+                self.assertNotEqual(code[instr.arg].opcode, JUMP)
+        self.assertEqual([instr.opcode for instr in code].count(JUMP), 1)
+    
+    def test_peephole_drops_unreachable_code(self):
+        """Test code after a return in every branch is removed and entries re-patched."""
+        code, consts, names = self.analyze_and_compile("""def f(a):
+    if a > 1:
+        return 1
+    else:
+        return 2
+print(f(3))""")
+        function = consts[0]
+        self.assertEqual([instr.opcode for instr in code[function.entry:]].count(RETURN), 2)
+        self.assertEqual(code[-1].opcode, RETURN)
+        self.assertEqual(code[function.entry].opcode, LOAD_FAST)
+    
+    def test_stack_shuffles(self):
+        """Test DUP, SWAP and ROT rearrange the top of the stack."""
+        code = [
+            Instruction(LOAD_CONST, 0), Instruction(LOAD_CONST, 1), Instruction(LOAD_CONST, 2),
+            Instruction(ROT), Instruction(STORE_NAME, 0),  # [10, 4, 1] -> [4, 1, 10]
+            Instruction(SWAP), Instruction(SUB),  # 1 - 4
+            Instruction(DUP), Instruction(MUL_INT), Instruction(STORE_NAME, 1),
+            Instruction(HALT),
+        ]
+        self.assertEqual(VM(code, [10, 4, 1], ["a", "b"]).run(), {"a": 10, "b": 9})
+    
+    def test_repeated_operands_use_dup(self):
+        """Test a value stored and read straight back, or used as both operands, is not loaded again."""
+        code, consts, names = self.analyze_and_compile("x = 3\nx = x + 1\nprint(x * x)")
+        opcodes = [instr.opcode for instr in code]
+        self.assertEqual(opcodes.count(DUP), 3)
+        self.assertNotIn(LOAD_NAME, opcodes)
+        self.assertEqual(VM(code, consts, names).run(), {"x": 4})
+    
+    def test_dead_locals_take_no_slots(self):
+        """Test locals removed by dead store elimination get no slot or store."""
+        ast = Parser(Lexer("def f(n):\n    a = n * 2\n    b = n + 1\n    return b\nprint(f(1))").tokenize()).parse_program()
+        self.assertEqual(SemanticAnalyzer().check(ast), [])
+        code, consts, names = compile_ast(Optimizer().optimize(ast))
+        function = next(const for const in consts if isinstance(const, Function))
+        self.assertEqual(function.nlocals, 2)
+        self.assertEqual([instr.opcode for instr in code].count(STORE_FAST), 1)
 
 
 if __name__ == "__main__":
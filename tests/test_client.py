@@ -0,0 +1,201 @@
+"""Tests for the VM server client."""
+
+import unittest
+import sys
+import os
+import socket
+import subprocess
+import tempfile
+import threading
+import time
+import hashlib
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+from lexer import Lexer
+from parser import Parser
+from compiler import compile_ast
+from bytecode_serializer import serialize_bytecode
+from minipy_client import VMClient
+from errors import ServerError
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+VM_BINARY = os.environ.get("MINIPY_VM", os.path.join(ROOT, "cpp_vm", "build", "minipy_vm"))
+
+
+def compile_to_text(source):
+    """Compile source and return the serialized bytecode text."""
+    ast = Parser(Lexer(source).tokenize()).parse_program()
+    code, consts, names = compile_ast(ast)
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, "prog.mpbc")
+        serialize_bytecode(code, consts, names, path)
+        with open(path) as f:
+            return f.read()
+
+
+class TestClientProtocol(unittest.TestCase):
+    """Test request framing against a scripted peer."""
+    
+    def setUp(self):
+        self.client_sock, self.server_sock = socket.socketpair()
+        self.client = VMClient(self.client_sock)
+        self.server = self.server_sock.makefile('rwb')
+    
+    def tearDown(self):
+        self.client.close()
+        self.server.close()
+        self.server_sock.close()
+    
+    def reply(self, data):
+        self.server.write(data)
+        self.server.flush()
+    
+    def test_load(self):
+        """LOAD sends the byte count followed by the contents."""
+        self.reply(b"OK 00000000000000ff\n")
+        program_id = self.client.load("1\nHALT\n0\n0\n")
+        self.assertEqual(program_id, "00000000000000ff")
+        self.assertEqual(self.server.readline(), b"LOAD 11\n")
+        self.assertEqual(self.server.read(11), b"1\nHALT\n0\n0\n")
+    
+    def test_run_collects_output_frames(self):
+        """RUN sends bindings and joins OUT frames until DONE."""
+        self.reply(b"OUT 2\n1\nOUT 2\n2\nDONE\n")
+        chunks = []
+        output = self.client.run("abc", {"n": 5}, on_output=chunks.append)
+        self.assertEqual(output, "1\n2\n")
+        self.assertEqual(chunks, ["1\n", "2\n"])
+        self.assertEqual(self.server.readline(), b"RUN abc 1\n")
+        self.assertEqual(self.server.readline(), b"n 5\n")
+    
+    def test_run_error(self):
+        """ERR replies raise ServerError."""
+        self.reply(b"ERR Division by zero\n")
+        with self.assertRaises(ServerError):
+            self.client.run("abc")
+
+
+@unittest.skipUnless(os.path.exists(VM_BINARY) and hasattr(socket, "AF_UNIX"),
+                     "C++ VM not built")
+class TestServer(unittest.TestCase):
+    """End-to-end tests against minipy_vm --serve."""
+    
+    def setUp(self):
+        self.tmp = tempfile.TemporaryDirectory()
+        self.procs = []
+        self.socket_path = self.start_server("vm.sock", "--workers", "2")
+    
+    def tearDown(self):
+        for proc in self.procs:
+            proc.kill()
+            proc.wait()
+        self.tmp.cleanup()
+    
+    def start_server(self, name, *args):
+        """Start a server with extra arguments and return its socket path."""
+        socket_path = os.path.join(self.tmp.name, name)
+        self.procs.append(subprocess.Popen([VM_BINARY, "--serve", socket_path, *args],
+                                           stderr=subprocess.DEVNULL))
+        for _ in range(100):
+            if os.path.exists(socket_path):
+                break
+            time.sleep(0.05)
+        return socket_path
+    
+    def test_load_is_cached_by_content(self):
+        """Loading the same program twice yields the same id, its SHA-256."""
+        text = compile_to_text("print(5)")
+        with VMClient.connect(self.socket_path) as client:
+            self.assertEqual(client.load(text), client.load(text))
+            self.assertEqual(client.load(text), hashlib.sha256(text.encode()).hexdigest())
+    
+    def test_cache_evicts_least_recently_used(self):
+        """Past its byte budget the cache drops the program used longest ago."""
+        texts = [compile_to_text(f"print({n})") for n in range(3)]
+        socket_path = self.start_server("small.sock", "--cache-bytes", str(2 * max(map(len, texts))))
+        with VMClient.connect(socket_path) as client:
+            first, second = client.load(texts[0]), client.load(texts[1])
+            self.assertEqual(client.run(first), "0\n")
+            client.load(texts[2])
+            self.assertEqual(client.run(first), "0\n")
+            with self.assertRaises(ServerError):
+                client.run(second)
+    
+    def test_oversized_load_is_refused(self):
+        """A LOAD larger than the limit is refused before its payload is read."""
+        socket_path = self.start_server("limited.sock", "--max-program-bytes", "100")
+        with VMClient.connect(socket_path) as client:
+            client.sock.sendall(b"LOAD 1000000000\n")
+            self.assertIn("too large", client.read_line())
+            self.assertEqual(client.reader.readline(), b"")
+    
+    def test_run_with_bindings(self):
+        """Bindings become globals for the run."""
+        text = compile_to_text("""x = 0
+while x < n:
+    x = x + 1
+print(x)""")
+        with VMClient.connect(self.socket_path) as client:
+            program_id = client.load(text)
+            self.assertEqual(client.run(program_id, {"n": 3}), "3\n")
+            self.assertEqual(client.run(program_id, {"n": 7}), "7\n")
+    
+    def test_concurrent_clients(self):
+        """Several connections are served in parallel from one cache."""
+        text = compile_to_text("print(n * 2)")
+        results = {}
+        
+        def worker(n):
+            with VMClient.connect(self.socket_path) as client:
+                results[n] = client.run(client.load(text), {"n": n})
+        
+        threads = [threading.Thread(target=worker, args=(n,)) for n in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(results, {n: f"{n * 2}\n" for n in range(4)})
+    
+    def test_idle_connection_holds_no_worker(self):
+        """With a single worker, an idle open connection does not stall other clients."""
+        socket_path = self.start_server("one.sock", "--workers", "1")
+        text = compile_to_text("print(n + 1)")
+        with VMClient.connect(socket_path) as idle:
+            program_id = idle.load(text)
+            with VMClient.connect(socket_path) as client:
+                client.sock.settimeout(10)
+                self.assertEqual(client.load(text), program_id)
+                self.assertEqual(client.run(program_id, {"n": 1}), "2\n")
+            self.assertEqual(idle.run(program_id, {"n": 2}), "3\n")
+    
+    def test_huge_binding_stalls_no_other_client(self):
+        """A huge binding is parsed by a worker, and one past the line limit is refused."""
+        text = compile_to_text("print(n > 0)")
+        with VMClient.connect(self.socket_path) as big:
+            program_id = big.load(text)
+            big.sock.sendall(f"RUN {program_id} 1\nn {'7' * 60000}\n".encode())
+            with VMClient.connect(self.socket_path) as client:
+                client.sock.settimeout(10)
+                self.assertEqual(client.run(program_id, {"n": -3}), "False\n")
+            self.assertEqual(big.read_line(), "OUT 5")
+            self.assertEqual(big.read_line(), "True")
+            self.assertEqual(big.read_line(), "DONE")
+        
+        with VMClient.connect(self.socket_path) as big:
+            big.sock.sendall(f"RUN {program_id} 1\nn {'7' * 100000}".encode())
+            self.assertIn("too long", big.read_line())
+    
+    def test_runtime_error(self):
+        """Runtime errors are reported after any output produced so far."""
+        text = compile_to_text("""print(1)
+print(1 / n)""")
+        with VMClient.connect(self.socket_path) as client:
+            program_id = client.load(text)
+            with self.assertRaises(ServerError):
+                client.run(program_id, {"n": 0})
+            # The connection stays usable after an error
+            self.assertEqual(client.run(program_id, {"n": 1}), "1\n1\n")
+
+
+if __name__ == "__main__":
+    unittest.main()
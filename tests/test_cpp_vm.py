@@ -0,0 +1,590 @@
+"""End-to-end tests for the C++ VM command line (skipped unless it is built)."""
+
+import unittest
+import sys
+import os
+import subprocess
+import tempfile
+import io
+import contextlib
+import time
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+from lexer import Lexer
+from parser import Parser
+from semantic import SemanticAnalyzer
+from optimizer import Optimizer
+from compiler import compile_ast
+from bytecode_serializer import serialize_bytecode
+from bytecode import Instruction, Function
+from vm import VM
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+VM_BINARY = os.environ.get("MINIPY_VM", os.path.join(ROOT, "cpp_vm", "build", "minipy_vm"))
+
+
+@unittest.skipUnless(os.path.exists(VM_BINARY), "C++ VM not built")
+class TestCppVM(unittest.TestCase):
+    """Compile MiniPy programs and run them on minipy_vm."""
+    
+    def setUp(self):
+        self.tmp = tempfile.TemporaryDirectory()
+    
+    def tearDown(self):
+        self.tmp.cleanup()
+    
+    def compile(self, source, name="prog", externs=None):
+        """Compile source to a .mpbc file and return its path."""
+        ast = Parser(Lexer(source).tokenize()).parse_program()
+        self.assertEqual(SemanticAnalyzer(externs).check(ast), [])
+        ast = Optimizer().optimize(ast)
+        code, consts, names = compile_ast(ast)
+        path = os.path.join(self.tmp.name, f"{name}.mpbc")
+        serialize_bytecode(code, consts, names, path)
+        return path
+    
+    def run_vm(self, *args):
+        """Run minipy_vm and return the completed process."""
+        return subprocess.run([VM_BINARY, *args], capture_output=True, text=True, timeout=30)
+    
+    def test_run(self):
+        """Test running a program with a loop."""
+        path = self.compile("""x = 0
+while x < 3:
+    x = x + 1
+print(x)""")
+        result = self.run_vm(path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout, "3\n")
+    
+    def test_big_integers(self):
+        """Test arithmetic promotes to big integers instead of wrapping."""
+        path = self.compile("""f = 1
+i = 1
+while i <= 30:
+    f = f * i
+    i = i + 1
+print(f)
+print(f / 1000000007)
+print((0 - f) / 7)
+print(f - f + 5)
+print(f > 4611686018427387903)
+x = 4611686018427387903
+print(x + 1)
+print(x * x)
+print((0 - 7) / 2)""")
+        result = self.run_vm(path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        f = 265252859812191058636308480000000
+        x = 4611686018427387903
+        expected = [f, f // 1000000007, (0 - f) // 7, 5, True, x + 1, x * x, -4]
+        self.assertEqual(result.stdout.split(), [str(v) for v in expected])
+    
+    def test_huge_integers(self):
+        """Test integers are capped, charged by size, and print like the Python VM."""
+        path = self.compile("""x = 3
+while 1 > 0:
+    x = x * x""")
+        result = self.run_vm(path)
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn("Integer too large", result.stderr)
+        
+        # Each product takes milliseconds, so a budget must not wait for 1024 of them
+        path = self.compile("""x = 3
+i = 0
+while i < 17:
+    x = x * x
+    i = i + 1
+while 1 > 0:
+    x = x + 1
+    y = x * x""")
+        start = time.monotonic()
+        result = self.run_vm("--max-time-ms", "100", path)
+        self.assertLess(time.monotonic() - start, 2)
+        self.assertIn("budget exhausted", result.stderr)
+        
+        source = """x = 3
+i = 0
+while i < 16:
+    x = x * x
+    i = i + 1
+print(0 - x)"""
+        path = self.compile(source)
+        code, consts, names = compile_ast(Parser(Lexer(source).tokenize()).parse_program())
+        expected = io.StringIO()
+        with contextlib.redirect_stdout(expected):
+            VM(code, consts, names).run()
+        result = self.run_vm(path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout, expected.getvalue())
+    
+    def test_mixed_value_types(self):
+        """Test float and bool constants behave like the Python VM."""
+        consts = [1.5, 2, True, 10 ** 20, 0.1, -7.5, 0.0, 3]
+        code = []
+        for a, op, b in [(0, "ADD", 1), (1, "MUL", 2), (3, "MUL", 0), (4, "MUL", 7),
+                         (5, "DIV", 1), (7, "DIV", 0), (0, "CMP_LT", 1), (6, "CMP_EQ", 2)]:
+            code += [Instruction("LOAD_CONST", a), Instruction("LOAD_CONST", b),
+                     Instruction(op), Instruction("PRINT")]
+        code += [Instruction("LOAD_CONST", 2), Instruction("PRINT"),
+                 Instruction("LOAD_CONST", 6), Instruction("JUMP_IF_FALSE", len(code) + 6),
+                 Instruction("LOAD_CONST", 0), Instruction("PRINT"),
+                 Instruction("HALT")]
+        path = os.path.join(self.tmp.name, "mixed.mpbc")
+        serialize_bytecode(code, consts, [], path)
+        
+        expected = io.StringIO()
+        with contextlib.redirect_stdout(expected):
+            VM(code, consts, []).run()
+        result = self.run_vm(path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout, expected.getvalue())
+    
+    def test_loader_threads_old_jumps(self):
+        """Test bytecode with jump chains and dead code, as older compilers wrote it."""
+        consts = [Function("f", 1, 18, 1), 0, 1, 5, 2]
+        code = [
+            Instruction("LOAD_CONST", 1), Instruction("STORE_NAME", 0),
+            # while i < 5: print(f(i)); i = i + 1
+            Instruction("LOAD_NAME", 0), Instruction("LOAD_CONST", 3), Instruction("JUMP_IF_GE", 16),
+            Instruction("LOAD_NAME", 0), Instruction("CALL", 0), Instruction("PRINT"),
+            Instruction("JUMP", 9),
+            Instruction("LOAD_NAME", 0), Instruction("LOAD_CONST", 2), Instruction("ADD"),
+            Instruction("STORE_NAME", 0),
+            Instruction("JUMP", 15), Instruction("PRINT"), Instruction("JUMP", 2),
+            Instruction("JUMP", 17), Instruction("HALT"),
+            # f(a): if a > 2: return a, else return 0 - a
+            Instruction("LOAD_FAST", 0), Instruction("LOAD_CONST", 4), Instruction("JUMP_IF_LE", 24),
+            Instruction("LOAD_FAST", 0), Instruction("RETURN"), Instruction("JUMP", 27),
+            Instruction("LOAD_CONST", 1), Instruction("LOAD_FAST", 0), Instruction("SUB"),
+            Instruction("JUMP", 29), Instruction("PRINT"), Instruction("RETURN"),
+        ]
+        path = os.path.join(self.tmp.name, "old.mpbc")
+        serialize_bytecode(code, consts, ["i"], path)
+        result = self.run_vm(path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout.split(), ["0", "-1", "-2", "3", "4"])
+    
+    def test_stack_shuffles(self):
+        """Test DUP, SWAP and ROT, and that SWAP needs two values."""
+        code = [
+            Instruction("LOAD_CONST", 0), Instruction("LOAD_CONST", 1), Instruction("LOAD_CONST", 2),
+            Instruction("ROT"), Instruction("PRINT"),  # [10, 4, 1] -> [4, 1, 10]
+            Instruction("SWAP"), Instruction("SUB"),  # 1 - 4
+            Instruction("DUP"), Instruction("MUL"), Instruction("PRINT"),
+            Instruction("LOAD_CONST", 0), Instruction("SWAP"), Instruction("HALT"),
+        ]
+        path = os.path.join(self.tmp.name, "shuffle.mpbc")
+        serialize_bytecode(code, [10, 4, 1], [], path)
+        result = self.run_vm(path)
+        self.assertNotEqual(result.returncode, 0)
+        self.assertEqual(result.stdout.split(), ["10", "9"])
+        self.assertIn("Stack underflow", result.stderr)
+    
+    def test_big_integer_garbage_is_reclaimed(self):
+        """Test a long loop over big integers keeps only live values."""
+        path = self.compile("""big = 1
+i = 0
+while i < 70:
+    big = big * 2
+    i = i + 1
+total = 0
+i = 0
+while i < 200000:
+    total = total + big
+    i = i + 1
+print(total)""")
+        result = self.run_vm(path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout, f"{200000 * 2 ** 70}\n")
+    
+    def test_time_limit_stops_infinite_loop(self):
+        """Test a time budget preempts a loop that never ends."""
+        path = self.compile("""x = 0
+while 1 > 0:
+    x = x + 1""")
+        result = self.run_vm("--max-time-ms", "50", path)
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn("budget exhausted", result.stderr)
+    
+    def test_instruction_limit(self):
+        """Test an instruction budget is charged per loop iteration."""
+        source = """x = 0
+while x < 100:
+    x = x + 1
+    y = x / 3
+print(x)"""
+        path = self.compile(source)
+        self.assertNotEqual(self.run_vm("--max-instructions", "100", path).returncode, 0)
+        result = self.run_vm("--max-instructions", "100000", path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout, "100\n")
+    
+    def test_budget_charges_array_builtins_by_length(self):
+        """Test a budget stops a loop whose body is one long whole-array builtin."""
+        path = self.compile("""a = array(16000000)
+for i in range(100000):
+    array_fill(a, i)
+print(array_sum(a))""")
+        for limit in (["--max-instructions", "1000"], ["--max-time-ms", "100"]):
+            start = time.monotonic()
+            result = self.run_vm(*limit, path)
+            # Charged one instruction per fill, the loop ran for seconds
+            self.assertLess(time.monotonic() - start, 2)
+            self.assertNotEqual(result.returncode, 0)
+            self.assertIn("budget exhausted", result.stderr)
+    
+    def test_green_threads(self):
+        """Test many time-sliced tasks all run to completion."""
+        path = self.compile("""x = 0
+while x < 200:
+    x = x + 1
+print(x + task)""", externs=["task"])
+        result = self.run_vm("--tasks", "300", "--workers", "3", "--slice", "50", path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(sorted(int(line) for line in result.stdout.split()),
+                         [200 + i for i in range(300)])
+    
+    def test_green_thread_errors(self):
+        """Test a failing task is reported without stopping the others."""
+        path = self.compile("print(10 / task)", externs=["task"])
+        result = self.run_vm("--tasks", "3", path)
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn("Division by zero", result.stderr)
+        self.assertEqual(sorted(result.stdout.split()), ["10", "5"])
+    
+    def test_snapshot_and_resume(self):
+        """Test resuming from a checkpoint skips the prologue."""
+        path = self.compile("""base = 0
+i = 0
+while i < 10:
+    base = base + i
+    i = i + 1
+print(base)
+checkpoint
+x = base * 2
+print(x)""")
+        snap = os.path.join(self.tmp.name, "prog.snap")
+        result = self.run_vm("--snapshot", snap, path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout, "45\n")
+        
+        for _ in range(2):
+            result = self.run_vm("--resume", snap, path)
+            self.assertEqual(result.returncode, 0, result.stderr)
+            self.assertEqual(result.stdout, "90\n")
+    
+    def test_snapshot_keeps_big_integers(self):
+        """Test big integers on the stack and in globals survive a snapshot."""
+        path = self.compile("""x = 99999999999999999999999 * 3
+checkpoint
+print(x + 1)""")
+        snap = os.path.join(self.tmp.name, "prog.snap")
+        self.assertEqual(self.run_vm("--snapshot", snap, path).returncode, 0)
+        result = self.run_vm("--resume", snap, path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout, f"{99999999999999999999999 * 3 + 1}\n")
+    
+    def test_resume_rejects_other_program(self):
+        """Test a snapshot only resumes the program it came from."""
+        path = self.compile("x = 1\ncheckpoint\nprint(x)")
+        other = self.compile("x = 2\ncheckpoint\nprint(x)", "other")
+        snap = os.path.join(self.tmp.name, "prog.snap")
+        self.assertEqual(self.run_vm("--snapshot", snap, path).returncode, 0)
+        result = self.run_vm("--resume", snap, other)
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn("different program", result.stderr)
+    
+    def test_snapshot_requires_checkpoint(self):
+        """Test --snapshot fails when no checkpoint is reached."""
+        path = self.compile("print(1)")
+        result = self.run_vm("--snapshot", os.path.join(self.tmp.name, "x.snap"), path)
+        self.assertNotEqual(result.returncode, 0)
+    
+    def test_functions(self):
+        """Test recursive calls, locals, globals and discarded results."""
+        path = self.compile("""scale = 10
+def fib(n):
+    if n < 2:
+        return n
+    return fib(n - 1) + fib(n - 2)
+def scaled(a, b) -> int:
+    c = a * scale + b
+    return c
+def even(n) -> bool:
+    return n / 2 * 2 == n
+def show(x):
+    print(x)
+print(fib(20))
+print(scaled(3, 4))
+print(even(7))
+show(fib(10))""")
+        result = self.run_vm(path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout, "6765\n34\nFalse\n55\n")
+    
+    def test_runaway_recursion(self):
+        """Test unbounded recursion fails cleanly instead of overflowing."""
+        path = self.compile("""def f(n):
+    return f(n + 1) + 1
+print(f(0))""")
+        result = self.run_vm(path)
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn("recursion depth", result.stderr)
+    
+    def test_calls_are_preemptible(self):
+        """Test call-heavy tasks without loops are still time-sliced."""
+        path = self.compile("""def fib(n):
+    if n < 2:
+        return n
+    return fib(n - 1) + fib(n - 2)
+print(fib(15) + task)""", externs=["task"])
+        result = self.run_vm("--tasks", "20", "--workers", "2", "--slice", "50", path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(sorted(int(line) for line in result.stdout.split()),
+                         [610 + i for i in range(20)])
+        self.assertNotEqual(self.run_vm("--max-instructions", "100", path).returncode, 0)
+    
+    def test_snapshot_inside_function(self):
+        """Test a checkpoint inside a call resumes with its frames intact."""
+        path = self.compile("""def f(n):
+    m = n * 2
+    checkpoint
+    return m + 1
+print(f(20) + 1)""")
+        snap = os.path.join(self.tmp.name, "prog.snap")
+        self.assertEqual(self.run_vm("--snapshot", snap, path).returncode, 0)
+        result = self.run_vm("--resume", snap, path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout, "42\n")
+    
+    def test_tail_recursion_runs_in_constant_space(self):
+        """Test deep tail recursion neither overflows nor hits the depth limit."""
+        path = self.compile("""def sum_to(n, acc):
+    if n == 0:
+        return acc
+    return sum_to(n - 1, acc + n)
+def start(n):
+    twice = n * 2
+    return sum_to(twice, 0)
+print(start(100000))""")
+        result = self.run_vm(path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout, f"{200000 * 200001 // 2}\n")
+    
+    def test_for_range(self):
+        """Test FOR_RANGE matches the reference VM, across the small-int limit too."""
+        source = """total = 0
+for i in range(5):
+    total = total + i
+print(total)
+for i in range(10, 0, 0 - 3):
+    print(i)
+big = 4611686018427387900
+for j in range(big, big + 20, 7):
+    print(j)
+def tri(n):
+    s = 0
+    for k in range(1, n + 1):
+        s = s + k
+    return s
+print(tri(100))
+for i in range(3, 3):
+    print(99)"""
+        path = self.compile(source)
+        result = self.run_vm(path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        
+        ast = Parser(Lexer(source).tokenize()).parse_program()
+        SemanticAnalyzer().check(ast)
+        expected = io.StringIO()
+        with contextlib.redirect_stdout(expected):
+            VM(*compile_ast(Optimizer().optimize(ast))).run()
+        self.assertEqual(result.stdout, expected.getvalue())
+    
+    def test_hoisted_invariants(self):
+        """Test loops with hoisted invariants print what the unoptimized program does."""
+        source = """a = 6
+b = 7
+total = 0
+i = 0
+while i < a * b / 7:
+    for j in range(4):
+        total = total + a * b + j
+        if j == 2:
+            print(total / (a - 5))
+    i = i + 1
+print(total)
+def scaled(n, k):
+    s = 0
+    while n > 0:
+        s = s + k * k + n
+        n = n - 1
+    return s
+print(scaled(10, 3))
+j = 40
+while j > 0 - 20:
+    print(j * 5 + b + (j * 5 + b) / 3)
+    j = j - 7"""
+        path = self.compile(source)
+        result = self.run_vm(path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        
+        ast = Parser(Lexer(source).tokenize()).parse_program()
+        SemanticAnalyzer().check(ast)
+        expected = io.StringIO()
+        with contextlib.redirect_stdout(expected):
+            VM(*compile_ast(ast)).run()
+        self.assertEqual(result.stdout, expected.getvalue())
+    
+    def test_arrays(self):
+        """Test arrays are shared by reference, printed like lists and bounds checked."""
+        path = self.compile("""def total(a: array) -> int:
+    s = 0
+    for i in range(len(a)):
+        s = s + a[i]
+    return s
+a = array(5)
+b = a
+for i in range(len(a)):
+    b[i] = i * i
+print(a)
+print(total(a))
+a[2] = 9223372036854775807
+print(a[2])
+print(a[5])""")
+        result = self.run_vm(path)
+        self.assertNotEqual(result.returncode, 0)
+        self.assertEqual(result.stdout, "[0, 1, 4, 9, 16]\n30\n9223372036854775807\n")
+        self.assertIn("Array index out of range", result.stderr)
+        
+        path = self.compile("a = array(1)\na[0] = 9223372036854775807 + 1")
+        result = self.run_vm(path)
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn("Array value out of range", result.stderr)
+    
+    def test_unchecked_access_from_crafted_file(self):
+        """Test UNCHECKED accesses a file claims are safe are still checked."""
+        programs = [
+            ([Instruction("LOAD_CONST", 0), Instruction("NEW_ARRAY"), Instruction("LOAD_CONST", 1),
+              Instruction("LOAD_INDEX_UNCHECKED"), Instruction("PRINT"), Instruction("HALT")],
+             "Array index out of range"),
+            ([Instruction("LOAD_CONST", 0), Instruction("LOAD_CONST", 0), Instruction("NEW_ARRAY"),
+              Instruction("LOAD_CONST", 1), Instruction("STORE_INDEX_UNCHECKED"), Instruction("HALT")],
+             "Array index out of range"),
+            ([Instruction("LOAD_CONST", 0), Instruction("LOAD_CONST", 0),
+              Instruction("LOAD_INDEX_UNCHECKED"), Instruction("PRINT"), Instruction("HALT")],
+             "Not an array"),
+        ]
+        for code, message in programs:
+            path = os.path.join(self.tmp.name, "crafted.mpbc")
+            serialize_bytecode(code, [2, 100000000], [], path)
+            result = self.run_vm(path)
+            self.assertEqual(result.returncode, 1, result.stderr)
+            self.assertEqual(result.stdout, "")
+            self.assertIn(message, result.stderr)
+    
+    def test_arrays_survive_collection_and_snapshot(self):
+        """Test aliases still share one array after garbage collection and a resume."""
+        path = self.compile("""a = array(3)
+b = a
+big = 1
+i = 0
+while i < 70:
+    big = big * 2
+    i = i + 1
+i = 0
+while i < 100000:
+    x = big + i
+    a[i - i / 3 * 3] = i
+    i = i + 1
+checkpoint
+b[0] = 7
+print(a)""")
+        result = self.run_vm(path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout, "[7, 99997, 99998]\n")
+        snap = os.path.join(self.tmp.name, "prog.snap")
+        self.assertEqual(self.run_vm("--snapshot", snap, path).returncode, 0)
+        result = self.run_vm("--resume", snap, path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout, "[7, 99997, 99998]\n")
+    
+    def test_strings(self):
+        """Test string constants (repeated, short, long and escaped) behave like the Python VM."""
+        consts = ["hello, world", "hello, world", "hi", "tab\t\"quoted\"\\", "", "hello, worle"]
+        code = []
+        for a, op, b in [(0, "CMP_EQ", 1), (0, "CMP_EQ", 5), (0, "CMP_LT", 5), (2, "CMP_GT", 0),
+                         (2, "ADD", 2), (0, "ADD", 2), (4, "ADD", 3), (2, "CMP_NEQ", 4)]:
+            code += [Instruction("LOAD_CONST", a), Instruction("LOAD_CONST", b),
+                     Instruction(op), Instruction("PRINT")]
+        code += [Instruction("LOAD_CONST", 0), Instruction("LOAD_CONST", 3), Instruction("ADD"),
+                 Instruction("ARRAY_LEN"), Instruction("PRINT"), Instruction("HALT")]
+        path = os.path.join(self.tmp.name, "strings.mpbc")
+        serialize_bytecode(code, consts, [], path)
+        
+        expected = io.StringIO()
+        with contextlib.redirect_stdout(expected):
+            VM(code, consts, []).run()
+        result = self.run_vm(path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout, expected.getvalue())
+    
+    def test_string_building_survives_collection_and_snapshot(self):
+        """Test strings appended to in a loop survive garbage collection and a resume."""
+        path = self.compile("""s = ""
+t = ""
+for i in range(100000):
+    s = s + "ab"
+    t = "c" + t
+    x = 99999999999999999999 + i
+checkpoint
+u = s + t
+print(len(u))
+print(u < s + "d")
+print(u == s + t)
+print(u == t + s)""")
+        expected = "300000\nTrue\nTrue\nFalse\n"
+        result = self.run_vm(path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout, expected)
+        snap = os.path.join(self.tmp.name, "prog.snap")
+        self.assertEqual(self.run_vm("--snapshot", snap, path).returncode, 0)
+        result = self.run_vm("--resume", snap, path)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout, expected)
+    
+    def test_array_builtins_on_every_kernel(self):
+        """Test the AVX2, SSE4.2 and scalar kernels all match the Python VM, vector tails included."""
+        source = """a = array(11)
+for i in range(len(a)):
+    a[i] = i * 1000000000000000000 - 5000000000000000000
+b = array_fill(array(11), 4611686018427387904)
+print(array_sum(a))
+print(array_sum(b))
+print(array_min(a))
+print(array_max(a))
+print(array_count_lt(a, 0))
+print(array_count_lt(a, 4611686018427387904))
+print(array_count_lt(a, 0 - 9223372036854775809))
+out = array(11)
+array_add(a, array_fill(array(11), 3), out)
+print(out)
+print(array_max(array(0)))"""
+        path = self.compile(source)
+        expected = io.StringIO()
+        with contextlib.redirect_stdout(expected):
+            with self.assertRaises(Exception):
+                code, consts, names = compile_ast(Parser(Lexer(source).tokenize()).parse_program())
+                VM(code, consts, names).run()
+        for level in ("avx2", "sse4.2", "scalar"):
+            with self.subTest(level=level):
+                result = self.run_vm("--simd", level, path)
+                self.assertNotEqual(result.returncode, 0)
+                self.assertIn("array_max() of empty array", result.stderr)
+                self.assertEqual(result.stdout, expected.getvalue())
+        self.assertNotEqual(self.run_vm("--simd", "neon", path).returncode, 0)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -13,6 +13,7 @@ from lexer import Lexer
 from parser import Parser
 from compiler import compile_ast
 from vm import VM
+from errors import VMError
 
 
 class TestIntegration(unittest.TestCase):
@@ -101,6 +102,88 @@ else:
         source = "print((2 + 3) * 4)"
         output = self.run_program(source)
         self.assertEqual(output, "20")  # (2 + 3) * 4 = 20
+    
+    def test_recursive_function(self):
+        """Test recursive calls with locals and an implicit return."""
+        source = """def fib(n):
+    if n < 2:
+        return n
+    a = fib(n - 1)
+    b = fib(n - 2)
+    return a + b
+def show(x):
+    print(x)
+show(fib(15))"""
+        output = self.run_program(source)
+        self.assertEqual(output, "610")
+    
+    def test_tail_recursion_is_not_depth_limited(self):
+        """Test tail calls run deeper than the call depth limit."""
+        source = """def count(n, acc):
+    if n == 0:
+        return acc
+    return count(n - 1, acc + 2)
+print(count(5000, 0))"""
+        output = self.run_program(source)
+        self.assertEqual(output, "10000")
+    
+    def test_for_range(self):
+        """Test counting up and down, and an empty range."""
+        source = """total = 0
+for i in range(5):
+    total = total + i
+print(total)
+for i in range(6, 0, 0 - 2):
+    print(i)
+for i in range(3, 3):
+    print(99)"""
+        output = self.run_program(source)
+        self.assertEqual(output, "10\n6\n4\n2")
+    
+    def test_array_builtins(self):
+        """Test the whole-array builtins, including sums past 64 bits."""
+        source = """a = array(5)
+for i in range(len(a)):
+    a[i] = i * 10 - 20
+print(array_sum(a))
+print(array_min(a))
+print(array_max(a))
+print(array_count_lt(a, 5))
+b = array_fill(array(5), 1)
+print(array_add(a, b, b))
+big = array_fill(array(3), 9223372036854775807)
+print(array_sum(big))"""
+        output = self.run_program(source)
+        self.assertEqual(output.split("\n"), ["0", "-20", "20", "3", "[-19, -9, 1, 11, 21]",
+                                               str(3 * (2 ** 63 - 1))])
+    
+    def test_array_builtin_errors(self):
+        """Test empty arrays, mismatched lengths and overflowing sums fail at run time."""
+        for source, message in [
+            ("print(array_min(array(0)))", "array_min() of empty array"),
+            ("a = array(2)\narray_add(a, a, array(3))", "lengths differ"),
+            ("a = array_fill(array(2), 9223372036854775807)\narray_add(a, a, a)", "value out of range"),
+        ]:
+            with self.subTest(source=source):
+                with self.assertRaises(VMError) as raised:
+                    self.run_program(source)
+                self.assertIn(message, str(raised.exception))
+    
+    def test_strings(self):
+        """Test concatenation, comparison, len and string-returning functions."""
+        source = """def repeat(s: str, n: int) -> str:
+    out = ""
+    for i in range(n):
+        out = out + s
+    return out
+s = repeat("ab", 3) + '"!"'
+print(s)
+print(len(s))
+print(s < "b")
+print(s == "ababab" + '"!"')
+print("tab\\there")"""
+        output = self.run_program(source)
+        self.assertEqual(output.split("\n"), ['ababab"!"', "9", "True", "True", "tab\there"])
 
 
 if __name__ == "__main__":
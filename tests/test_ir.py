@@ -0,0 +1,218 @@
+"""Tests for the SSA intermediate representation."""
+
+import unittest
+import sys
+import os
+import io
+import contextlib
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+from lexer import Lexer
+from parser import Parser
+from semantic import SemanticAnalyzer
+from optimizer import Optimizer
+from compiler import compile_ast
+from ir import build_ir, optimize_ir, compile_ir, natural_loops
+from bytecode import SWAP, STORE_INDEX_UNCHECKED
+from vm import VM
+
+
+class TestIR(unittest.TestCase):
+    """Test SSA construction, the SSA passes and lowering to bytecode."""
+    
+    def analyze(self, source):
+        """Parse and analyze source (not optimized, so the SSA passes do the work)."""
+        ast = Parser(Lexer(source).tokenize()).parse_program()
+        self.assertEqual(SemanticAnalyzer().check(ast), [])
+        return ast
+    
+    def function(self, source, name="f", optimize=True):
+        """The IRFunction for one function of source."""
+        for function in build_ir(self.analyze(source)):
+            if function.name == name:
+                return optimize_ir(function) if optimize else function
+        self.fail(f"no function {name}")
+    
+    def instrs(self, function, op):
+        """Every Instr of function with the given op."""
+        return [instr for block in function.blocks for instr in block.instrs if instr.op == op]
+    
+    def run_program(self, code, consts, names):
+        """Run bytecode; return its output and the user's globals."""
+        output = io.StringIO()
+        with contextlib.redirect_stdout(output):
+            result = VM(code, consts, names).run()
+        return output.getvalue(), {name: value for name, value in result.items() if not name.startswith("$")}
+    
+    def test_loop_variables_get_phis(self):
+        """Test a variable assigned in a loop gets a phi at the header, with def-use chains both ways."""
+        function = self.function("""def f(n) -> int:
+    i = 0
+    s = 0
+    while i < n:
+        s = s + i
+        i = i + 1
+    return s""", optimize=False)
+        phis = self.instrs(function, "phi")
+        self.assertEqual(sorted(phi.var for phi in phis), ["i", "s"])
+        for phi in phis:
+            self.assertEqual(len(phi.args), len(phi.block.preds))
+        for block in function.blocks:
+            for instr in block.instrs + [block.terminator]:
+                for arg in instr.args:
+                    self.assertIn(instr, arg.users)
+                for user in instr.users:
+                    self.assertIn(instr, user.args)
+    
+    def test_constant_branch_is_folded(self):
+        """Test constant propagation removes a branch and the side never taken."""
+        function = self.function("""def f() -> int:
+    x = 3
+    if x * 2 > 5:
+        print(1)
+    else:
+        print(2)
+    return x""")
+        self.assertEqual(self.instrs(function, "binop"), [])
+        self.assertEqual([block.terminator.op for block in function.blocks].count("branch"), 0)
+        printed = [instr.args[0].value for instr in self.instrs(function, "print")]
+        self.assertEqual(printed, [1])
+    
+    def test_constant_through_loop(self):
+        """Test a variable the loop only reassigns to itself stays constant (no phi)."""
+        function = self.function("""def f(n) -> int:
+    x = 1
+    i = 0
+    while i < n:
+        x = x * 1
+        i = i + 1
+    return x""")
+        self.assertEqual([phi.var for phi in self.instrs(function, "phi")], ["i"])
+        returns = [block.terminator for block in function.blocks if block.terminator.op == "return"]
+        self.assertEqual([ret.args[0].value for ret in returns], [1])
+    
+    def test_repeated_expression_is_numbered_once(self):
+        """Test global value numbering keeps one a * b (commuted or not)."""
+        function = self.function("""def f(a, b) -> int:
+    print(a * b)
+    if a < b:
+        print(b * a)
+    return a * b""")
+        self.assertEqual(len(self.instrs(function, "binop")), 2)  # a * b and a < b
+    
+    def test_invariant_moves_to_preheader(self):
+        """Test loop-invariant arithmetic leaves the loop but a possibly failing division does not."""
+        function = self.function("""def f(n, k) -> int:
+    s = 0
+    for i in range(n):
+        s = s + k * 4 + n / k
+    return s""")
+        loops = natural_loops(function)
+        self.assertEqual(len(loops), 1)
+        body = next(iter(loops.values()))
+        ops = {instr.value: instr.block in body for instr in self.instrs(function, "binop")}
+        self.assertFalse(ops["*"])
+        self.assertTrue(ops["/"])
+    
+    def test_dead_values_are_removed(self):
+        """Test values no effect depends on are dropped, but a division that may fail is kept."""
+        function = self.function("""def f(a, b) -> int:
+    x = a * b
+    y = a / b
+    return a""")
+        self.assertEqual([instr.value for instr in self.instrs(function, "binop")], ["/"])
+    
+    def test_swapping_loop_uses_parallel_copies(self):
+        """Test phis that read each other are copied in parallel."""
+        source = """def f(n) -> int:
+    a = 1
+    b = 2
+    for i in range(n):
+        t = a
+        a = b
+        b = t
+    return a * 10 + b
+print(f(3))
+print(f(4))"""
+        output, _ = self.run_program(*compile_ir(self.analyze(source)))
+        self.assertEqual(output, "21\n12\n")
+    
+    def test_effects_in_reverse_order_are_swapped(self):
+        """Test b - a, with the call for a made first, stays on the stack and is put in order with SWAP."""
+        source = """def f(x) -> int:
+    print(x)
+    return x
+def g() -> int:
+    a = f(1)
+    b = f(2)
+    return b - a
+print(g())"""
+        code, consts, names = compile_ir(self.analyze(source))
+        self.assertIn(SWAP, [instr.opcode for instr in code])
+        self.assertEqual(self.run_program(code, consts, names)[0], "1\n2\n1\n")
+    
+    def test_lowering_matches_tree_compiler(self):
+        """Test SSA-compiled programs print and leave the same globals as the tree compiler."""
+        programs = [
+            """def fib(n) -> int:
+    if n < 2:
+        return n
+    return fib(n - 1) + fib(n - 2)
+x = 0
+for i in range(12):
+    x = x + fib(i)
+print(x)""",
+            """limit = 20
+def over(n) -> bool:
+    return n > limit
+count = 0
+n = 0
+while n < 40:
+    if over(n):
+        count = count + 1
+    limit = limit + 1
+    n = n + 2
+print(count)
+print(limit)""",
+            """a = 5
+b = a * 3
+c = b
+b = 0
+d = 0
+while d < c:
+    d = d + a
+    y = c * 2 + a
+    print(y - d)
+print(a / 2 == 2)""",
+        ]
+        for source in programs:
+            with self.subTest(source=source.splitlines()[0]):
+                ast = Optimizer().optimize(self.analyze(source))
+                self.assertEqual(self.run_program(*compile_ir(ast)), self.run_program(*compile_ast(ast)))
+    
+    def test_arrays(self):
+        """Test element loads are not hoisted past stores and len() is, matching the tree compiler."""
+        source = """def fill(a: array, v) -> array:
+    for i in range(len(a)):
+        a[i] = v + i
+    return a
+a = fill(array(4), 10)
+s = 0
+i = 0
+while i < len(a):
+    s = s + a[i] * a[0]
+    a[0] = 1
+    i = i + 1
+print(s)
+print(a)
+print(len(array(0)))"""
+        ast = Optimizer().optimize(self.analyze(source))
+        self.assertEqual(len(self.instrs(self.function(source, "fill"), "store_index")), 1)
+        code, consts, names = compile_ir(ast)
+        # The AST optimizer proved the store in fill() in bounds
+        self.assertEqual([instr.opcode for instr in code].count(STORE_INDEX_UNCHECKED), 1)
+        self.assertEqual(self.run_program(code, consts, names), self.run_program(*compile_ast(ast)))
+
+
+if __name__ == '__main__':
+    unittest.main()
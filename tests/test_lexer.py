@@ -2,7 +2,8 @@
 
 import unittest
 from lexer import Lexer, Token, IDENT, NUMBER, KEYWORD, PLUS, MINUS, MUL, DIV
-from lexer import LT, GT, EQEQ, ASSIGN, LPAREN, RPAREN, COLON, NEWLINE, INDENT, DEDENT, EOF
+from lexer import LT, GT, EQEQ, ASSIGN, LPAREN, RPAREN, COLON, NEWLINE, INDENT, DEDENT, EOF, STRING
+from errors import LexerError
 
 
 class TestLexer(unittest.TestCase):
@@ -78,6 +79,17 @@ z = 3"""
         tokens = lexer.tokenize()
         types = [t.type for t in tokens if t.type != EOF]
         self.assertEqual(types, [KEYWORD, LPAREN, IDENT, RPAREN])
+    
+    def test_strings(self):
+        """Test string literals in either quote, with escapes."""
+        tokens = Lexer("""'it' + "a\\t\\"b\\"\\n" """).tokenize()
+        self.assertEqual([(t.type, t.value) for t in tokens if t.type == STRING],
+                         [(STRING, "it"), (STRING, "a\t\"b\"\n")])
+        for source, message in [('"abc', "Unterminated"), ('"a\\q"', "Unknown escape"), ('"\u00e9"', "Unsupported character")]:
+            with self.subTest(source=source):
+                with self.assertRaises(LexerError) as raised:
+                    Lexer(source).tokenize()
+                self.assertIn(message, str(raised.exception))
 
 
 if __name__ == "__main__":
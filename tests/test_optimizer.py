@@ -3,24 +3,30 @@
 import unittest
 import sys
 import os
+import io
+import contextlib
 sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
 
 from lexer import Lexer
 from parser import Parser
-from optimizer import Optimizer
-from ast_nodes import Number, BinOp
+from semantic import SemanticAnalyzer
+from optimizer import Optimizer, MAX_FOLDED_STRING
+from compiler import compile_ast
+from vm import VM
+from ast_nodes import Number, String, BinOp, Assign, If, While, For, ExprStmt
+from bytecode import ARRAY_FILL, ARRAY_ADD, ARRAY_SUM, ARRAY_COUNT_LT, ARRAY_MIN
 
 
 class TestOptimizer(unittest.TestCase):
     """Test constant folding."""
     
-    def parse_and_optimize(self, source):
-        """Parse and optimize source."""
+    def parse_and_optimize(self, source, unroll_factor=1):
+        """Parse and optimize source (without unrolling unless asked, so loops keep their shape)."""
         lexer = Lexer(source)
         tokens = lexer.tokenize()
         parser = Parser(tokens)
         ast = parser.parse_program()
-        optimizer = Optimizer()
+        optimizer = Optimizer(unroll_factor=unroll_factor)
         return optimizer.optimize(ast)
     
     def test_constant_folding_add(self):
@@ -59,6 +65,372 @@ else:
         if_stmt = ast.statements[0]
         # Then body should be empty
         self.assertEqual(len(if_stmt.then_body), 0)
+    
+    def test_hoist_loop_invariant(self):
+        """Test invariant arithmetic moves into a temporary before the loop."""
+        source = """while i < limit * 4 + base:
+    total = total + (limit * 4 + base)
+    i = i + 1
+    print(total)"""
+        ast = self.parse_and_optimize(source)
+        first, second, loop = ast.statements
+        self.assertEqual(repr(first.expr), "BinOp(Var(limit), *, Number(4))")
+        self.assertEqual(repr(second.expr), f"BinOp(Var({first.name}), +, Var(base))")
+        self.assertIsInstance(loop, While)
+        self.assertEqual(loop.cond.right.name, second.name)
+        self.assertEqual(loop.body[0].expr.right.name, second.name)
+        # i is assigned in the loop, so i + 1 stays
+        self.assertEqual(repr(loop.body[1].expr), "BinOp(Var(i), +, Number(1))")
+    
+    def test_no_hoist_of_unsafe_expressions(self):
+        """Test division by a variable and calls are never hoisted."""
+        source = """while i < 10:
+    print(n / d)
+    print(f(n) + 1)
+    i = i + 1"""
+        ast = self.parse_and_optimize(source)
+        self.assertEqual(len(ast.statements), 1)
+    
+    def test_hoist_out_of_nested_loops(self):
+        """Test temporaries of an inner loop move out of the outer loop too."""
+        source = """while i < 3:
+    for j in range(4):
+        total = total + a * b + j
+    i = i + 1"""
+        ast = self.parse_and_optimize(source)
+        hoisted, loop = ast.statements
+        self.assertIsInstance(hoisted, Assign)
+        self.assertEqual(repr(hoisted.expr), "BinOp(Var(a), *, Var(b))")
+        self.assertIsInstance(loop.body[0], For)
+    
+    def test_constant_propagation(self):
+        """Test constants and copies flow into later statements and fold."""
+        source = """x = 3
+y = x * 4
+z = y
+print(z + 1)"""
+        ast = self.parse_and_optimize(source)
+        self.assertEqual(ast.statements[1].expr.value, 12)
+        self.assertEqual(ast.statements[3].expr.value, 13)
+    
+    def test_propagation_merges_branches(self):
+        """Test only facts that hold after both branches survive an if."""
+        source = """if c:
+    x = 1
+    y = 2
+else:
+    x = 1
+    y = 3
+print(x)
+print(y)"""
+        ast = self.parse_and_optimize(source)
+        self.assertIsInstance(ast.statements[1].expr, Number)
+        self.assertEqual(repr(ast.statements[2].expr), "Var(y)")
+    
+    def test_propagation_stops_at_loop_assignments(self):
+        """Test variables assigned in a loop are not treated as constant."""
+        source = """i = 0
+n = 10
+while i < n:
+    i = i + 1
+    print(i)
+print(i)"""
+        ast = self.parse_and_optimize(source)
+        loop = ast.statements[2]
+        self.assertEqual(repr(loop.cond), "BinOp(Var(i), <, Number(10))")
+        self.assertEqual(repr(loop.body[0].expr), "BinOp(Var(i), +, Number(1))")
+        self.assertEqual(repr(ast.statements[3].expr), "Var(i)")
+    
+    def test_dead_stores_in_function(self):
+        """Test locals that are overwritten or never read are dropped."""
+        source = """def f(n):
+    unused = n * 2
+    s = 0
+    for k in range(n):
+        square = k * k
+        s = s + k
+    return s"""
+        body = self.parse_and_optimize(source).statements[0].body
+        self.assertEqual([stmt.name for stmt in body if isinstance(stmt, Assign)], ["s"])
+        self.assertEqual(len(body[1].body), 1)
+    
+    def test_dead_store_keeps_trapping_expression(self):
+        """Test a dead division by a variable is still evaluated."""
+        source = """def f(n):
+    q = 10 / n
+    return n"""
+        body = self.parse_and_optimize(source).statements[0].body
+        self.assertIsInstance(body[0], ExprStmt)
+        self.assertEqual(repr(body[0].expr), "BinOp(Number(10), /, Var(n))")
+    
+    def test_overwritten_global_store_is_dropped(self):
+        """Test a global store overwritten before any read is dropped."""
+        source = """x = y * 2
+x = y * 3
+print(x)"""
+        ast = self.parse_and_optimize(source)
+        self.assertEqual(len(ast.statements), 2)
+        self.assertEqual(repr(ast.statements[0].expr), "BinOp(Var(y), *, Number(3))")
+    
+    def test_reassociate_constants(self):
+        """Test constants cluster: (x + 1) + 2 and 1 + x + 2 both become x + 3."""
+        for source in ["print((x + 1) + 2)", "print(1 + x + 2)", "print(x - 1 + 4)"]:
+            ast = self.parse_and_optimize(source)
+            self.assertEqual(repr(ast.statements[0].expr), "BinOp(Var(x), +, Number(3))")
+        ast = self.parse_and_optimize("print(x * 3 * 4)")
+        self.assertEqual(repr(ast.statements[0].expr), "BinOp(Var(x), *, Number(12))")
+    
+    def test_strength_reduction(self):
+        """Test x * 2 becomes x + x and x - x becomes 0."""
+        ast = self.parse_and_optimize("print(x * 2)\nprint(x - x)")
+        self.assertEqual(repr(ast.statements[0].expr), "BinOp(Var(x), +, Var(x))")
+        self.assertEqual(ast.statements[1].expr.value, 0)
+    
+    def test_comparison_canonicalization(self):
+        """Test constants move right and offsets move across comparisons."""
+        ast = self.parse_and_optimize("print(3 < x)\nprint(x + 2 <= 10)")
+        self.assertEqual(repr(ast.statements[0].expr), "BinOp(Var(x), >, Number(3))")
+        self.assertEqual(repr(ast.statements[1].expr), "BinOp(Var(x), <=, Number(8))")
+    
+    def test_induction_variable_strength_reduction(self):
+        """Test i * 8 + 1 used twice per iteration is carried in an added-to temporary."""
+        source = """while i < n:
+    print(i * 8 + 1)
+    total = total + (i * 8 + 1)
+    i = i + 1"""
+        ast = self.parse_and_optimize(source)
+        setup, loop = ast.statements
+        self.assertEqual(repr(setup.expr), "BinOp(BinOp(Var(i), *, Number(8)), +, Number(1))")
+        self.assertEqual(repr(loop.body[0].expr), f"Var({setup.name})")
+        self.assertEqual(repr(loop.body[-1].expr), f"BinOp(Var({setup.name}), +, Number(8))")
+    
+    def test_closed_form_constant_trip_count(self):
+        """Test a counting loop with a known trip count folds to its final values."""
+        source = """s = 0
+t = 0
+i = 0
+while i < 10:
+    s = s + i * i
+    i = i + 1
+    t = i * 2"""
+        ast = self.parse_and_optimize(source)
+        self.assertFalse(any(isinstance(stmt, While) for stmt in ast.statements))
+        finals = {stmt.name: stmt.expr for stmt in ast.statements if isinstance(stmt, Assign)}
+        self.assertEqual({name: repr(finals[name]) for name in "sti"},
+                         {"s": "Number(285)", "t": "Number(20)", "i": "Number(10)"})
+    
+    def test_closed_form_symbolic_trip_count(self):
+        """Test a loop up to a parameter becomes guarded arithmetic with the loop's results."""
+        source = """def f(n, a) -> int:
+    s = 5
+    i = n
+    while i >= 3:
+        i = i - 2
+        s = s - a * i + 1
+    return s * 100 + i
+"""
+        calls = [(n, a) for n in range(-2, 12) for a in (1, 3)]
+        source += "".join(f"print(f({n + 2} - 2, {a}))\n" for n, a in calls)
+        ast = self.parse_and_optimize(source)
+        self.assertNotIn("While", repr(ast.statements[0].body))
+        
+        def f(n, a):
+            s, i = 5, n
+            while i >= 3:
+                i = i - 2
+                s = s - a * i + 1
+            return s * 100 + i
+        output = io.StringIO()
+        with contextlib.redirect_stdout(output):
+            VM(*compile_ast(ast)).run()
+        self.assertEqual(output.getvalue(), "".join(f"{f(n, a)}\n" for n, a in calls))
+    
+    def test_closed_form_needs_pure_body(self):
+        """Test loops that print or divide keep running."""
+        for body in ("print(i)", "s = s + i / 2"):
+            ast = self.parse_and_optimize(f"""s = 0
+i = 0
+while i < n:
+    {body}
+    i = i + 1""")
+            self.assertIsInstance(ast.statements[-1], While)
+    
+    def test_unroll_counted_loop(self):
+        """Test a counted loop runs four bodies per test, then finishes in a remainder loop."""
+        source = """def f(n) -> int:
+    i = 1
+    while i < n:
+        print(i)
+        i = i + 2
+    return i
+"""
+        ast = self.parse_and_optimize(source + "f(4)", unroll_factor=4)
+        limit, unrolled, remainder = ast.statements[0].body[1:4]
+        self.assertEqual(repr(limit.expr), "BinOp(Var(n), -, Number(6))")
+        self.assertEqual(repr(unrolled.cond), f"BinOp(Var(i), <, Var({limit.name}))")
+        # i is read once per iteration, so the copies read i + 2k and store i once
+        self.assertEqual([repr(stmt) for stmt in unrolled.body],
+                         ["Print(Var(i))", "Print(BinOp(Var(i), +, Number(2)))",
+                          "Print(BinOp(Var(i), +, Number(4)))", "Print(BinOp(Var(i), +, Number(6)))",
+                          "Assign(i, BinOp(Var(i), +, Number(8)))"])
+        self.assertEqual(len(remainder.body), 2)
+        
+        calls = "".join(f"print(f({n}))\n" for n in range(12))
+        expected = ""
+        for n in range(12):
+            odd = list(range(1, n, 2))
+            expected += "".join(f"{i}\n" for i in odd) + f"{odd[-1] + 2 if odd else 1}\n"
+        output = io.StringIO()
+        with contextlib.redirect_stdout(output):
+            VM(*compile_ast(self.parse_and_optimize(source + calls, unroll_factor=4))).run()
+        self.assertEqual(output.getvalue(), expected)
+    
+    def test_unroll_respects_budget(self):
+        """Test the unroll factor shrinks to fit the code-size budget, down to no unrolling."""
+        def loops(body):
+            ast = Parser(Lexer(f"while i < 100:\n    {body}\n    i = i + 1").tokenize()).parse_program()
+            return [stmt for stmt in Optimizer(unroll_factor=8, unroll_budget=30).optimize(ast).statements
+                    if isinstance(stmt, While)]
+        # Two statements and four expression nodes, so five copies (one store of i)
+        unrolled, remainder = loops("print(i)")
+        self.assertEqual(len(unrolled.body), 6)
+        self.assertEqual(len(loops("print(i * i * i * i * i * i * i * i)")), 1)
+    
+    def test_common_subexpression_elimination(self):
+        """Test repeated arithmetic (operands commuted or not) is computed once into a temporary."""
+        source = """def f(a, b, c) -> int:
+    x = (a + b) * c
+    print((b + a) * c + 1)
+    return (a + b) * c - x"""
+        body = self.parse_and_optimize(source).statements[0].body
+        temp = body[0]
+        self.assertEqual(repr(temp.expr), "BinOp(BinOp(Var(a), +, Var(b)), *, Var(c))")
+        self.assertEqual(repr(body[1].expr), f"Var({temp.name})")
+        self.assertEqual(repr(body[2].expr), f"BinOp(Var({temp.name}), +, Number(1))")
+        self.assertEqual(repr(body[3].expr), f"BinOp(Var({temp.name}), -, Var(x))")
+    
+    def test_common_subexpression_availability(self):
+        """Test reuse stops at an operand's assignment and never leaves the branch it was found in."""
+        source = """def f(a, b, c) -> int:
+    if a > b:
+        print(a * b + c)
+    print(a * b + c)
+    a = a * b + c
+    print(a * b + c)
+    return a * b + c"""
+        body = self.parse_and_optimize(source).statements[0].body
+        self.assertIsInstance(body[0], If)
+        # Found after the if: reused by the assignment, then a changes
+        self.assertEqual(repr(body[1].expr), "BinOp(BinOp(Var(a), *, Var(b)), +, Var(c))")
+        self.assertEqual(repr(body[2].expr), f"Var({body[1].name})")
+        self.assertEqual(repr(body[3].expr), f"Var({body[1].name})")
+        self.assertEqual(repr(body[5].expr), f"Var({body[4].name})")
+    
+    def test_bounds_check_elimination(self):
+        """Test accesses proven in bounds lose their check and the rest keep it."""
+        source = """def f(a: array, k) -> int:
+    s = 0
+    for i in range(len(a)):
+        s = s + a[i]
+        a[i] = a[i + 1]
+    j = len(a) - 1
+    while j >= 0:
+        s = s + a[j]
+        j = j - 1
+    if k < len(a):
+        s = s + a[k]
+    return s
+b = array(4)
+b[3] = 1
+print(b[4])"""
+        program = self.parse_and_optimize(source)
+        body = program.statements[0].body
+        loop = body[1].body
+        self.assertFalse(loop[0].expr.right.checked)
+        self.assertFalse(loop[1].checked)
+        # i + 1 may reach len(a)
+        self.assertTrue(loop[1].expr.checked)
+        self.assertFalse(body[3].body[0].expr.right.checked)
+        # k may be negative
+        self.assertTrue(body[4].then_body[0].expr.right.checked)
+        self.assertFalse(program.statements[2].checked)
+        self.assertTrue(program.statements[3].expr.checked)
+    
+    def test_vectorize_array_loops(self):
+        """Test whole-array loops become array builtins and compute what the loops did."""
+        source = """def f(a: array, b: array, c: array, k) -> int:
+    for i in range(len(a)):
+        a[i] = k
+    for i in range(len(b)):
+        b[i] = a[i] + c[i]
+    s = 0
+    for i in range(len(b)):
+        s = s + b[i]
+    i = 0
+    while i < len(b):
+        if b[i] > 3:
+            s = s + 1
+        i = i + 1
+    m = 100
+    for j in range(len(b)):
+        if b[j] < m:
+            m = b[j]
+    return s * 1000 + m * 10 + i
+x = array(5)
+y = array(5)
+z = array(5)
+for i in range(len(z)):
+    print(f(x, y, z, i))
+    z[i] = i
+print(f(x, array(3), z, 2))
+print(y)"""
+        program = self.parse_and_optimize(source)
+        self.assertFalse(any(isinstance(stmt, (For, While)) for stmt in program.statements[0].body))
+        code = compile_ast(program)
+        opcodes = {instr.opcode for instr in code[0]}
+        self.assertLessEqual({ARRAY_FILL, ARRAY_ADD, ARRAY_SUM, ARRAY_COUNT_LT, ARRAY_MIN}, opcodes)
+        
+        def f(k, c):
+            b = [k + value for value in c]
+            return (sum(b) + sum(value > 3 for value in b)) * 1000 + min(b) * 10 + len(b)
+        expected = "".join(f"{f(i, list(range(i)) + [0] * (5 - i))}\n" for i in range(5))
+        output = io.StringIO()
+        with contextlib.redirect_stdout(output):
+            VM(*code).run()
+        # Lengths differ in the last call, so the loop adds instead of array_add()
+        self.assertEqual(output.getvalue(), expected + f"{f(2, [0, 1, 2])}\n[4, 5, 6, 7, 4]\n")
+    
+    def test_vectorize_needs_independent_iterations(self):
+        """Test loops that print, shift elements or see their own stores keep running."""
+        for body in ("print(a[i])", "a[i] = a[i + 1]", "a[i] = i", "s = s + a[i] * 2",
+                     "if a[i] < s:\n        s = s + a[i]"):
+            program = self.parse_and_optimize(f"""s = 0
+a = array(n)
+for i in range(len(a)):
+    {body}
+print(s)""")
+            self.assertIsInstance(program.statements[-2], For, body)
+    
+    def test_string_folding(self):
+        """Test string constants fold (up to a size limit) and concatenation never commutes."""
+        source = f"""def f(s: str) -> bool:
+    return "a" + s == s + "a"
+print("ab" + "cd")
+print("ab" < "b")
+print("x" + "{'y' * MAX_FOLDED_STRING}")
+print(f("a"))
+print(f("b"))"""
+        program = Parser(Lexer(source).tokenize()).parse_program()
+        self.assertEqual(SemanticAnalyzer().check(program), [])
+        program = Optimizer().optimize(program)
+        self.assertEqual(repr(program.statements[1].expr), "String('abcd')")
+        self.assertEqual(repr(program.statements[2].expr), "Number(True)")
+        self.assertIsInstance(program.statements[3].expr, BinOp)
+        self.assertEqual(repr(program.statements[0].body[0].expr.left), "BinOp(String('a'), +, Var(s))")
+        output = io.StringIO()
+        with contextlib.redirect_stdout(output):
+            VM(*compile_ast(program)).run()
+        self.assertEqual(output.getvalue().split("\n")[3:5], ["True", "False"])
 
 
 if __name__ == "__main__":
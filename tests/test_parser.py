@@ -3,7 +3,10 @@
 import unittest
 from lexer import Lexer
 from parser import Parser
-from ast_nodes import Program, Assign, Print, If, While, BinOp, Number, Var
+from ast_nodes import (
+    Program, Assign, Print, If, While, For, Checkpoint, FunctionDef, Return, ExprStmt,
+    BinOp, Number, Var, Call, Index, IndexAssign
+)
 
 
 class TestParser(unittest.TestCase):
@@ -75,6 +78,12 @@ while x < 3:
         self.assertIsInstance(while_stmt.cond, BinOp)
         self.assertEqual(len(while_stmt.body), 1)
     
+    def test_checkpoint_statement(self):
+        """Test parsing checkpoint statement."""
+        ast = self.parse_source("x = 1\ncheckpoint\nprint(x)")
+        self.assertIsInstance(ast.statements[1], Checkpoint)
+        self.assertEqual(len(ast.statements), 3)
+    
     def test_operator_precedence(self):
         """Test operator precedence."""
         ast = self.parse_source("x = 2 + 3 * 4")
@@ -91,6 +100,45 @@ while x < 3:
         assign = ast.statements[0]
         self.assertIsInstance(assign.expr, BinOp)
         self.assertEqual(assign.expr.op, "<")
+    
+    def test_function_definition(self):
+        """Test parsing def with annotations, return and calls."""
+        ast = self.parse_source("""def f(a, b: bool) -> int:
+    return g(a, 1) + 2
+f(1, 2 < 3)""")
+        func = ast.statements[0]
+        self.assertIsInstance(func, FunctionDef)
+        self.assertEqual(func.params, ["a", "b"])
+        self.assertEqual(func.param_types, ["int", "bool"])
+        self.assertEqual(func.return_type, "int")
+        self.assertIsInstance(func.body[0], Return)
+        call = func.body[0].expr.left
+        self.assertIsInstance(call, Call)
+        self.assertEqual(call.name, "g")
+        self.assertEqual(len(call.args), 2)
+        self.assertIsInstance(ast.statements[1], ExprStmt)
+        self.assertIsInstance(ast.statements[1].expr, Call)
+    
+    def test_for_range(self):
+        """Test range() defaults for start and step."""
+        ast = self.parse_source("for i in range(n):\n    print(i)\nfor j in range(1, 9, 2):\n    print(j)")
+        loop = ast.statements[0]
+        self.assertIsInstance(loop, For)
+        self.assertEqual(loop.var, "i")
+        self.assertEqual((loop.start.value, loop.step.value), (0, 1))
+        self.assertIsInstance(loop.stop, Var)
+        self.assertEqual(len(loop.body), 1)
+        self.assertEqual(ast.statements[1].step.value, 2)
+    
+    def test_indexing(self):
+        """Test element loads in expressions and element stores as statements."""
+        ast = self.parse_source("a = array(3)\na[i + 1] = a[0] * 2")
+        store = ast.statements[1]
+        self.assertIsInstance(store, IndexAssign)
+        self.assertEqual(repr(store.array), "Var(a)")
+        self.assertEqual(repr(store.index), "BinOp(Var(i), +, Number(1))")
+        self.assertIsInstance(store.expr.left, Index)
+        self.assertEqual(repr(store.expr.left), "Index(Var(a), Number(0))")
 
 
 if __name__ == "__main__":
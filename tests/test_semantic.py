@@ -62,6 +62,131 @@ else:
     print(0)"""
         errors = self.parse_and_check(source)
         self.assertEqual(len(errors), 0)
+    
+    def test_function_calls_are_checked(self):
+        """Test arity, argument and return types of functions."""
+        source = """def f(a, b: bool) -> int:
+    return a
+x = f(1)
+y = f(1, 2)
+def g() -> bool:
+    return 1
+print(h(1))"""
+        errors = [str(e) for e in self.parse_and_check(source)]
+        self.assertEqual(len(errors), 4)
+        self.assertIn("takes 2 arguments", errors[0])
+        self.assertIn("Argument 2", errors[1])
+        self.assertIn("Return type mismatch", errors[2])
+        self.assertIn("Undefined function", errors[3])
+    
+    def test_function_scope(self):
+        """Test functions see earlier globals but assigned names are local."""
+        valid = """g = 1
+def f(n):
+    m = n + g
+    return m
+print(f(2))"""
+        self.assertEqual(self.parse_and_check(valid), [])
+        
+        # Assigned in the body, so local and unbound when read
+        local = """g = 1
+def f(n):
+    n = g + n
+    g = 2
+    return n"""
+        self.assertGreater(len(self.parse_and_check(local)), 0)
+        self.assertGreater(len(self.parse_and_check("return 1")), 0)
+    
+    def test_for_range_is_checked(self):
+        """Test range() bounds must be int and the step non-zero."""
+        errors = [str(e) for e in self.parse_and_check("""b = 1 < 2
+for i in range(b):
+    print(i)
+for i in range(1, 5, 0):
+    print(i)""")]
+        self.assertEqual(len(errors), 2)
+        self.assertIn("range() stop must be int", errors[0])
+        self.assertIn("step must not be zero", errors[1])
+        self.assertEqual(self.parse_and_check("for i in range(3):\n    print(i)"), [])
+    
+    def test_arrays_are_checked(self):
+        """Test indexing needs an array and an int index, and elements are ints."""
+        valid = """def total(a: array) -> int:
+    s = 0
+    for i in range(len(a)):
+        s = s + a[i]
+    return s
+a = array(4)
+a[1] = 5
+print(total(a))"""
+        self.assertEqual(self.parse_and_check(valid), [])
+        errors = [str(e) for e in self.parse_and_check("""a = array(2)
+n = 3
+a[0] = 1 < 2
+print(n[0])
+print(a[1 < 2])
+print(a == a)
+print(len(n))
+def len(x):
+    return x""")]
+        self.assertEqual(len(errors), 6)
+        self.assertIn("Array elements must be int", errors[0])
+        self.assertIn("Cannot index", errors[1])
+        self.assertIn("Array index must be int", errors[2])
+        self.assertIn("not defined for arrays", errors[3])
+        self.assertIn("Argument 1", errors[4])
+        self.assertIn("already defined", errors[5])
+    
+    def test_array_builtins_are_checked(self):
+        """Test the whole-array builtins' argument types and reserved names."""
+        self.assertEqual(self.parse_and_check("""a = array(3)
+b = array_add(a, array_fill(array(3), 2), array(3))
+print(array_sum(b) + array_min(a) + array_max(b) + array_count_lt(b, 1))"""), [])
+        errors = [str(e) for e in self.parse_and_check("""a = array(3)
+print(array_sum(3))
+array_fill(a, a)
+array_add(a, a)
+x = array_count_lt(a, 1 < 2)
+def array_max(n):
+    return n""")]
+        self.assertEqual(len(errors), 5)
+        self.assertIn("Argument 1", errors[0])
+        self.assertIn("Argument 2", errors[1])
+        self.assertIn("takes 3 arguments", errors[2])
+        self.assertIn("Argument 2", errors[3])
+        self.assertIn("already defined", errors[4])
+        # Only the array_ names are taken
+        self.assertEqual(self.parse_and_check("""def add(a, b) -> int:
+    return a + b
+def sum(a: array) -> int:
+    return array_sum(a)
+print(add(sum(array(2)), 1))"""), [])
+    
+    def test_strings_are_checked(self):
+        """Test strings only concatenate and compare with strings."""
+        valid = """def greet(name: str) -> str:
+    return "hi " + name
+s = greet("bob")
+print(len(s) + 1)
+print(s < "z")
+print(s == s + "")"""
+        self.assertEqual(self.parse_and_check(valid), [])
+        errors = [str(e) for e in self.parse_and_check("""s = "a"
+print(s + 1)
+print(s * 2)
+print(s < 1)
+s = 3
+n = 1
+n = "b"
+if s:
+    print(s)""")]
+        self.assertEqual(len(errors), 6)
+        self.assertIn("requires int operands", errors[0])
+        self.assertIn("requires int operands", errors[1])
+        self.assertIn("requires two int or two str operands", errors[2])
+        self.assertIn("Type mismatch", errors[3])
+        self.assertIn("Type mismatch", errors[4])
+        self.assertIn("Condition must be bool", errors[5])
 
 
 if __name__ == "__main__":
@@ -1,9 +1,13 @@
 """Tests for the virtual machine."""
 
 import unittest
+import io
+import contextlib
 from bytecode import Instruction, LOAD_CONST, LOAD_NAME, STORE_NAME, ADD, SUB, MUL, DIV
-from bytecode import CMP_LT, CMP_GT, CMP_EQ, JUMP, JUMP_IF_FALSE, PRINT, HALT
+from bytecode import CMP_LT, CMP_GT, CMP_EQ, JUMP, JUMP_IF_FALSE, PRINT, CHECKPOINT, HALT
+from bytecode import NEW_ARRAY, ARRAY_LEN, LOAD_INDEX, STORE_INDEX
 from vm import VM
+from errors import VMError
 
 
 class TestVM(unittest.TestCase):
@@ -162,6 +166,63 @@ class TestVM(unittest.TestCase):
         vm = VM(code, consts, names)
         vm.run()
         self.assertEqual(vm.stack, [])  # Should jump before loading anything else
+    
+    def test_checkpoint_is_noop(self):
+        """Test checkpoint does not change execution."""
+        code = [
+            Instruction(LOAD_CONST, 0),
+            Instruction(CHECKPOINT),
+            Instruction(STORE_NAME, 0),
+            Instruction(HALT)
+        ]
+        vm = VM(code, [7], ["x"])
+        vm.run()
+        self.assertEqual(vm.globals["x"], 7)
+    
+    def test_arrays(self):
+        """Test creating, storing into and loading from an array."""
+        code = [
+            Instruction(LOAD_CONST, 0), Instruction(NEW_ARRAY), Instruction(STORE_NAME, 0),
+            Instruction(LOAD_CONST, 1), Instruction(LOAD_NAME, 0), Instruction(LOAD_CONST, 2),
+            Instruction(STORE_INDEX),  # a[1] = 7
+            Instruction(LOAD_NAME, 0), Instruction(LOAD_CONST, 2), Instruction(LOAD_INDEX),
+            Instruction(LOAD_NAME, 0), Instruction(ARRAY_LEN), Instruction(ADD),
+            Instruction(STORE_NAME, 1),
+            Instruction(HALT)
+        ]
+        vm = VM(code, [3, 7, 1], ["a", "x"])
+        vm.run()
+        self.assertEqual(vm.globals["a"], [0, 7, 0])
+        self.assertEqual(vm.globals["x"], 10)
+    
+    def test_array_errors(self):
+        """Test bad sizes, indices and element values are runtime errors."""
+        cases = [
+            ([0], [Instruction(LOAD_CONST, 0), Instruction(NEW_ARRAY), Instruction(LOAD_CONST, 0),
+                   Instruction(LOAD_INDEX)], "index out of range"),
+            ([-1], [Instruction(LOAD_CONST, 0), Instruction(NEW_ARRAY)], "size out of range"),
+            ([2 ** 63, 1, 0], [Instruction(LOAD_CONST, 0), Instruction(LOAD_CONST, 1), Instruction(NEW_ARRAY),
+                               Instruction(LOAD_CONST, 2), Instruction(STORE_INDEX)], "value out of range"),
+        ]
+        for consts, code, message in cases:
+            with self.subTest(message=message):
+                with self.assertRaises(VMError) as raised:
+                    VM(code + [Instruction(HALT)], consts, []).run()
+                self.assertIn(message, str(raised.exception))
+    
+    def test_huge_integers(self):
+        """Test ints print past Python's digit limit and fail past MAX_INT_BITS."""
+        code = [Instruction(LOAD_CONST, 0), Instruction(PRINT), Instruction(HALT)]
+        output = io.StringIO()
+        with contextlib.redirect_stdout(output):
+            VM(code, [-(10 ** 5000)], []).run()
+        self.assertEqual(output.getvalue(), "-1" + "0" * 5000 + "\n")
+        
+        code = [Instruction(LOAD_CONST, 0), Instruction(LOAD_CONST, 0), Instruction(MUL), Instruction(HALT)]
+        VM(code, [2 ** 262000], []).run()
+        with self.assertRaises(VMError) as raised:
+            VM(code, [2 ** 262200], []).run()
+        self.assertIn("Integer too large", str(raised.exception))
 
 
 if __name__ == "__main__":
@@ -1,13 +1,67 @@
 """Stack-based virtual machine for MiniPy."""
 
+import operator
 from bytecode import (
-    LOAD_CONST, LOAD_NAME, STORE_NAME, ADD, SUB, MUL, DIV,
+    LOAD_CONST, LOAD_NAME, STORE_NAME, LOAD_FAST, STORE_FAST, CALL, TAIL_CALL, RETURN,
+    ADD, SUB, MUL, DIV,
     CMP_LT, CMP_GT, CMP_LE, CMP_GE, CMP_EQ, CMP_NEQ,
-    JUMP, JUMP_IF_FALSE, JUMP_IF_TRUE, POP, PRINT, HALT
+    JUMP, JUMP_IF_FALSE, JUMP_IF_TRUE, FOR_RANGE, POP, DUP, SWAP, ROT, PRINT, CHECKPOINT, HALT,
+    NEW_ARRAY, ARRAY_LEN, LOAD_INDEX, LOAD_INDEX_UNCHECKED, STORE_INDEX, STORE_INDEX_UNCHECKED,
+    ARRAY_SUM, ARRAY_MIN, ARRAY_MAX, ARRAY_FILL, ARRAY_ADD, ARRAY_COUNT_LT,
+    JUMP_IF_LT, JUMP_IF_GT, JUMP_IF_LE, JUMP_IF_GE, JUMP_IF_EQ, JUMP_IF_NEQ,
+    ADD_INT, SUB_INT, MUL_INT, DIV_INT,
+    CMP_LT_INT, CMP_GT_INT, CMP_LE_INT, CMP_GE_INT, CMP_EQ_INT, CMP_NEQ_INT
 )
 from errors import VMError
 
 
+# Fused compare-and-branch opcodes and the comparison each one tests
+BRANCH_TESTS = {
+    JUMP_IF_LT: operator.lt,
+    JUMP_IF_GT: operator.gt,
+    JUMP_IF_LE: operator.le,
+    JUMP_IF_GE: operator.ge,
+    JUMP_IF_EQ: operator.eq,
+    JUMP_IF_NEQ: operator.ne,
+}
+
+# Deepest call chain before a call fails, as in the C++ VM
+MAX_CALL_DEPTH = 1000
+
+# Longest array NEW_ARRAY creates, and the range of its elements, as in the C++ VM
+MAX_ARRAY_LENGTH = 1 << 24
+ELEMENT_MIN = -(1 << 63)
+ELEMENT_MAX = (1 << 63) - 1
+
+# Longest string concatenation can build, as in the C++ VM
+MAX_STRING_LENGTH = 1 << 28
+
+# Widest integer arithmetic can produce, as in the C++ VM (2^14 32-bit limbs)
+MAX_INT_BITS = 1 << 19
+
+# Ints below this print with str(), which refuses past sys.get_int_max_str_digits()
+STR_INT_LIMIT = 10 ** 4000
+
+
+def checked_int(value, ip):
+    """Return an arithmetic result, failing if it is an int wider than MAX_INT_BITS."""
+    if isinstance(value, int) and value.bit_length() > MAX_INT_BITS:
+        raise VMError("Integer too large", ip)
+    return value
+
+
+def format_int(value):
+    """Decimal text of an int of any size."""
+    if value < 0:
+        return "-" + format_int(-value)
+    if value < STR_INT_LIMIT:
+        return str(value)
+    # Split at about half the digits (log10(2) is just over 0.3)
+    half = value.bit_length() * 3 // 20
+    high, low = divmod(value, 10 ** half)
+    return format_int(high) + format_int(low).rjust(half, "0")
+
+
 class VM:
     """Stack-based virtual machine."""
     
@@ -17,6 +71,8 @@ class VM:
         self.names = names
         self.stack = []
         self.globals = {}
+        self.frames = []  # (return ip, base) per active call
+        self.base = 0  # Stack index of the current frame's first local
         self.ip = 0  # Instruction pointer
     
     def push(self, value):
@@ -37,6 +93,21 @@ class VM:
             raise VMError("Stack underflow", self.ip)
         return self.stack[-1]
     
+    def pop_array(self):
+        """Pop a value that must be an array."""
+        array = self.pop()
+        if not isinstance(array, list):
+            raise VMError("Not an array", self.ip)
+        return array
+    
+    def pop_element(self):
+        """Pop index then array for an element access, checking both."""
+        index = self.pop()
+        array = self.pop_array()
+        if not 0 <= index < len(array):
+            raise VMError("Array index out of range", self.ip)
+        return array, index
+    
     def run(self):
         """Execute the bytecode."""
         self.ip = 0
@@ -63,25 +134,64 @@ class VM:
                 self.globals[name] = value
                 self.ip += 1
             
-            elif opcode == ADD:
+            elif opcode == LOAD_FAST:
+                self.push(self.stack[self.base + arg])
+                self.ip += 1
+            
+            elif opcode == STORE_FAST:
+                self.stack[self.base + arg] = self.pop()
+                self.ip += 1
+            
+            elif opcode == CALL:
+                # Arguments on the stack become the first locals
+                function = self.consts[arg]
+                if len(self.frames) >= MAX_CALL_DEPTH:
+                    raise VMError("Maximum recursion depth exceeded", self.ip)
+                self.frames.append((self.ip + 1, self.base))
+                self.base = len(self.stack) - function.nparams
+                self.stack.extend([0] * (function.nlocals - function.nparams))
+                self.ip = function.entry
+            
+            elif opcode == TAIL_CALL:
+                # The arguments replace the current frame's locals
+                function = self.consts[arg]
+                if not self.frames:
+                    raise VMError("Return outside function", self.ip)
+                args = self.stack[len(self.stack) - function.nparams:]
+                del self.stack[self.base:]
+                self.stack.extend(args)
+                self.stack.extend([0] * (function.nlocals - function.nparams))
+                self.ip = function.entry
+            
+            elif opcode == RETURN:
+                if not self.frames:
+                    raise VMError("Return outside function", self.ip)
+                result = self.pop()
+                del self.stack[self.base:]
+                self.push(result)
+                self.ip, self.base = self.frames.pop()
+            
+            elif opcode == ADD or opcode == ADD_INT:
                 b = self.pop()
                 a = self.pop()
-                self.push(a + b)
+                if isinstance(a, str) and len(a) + len(b) > MAX_STRING_LENGTH:
+                    raise VMError("String too long", self.ip)
+                self.push(checked_int(a + b, self.ip))
                 self.ip += 1
             
-            elif opcode == SUB:
+            elif opcode == SUB or opcode == SUB_INT:
                 b = self.pop()
                 a = self.pop()
-                self.push(a - b)
+                self.push(checked_int(a - b, self.ip))
                 self.ip += 1
             
-            elif opcode == MUL:
+            elif opcode == MUL or opcode == MUL_INT:
                 b = self.pop()
                 a = self.pop()
-                self.push(a * b)
+                self.push(checked_int(a * b, self.ip))
                 self.ip += 1
             
-            elif opcode == DIV:
+            elif opcode == DIV or opcode == DIV_INT:
                 b = self.pop()
                 a = self.pop()
                 if b == 0:
@@ -89,40 +199,40 @@ class VM:
                 self.push(a // b)  # Integer division
                 self.ip += 1
             
-            elif opcode == CMP_LT:
+            elif opcode == CMP_LT or opcode == CMP_LT_INT:
                 b = self.pop()
                 a = self.pop()
-                self.push(1 if a < b else 0)
+                self.push(a < b)
                 self.ip += 1
             
-            elif opcode == CMP_GT:
+            elif opcode == CMP_GT or opcode == CMP_GT_INT:
                 b = self.pop()
                 a = self.pop()
-                self.push(1 if a > b else 0)
+                self.push(a > b)
                 self.ip += 1
             
-            elif opcode == CMP_LE:
+            elif opcode == CMP_LE or opcode == CMP_LE_INT:
                 b = self.pop()
                 a = self.pop()
-                self.push(1 if a <= b else 0)
+                self.push(a <= b)
                 self.ip += 1
             
-            elif opcode == CMP_GE:
+            elif opcode == CMP_GE or opcode == CMP_GE_INT:
                 b = self.pop()
                 a = self.pop()
-                self.push(1 if a >= b else 0)
+                self.push(a >= b)
                 self.ip += 1
             
-            elif opcode == CMP_EQ:
+            elif opcode == CMP_EQ or opcode == CMP_EQ_INT:
                 b = self.pop()
                 a = self.pop()
-                self.push(1 if a == b else 0)
+                self.push(a == b)
                 self.ip += 1
             
-            elif opcode == CMP_NEQ:
+            elif opcode == CMP_NEQ or opcode == CMP_NEQ_INT:
                 b = self.pop()
                 a = self.pop()
-                self.push(1 if a != b else 0)
+                self.push(a != b)
                 self.ip += 1
             
             elif opcode == JUMP:
@@ -148,13 +258,132 @@ class VM:
                 else:
                     self.ip += 1
             
+            elif opcode in BRANCH_TESTS:
+                b = self.pop()
+                a = self.pop()
+                if BRANCH_TESTS[opcode](a, b):
+                    if arg is None or arg < 0 or arg >= len(self.code):
+                        raise VMError(f"Invalid jump target: {arg}", self.ip)
+                    self.ip = arg
+                else:
+                    self.ip += 1
+            
+            elif opcode == FOR_RANGE:
+                counter, stop, step = self.stack[-3:]
+                if step == 0:
+                    raise VMError("range() step must not be zero", self.ip)
+                if counter < stop if step > 0 else counter > stop:
+                    self.stack[-3] = checked_int(counter + step, self.ip)
+                    self.push(counter)
+                    self.ip += 1
+                else:
+                    del self.stack[-3:]
+                    if arg is None or arg < 0 or arg >= len(self.code):
+                        raise VMError(f"Invalid jump target: {arg}", self.ip)
+                    self.ip = arg
+            
             elif opcode == POP:
                 self.pop()  # Discard top of stack
                 self.ip += 1
             
+            elif opcode == DUP:
+                self.push(self.peek())
+                self.ip += 1
+            
+            elif opcode == SWAP:
+                b = self.pop()
+                a = self.pop()
+                self.push(b)
+                self.push(a)
+                self.ip += 1
+            
+            elif opcode == ROT:
+                c = self.pop()
+                b = self.pop()
+                a = self.pop()
+                self.push(b)
+                self.push(c)
+                self.push(a)
+                self.ip += 1
+            
+            elif opcode == NEW_ARRAY:
+                length = self.pop()
+                if not 0 <= length <= MAX_ARRAY_LENGTH:
+                    raise VMError("Array size out of range", self.ip)
+                self.push([0] * length)
+                self.ip += 1
+            
+            elif opcode == ARRAY_LEN:
+                # len() also counts the characters of a string
+                value = self.pop()
+                if not isinstance(value, (list, str)):
+                    raise VMError("Not an array or string", self.ip)
+                self.push(len(value))
+                self.ip += 1
+            
+            # The reference VM keeps checking the UNCHECKED forms
+            elif opcode == LOAD_INDEX or opcode == LOAD_INDEX_UNCHECKED:
+                array, index = self.pop_element()
+                self.push(array[index])
+                self.ip += 1
+            
+            elif opcode == STORE_INDEX or opcode == STORE_INDEX_UNCHECKED:
+                array, index = self.pop_element()
+                value = self.pop()
+                if not ELEMENT_MIN <= value <= ELEMENT_MAX:
+                    raise VMError("Array value out of range", self.ip)
+                array[index] = int(value)
+                self.ip += 1
+            
+            elif opcode == ARRAY_SUM:
+                self.push(sum(self.pop_array()))
+                self.ip += 1
+            
+            elif opcode == ARRAY_MIN or opcode == ARRAY_MAX:
+                array = self.pop_array()
+                name = "array_min" if opcode == ARRAY_MIN else "array_max"
+                if not array:
+                    raise VMError(f"{name}() of empty array", self.ip)
+                self.push(min(array) if opcode == ARRAY_MIN else max(array))
+                self.ip += 1
+            
+            elif opcode == ARRAY_FILL:
+                value = self.pop()
+                array = self.pop_array()
+                if not ELEMENT_MIN <= value <= ELEMENT_MAX:
+                    raise VMError("Array value out of range", self.ip)
+                array[:] = [int(value)] * len(array)
+                self.push(array)
+                self.ip += 1
+            
+            # Element by element, so a failure leaves the earlier sums written
+            # and out may be a or b, as in the C++ kernels
+            elif opcode == ARRAY_ADD:
+                out = self.pop_array()
+                b = self.pop_array()
+                a = self.pop_array()
+                if not len(a) == len(b) == len(out):
+                    raise VMError("Array lengths differ", self.ip)
+                for i in range(len(a)):
+                    total = a[i] + b[i]
+                    if not ELEMENT_MIN <= total <= ELEMENT_MAX:
+                        raise VMError("Array value out of range", self.ip)
+                    out[i] = total
+                self.push(out)
+                self.ip += 1
+            
+            elif opcode == ARRAY_COUNT_LT:
+                limit = self.pop()
+                self.push(sum(1 for element in self.pop_array() if element < limit))
+                self.ip += 1
+            
             elif opcode == PRINT:
                 value = self.pop()
-                print(value)
+                print(format_int(value) if type(value) is int else value)
+                self.ip += 1
+            
+            elif opcode == CHECKPOINT:
+                # Snapshots are a C++ VM feature; here it only marks the spot
                 self.ip += 1
             
             elif opcode == HALT: